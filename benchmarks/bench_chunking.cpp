@@ -1,11 +1,13 @@
 #include "common/chunker.h"
 #include "common/hash.h"
 #include "common/metrics.h"
+#include "common/thread_pool.h"
 #include <iostream>
 #include <fstream>
 #include <chrono>
 #include <random>
 #include <iomanip>
+#include <set>
 
 using namespace dropboxlite;
 
@@ -64,6 +66,185 @@ void benchmarkChunking(const std::string& file_path, size_t file_size_mb) {
     std::cout << "  Throughput: " << std::setprecision(1) << throughput_mbs << " MB/s\n";
 }
 
+void benchmarkInput(const std::string& file_path, size_t file_size_mb) {
+    std::vector<std::pair<FileInput, std::string>> inputs = {
+        {FileInput::Stream, "Stream (ifstream window)"},
+        {FileInput::Mapped, "Mapped (mmap, zero-copy)"}
+    };
+    
+    std::vector<double> throughputs;
+    for (const auto& [input, name] : inputs) {
+        Chunker chunker;
+        chunker.setFileInput(input);
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        chunker.chunkFile(file_path);
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+        double seconds = duration.count() / 1000.0;
+        throughputs.push_back(file_size_mb / seconds);
+        
+        std::cout << "  " << name << ": " << std::fixed << std::setprecision(1)
+                  << throughputs.back() << " MB/s\n";
+    }
+    
+    std::cout << "  Mapped speedup: " << std::setprecision(2)
+              << (throughputs[1] / throughputs[0]) << "x\n";
+}
+
+void benchmarkAlgorithms(const std::string& file_path, size_t file_size_mb) {
+    std::vector<std::pair<ChunkingAlgorithm, std::string>> algorithms = {
+        {ChunkingAlgorithm::Rabin, "Rabin (legacy)"},
+        {ChunkingAlgorithm::Gear, "Gear (FastCDC)"}
+    };
+    
+    std::vector<std::vector<ChunkInfo>> results;
+    for (const auto& [algorithm, name] : algorithms) {
+        Chunker chunker(algorithm);
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        results.push_back(chunker.chunkFile(file_path));
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+        double seconds = duration.count() / 1000.0;
+        auto stats = chunker.getLastStats();
+        
+        std::cout << "  " << name << ": " << std::fixed << std::setprecision(1)
+                  << (file_size_mb / seconds) << " MB/s, "
+                  << stats.total_chunks << " chunks, avg "
+                  << (stats.avg_size / 1024.0) << " KB\n";
+    }
+    
+    // Count cut points the two algorithms agree on
+    std::set<size_t> cuts;
+    for (const auto& chunk : results[0]) {
+        cuts.insert(chunk.offset + chunk.size);
+    }
+    size_t shared = 0;
+    for (const auto& chunk : results[1]) {
+        shared += cuts.count(chunk.offset + chunk.size);
+    }
+    
+    std::cout << "  Same boundaries: "
+              << (Chunker::sameBoundaries(results[0], results[1]) ? "yes" : "no")
+              << " (" << shared << " shared cut points)\n";
+}
+
+void benchmarkScaling(const std::string& file_path, size_t file_size_mb) {
+    // Only mapped (or in-memory) input is split across the pool; streamed
+    // input is always scanned sequentially
+    Chunker sequential;
+    sequential.setFileInput(FileInput::Mapped);
+    
+    auto start = std::chrono::high_resolution_clock::now();
+    auto expected = sequential.chunkFile(file_path);
+    auto end = std::chrono::high_resolution_clock::now();
+    double base_seconds = std::chrono::duration<double>(end - start).count();
+    
+    std::cout << "  Sequential: " << std::fixed << std::setprecision(1)
+              << (file_size_mb / base_seconds) << " MB/s\n";
+    
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        ThreadPool pool(threads);
+        Chunker chunker;
+        chunker.setFileInput(FileInput::Mapped);
+        chunker.setThreadPool(&pool);
+        
+        start = std::chrono::high_resolution_clock::now();
+        auto chunks = chunker.chunkFile(file_path);
+        end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        
+        std::cout << "  " << std::setw(3) << threads << " threads: "
+                  << std::setprecision(1) << (file_size_mb / seconds) << " MB/s ("
+                  << std::setprecision(2) << (base_seconds / seconds) << "x), boundaries "
+                  << (Chunker::sameBoundaries(expected, chunks) ? "match" : "DIFFER") << "\n";
+    }
+}
+
+void benchmarkKernels(const std::string& file_path, size_t file_size_mb) {
+    std::ifstream file(file_path, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+    
+    // Boundary scan only, so hashing and I/O don't hide kernel differences
+    auto scanAll = [&data](const Chunker& chunker) {
+        std::vector<size_t> cuts;
+        for (size_t offset = 0; offset < data.size(); ) {
+            offset += chunker.findBoundary(data.data() + offset, data.size() - offset);
+            cuts.push_back(offset);
+        }
+        return cuts;
+    };
+    
+    Chunker scalar;
+    scalar.setScanKernel(ScanKernel::Scalar);
+    auto expected = scanAll(scalar);
+    
+    std::cout << "  Detected: " << GearScan::name(GearScan::best()) << "\n";
+    for (auto kernel : {ScanKernel::Scalar, ScanKernel::SSE42,
+                        ScanKernel::AVX2, ScanKernel::AVX512}) {
+        Chunker chunker;
+        if (!chunker.setScanKernel(kernel)) {
+            std::cout << "  " << GearScan::name(kernel) << ": unsupported\n";
+            continue;
+        }
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        auto cuts = scanAll(chunker);
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        
+        std::cout << "  " << GearScan::name(kernel) << ": " << std::fixed
+                  << std::setprecision(1) << (file_size_mb / seconds) << " MB/s, boundaries "
+                  << (cuts == expected ? "match" : "DIFFER") << "\n";
+    }
+}
+
+void benchmarkBatchHashing(const std::string& file_path, size_t file_size_mb) {
+    std::ifstream file(file_path, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+    
+    // Hash the file's real chunks, Chunker::kHashBatchSize at a time
+    Chunker chunker;
+    auto chunks = chunker.chunkData(data);
+    std::vector<std::span<const uint8_t>> inputs;
+    for (const auto& chunk : chunks) {
+        inputs.emplace_back(data.data() + chunk.offset, chunk.size);
+    }
+    
+    std::cout << "  Detected: " << Hash::sha256KernelName(Hash::bestSha256Kernel()) << "\n";
+    for (auto kernel : {Sha256Kernel::Scalar, Sha256Kernel::SHANI, Sha256Kernel::AVX2}) {
+        if (!Hash::isSupported(kernel)) {
+            std::cout << "  " << Hash::sha256KernelName(kernel) << ": unsupported\n";
+            continue;
+        }
+        
+        std::vector<Digest> digests(inputs.size());
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t first = 0; first < inputs.size(); first += Chunker::kHashBatchSize) {
+            size_t count = std::min(Chunker::kHashBatchSize, inputs.size() - first);
+            Hash::sha256Batch(std::span(inputs).subspan(first, count),
+                              std::span(digests).subspan(first, count), kernel);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        
+        bool match = true;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            match = match && digests[i] == chunks[i].hash;
+        }
+        
+        std::cout << "  " << Hash::sha256KernelName(kernel) << ": " << std::fixed
+                  << std::setprecision(1) << (file_size_mb / seconds) << " MB/s, digests "
+                  << (match ? "match" : "DIFFER") << "\n";
+    }
+}
+
 void benchmarkHashing(const std::string& file_path, size_t file_size_mb) {
     auto start = std::chrono::high_resolution_clock::now();
     std::string hash = Hash::sha256File(file_path);
@@ -76,9 +257,35 @@ void benchmarkHashing(const std::string& file_path, size_t file_size_mb) {
     std::cout << "  Hash: " << hash.substr(0, 16) << "...\n";
     std::cout << "  Time: " << std::fixed << std::setprecision(2) << seconds << " seconds\n";
     std::cout << "  Throughput: " << std::setprecision(1) << throughput_mbs << " MB/s\n";
+    
+    // BLAKE3 streamed through the double-buffered reader, then as parallel subtrees
+    ThreadPool pool;
+    FileHashOptions parallel;
+    parallel.parallel_threshold = 0;
+    parallel.pool = &pool;
+    
+    for (const auto& [name, options] : {std::pair{"BLAKE3", FileHashOptions{}},
+                                        std::pair{"BLAKE3 parallel", parallel}}) {
+        start = std::chrono::high_resolution_clock::now();
+        auto digest = Hash::fileDigest(HashAlgorithm::BLAKE3, file_path, options);
+        end = std::chrono::high_resolution_clock::now();
+        seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << "  " << name << ": " << std::fixed << std::setprecision(1)
+                  << (file_size_mb / seconds) << " MB/s"
+                  << (digest ? "" : " (failed)") << "\n";
+    }
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // "compare" runs legacy Rabin and FastCDC gear chunking side by side,
+    // "scaling" runs parallel chunking at increasing thread counts,
+    // "kernels" times each boundary-scan kernel without hashing, then each
+    // batched SHA256 kernel over the resulting chunks
+    std::string mode = argc > 1 ? argv[1] : "";
+    bool compare = mode == "compare";
+    bool scaling = mode == "scaling";
+    bool kernels = mode == "kernels";
+    
     std::cout << "=== Dropbox Lite Performance Benchmarks ===\n\n";
     
     const size_t test_size_mb = 100; // 100MB test file
@@ -98,9 +305,38 @@ int main() {
         std::cout << "Generating test file...\n";
         generateTestFile(file_path, test_size_mb, type);
         
+        if (kernels) {
+            std::cout << "\n### Boundary Scan Kernels\n";
+            benchmarkKernels(file_path, test_size_mb);
+            std::cout << "\n### Batched SHA256 Kernels\n";
+            benchmarkBatchHashing(file_path, test_size_mb);
+            std::cout << "\n" << std::string(60, '-') << "\n\n";
+            std::remove(file_path.c_str());
+            continue;
+        }
+        
+        if (scaling) {
+            std::cout << "\n### Parallel Chunking Scaling\n";
+            benchmarkScaling(file_path, test_size_mb);
+            std::cout << "\n" << std::string(60, '-') << "\n\n";
+            std::remove(file_path.c_str());
+            continue;
+        }
+        
+        if (compare) {
+            std::cout << "\n### Chunking Algorithms\n";
+            benchmarkAlgorithms(file_path, test_size_mb);
+            std::cout << "\n" << std::string(60, '-') << "\n\n";
+            std::remove(file_path.c_str());
+            continue;
+        }
+        
         std::cout << "\n### Chunking Performance\n";
         benchmarkChunking(file_path, test_size_mb);
         
+        std::cout << "\n### Input Path (chunking + per-chunk SHA256)\n";
+        benchmarkInput(file_path, test_size_mb);
+        
         std::cout << "\n### Hashing Performance (SHA256)\n";
         benchmarkHashing(file_path, test_size_mb);
         
@@ -1,8 +1,9 @@
 #include "common/chunker.h"
 #include "common/hash.h"
+#include "common/parallel.h"
 #include <iostream>
 #include <fstream>
-#include <set>
+#include <unordered_set>
 #include <iomanip>
 
 using namespace dropboxlite;
@@ -37,29 +38,45 @@ int main() {
     std::cout << "Creating " << num_files << " similar files (90% overlap)...\n";
     createSimilarFiles(base_path, num_files);
     
-    Chunker chunker;
-    std::set<std::string> unique_chunks;
+    std::unordered_set<Digest> unique_chunks;
     size_t total_chunks = 0;
     size_t total_bytes = 0;
     size_t unique_bytes = 0;
     
-    // Process each file
-    for (int i = 0; i < num_files; i++) {
-        std::string file_path = base_path + "_" + std::to_string(i) + ".txt";
-        auto chunks = chunker.chunkFile(file_path);
-        
-        for (const auto& chunk : chunks) {
-            total_chunks++;
-            total_bytes += chunk.size;
-            
-            if (unique_chunks.insert(chunk.hash).second) {
-                // New unique chunk
-                unique_bytes += chunk.size;
-            }
-        }
-        
-        std::remove(file_path.c_str());
-    }
+    // Chunk files in parallel; tally them in order, so the results match a
+    // sequential run
+    struct FileChunks {
+        std::string path;
+        std::vector<ChunkInfo> chunks;
+    };
+    
+    ThreadPool pool;
+    int next_file = 0;
+    Pipeline<FileChunks> pipeline(2 * pool.size());
+    pipeline.source([&](FileChunks& file) {
+                if (next_file == num_files) {
+                    return false;
+                }
+                file.path = base_path + "_" + std::to_string(next_file++) + ".txt";
+                return true;
+            })
+            .stage(StageMode::Parallel, [](FileChunks& file) {
+                Chunker chunker;
+                file.chunks = chunker.chunkFile(file.path);
+            })
+            .stage(StageMode::Serial, [&](FileChunks& file) {
+                for (const auto& chunk : file.chunks) {
+                    total_chunks++;
+                    total_bytes += chunk.size;
+                    
+                    if (unique_chunks.insert(chunk.hash).second) {
+                        // New unique chunk
+                        unique_bytes += chunk.size;
+                    }
+                }
+                std::remove(file.path.c_str());
+            })
+            .run(pool);
     
     double dedup_ratio = 100.0 * (1.0 - (double)unique_bytes / total_bytes);
     double storage_savings = 100.0 * (total_bytes - unique_bytes) / total_bytes;
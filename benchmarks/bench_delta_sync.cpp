@@ -2,8 +2,9 @@
 #include "common/hash.h"
 #include <iostream>
 #include <fstream>
-#include <set>
+#include <unordered_set>
 #include <iomanip>
+#include <filesystem>
 
 using namespace dropboxlite;
 
@@ -61,7 +62,7 @@ int main() {
         auto modified_chunks = chunker.chunkFile(modified_path);
         
         // Build hash set of original chunks
-        std::set<std::string> original_hashes;
+        std::unordered_set<Digest> original_hashes;
         size_t original_bytes = 0;
         for (const auto& chunk : original_chunks) {
             original_hashes.insert(chunk.hash);
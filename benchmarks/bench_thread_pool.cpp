@@ -0,0 +1,193 @@
+#include "common/thread_pool.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+using namespace dropboxlite;
+
+// The previous pool design, kept here as the baseline: one queue behind one
+// mutex and one condition variable, notified per task
+class LockedQueuePool {
+public:
+    explicit LockedQueuePool(size_t num_threads) {
+        for (size_t i = 0; i < num_threads; i++) {
+            workers_.emplace_back([this] {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                        if (stop_ && tasks_.empty()) {
+                            return;
+                        }
+                        task = std::move(tasks_.front());
+                        tasks_.pop();
+                    }
+                    task();
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        active_--;
+                    }
+                    done_.notify_all();
+                }
+            });
+        }
+    }
+
+    ~LockedQueuePool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        condition_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    // Same packaging as ThreadPool::enqueue, so only scheduling differs
+    template<typename F>
+    std::future<void> enqueue(F&& f) {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(f));
+        std::future<void> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace([task] { (*task)(); });
+            active_++;
+        }
+        condition_.notify_one();
+        return result;
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return active_ == 0; });
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::condition_variable done_;
+    size_t active_ = 0;
+    bool stop_ = false;
+};
+
+constexpr size_t kTasks = 200000;
+
+// Millions of tasks per second
+double rate(size_t tasks, std::chrono::high_resolution_clock::time_point start) {
+    auto end = std::chrono::high_resolution_clock::now();
+    return tasks / std::chrono::duration<double>(end - start).count() / 1e6;
+}
+
+// Every thread of the pool's size submits an equal share of empty tasks at
+// once, so submissions and dequeues contend as hard as they can
+template<typename Pool>
+double floodRate(Pool& pool, size_t threads) {
+    std::atomic<size_t> ran{0};
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < threads; p++) {
+        producers.emplace_back([&pool, &ran, threads] {
+            for (size_t i = 0; i < kTasks / threads; i++) {
+                pool.enqueue([&ran] { ran.fetch_add(1, std::memory_order_relaxed); });
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    pool.wait();
+    return rate(ran.load(), start);
+}
+
+// Tasks splitting into two until the leaves, all submitted from inside the
+// pool; the shape of parallel divide-and-conquer
+template<typename Pool>
+double fanOutRate(Pool& pool) {
+    constexpr int kDepth = 17;
+    std::atomic<size_t> ran{0};
+    std::function<void(int)> split = [&](int depth) {
+        ran.fetch_add(1, std::memory_order_relaxed);
+        if (depth > 0) {
+            pool.enqueue([&split, depth] { split(depth - 1); });
+            pool.enqueue([&split, depth] { split(depth - 1); });
+        }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    pool.enqueue([&split] { split(kDepth); });
+    pool.wait();
+    return rate(ran.load(), start);
+}
+
+// One producer, tiny tasks, through each submission path
+void benchmarkSubmission() {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    ThreadPool pool(threads);
+    std::atomic<size_t> ran{0};
+    auto work = [&ran] { ran.fetch_add(1, std::memory_order_relaxed); };
+    
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < kTasks; i++) {
+        pool.enqueue(work);
+    }
+    pool.wait();
+    double enqueue_rate = rate(kTasks, start);
+    
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < kTasks; i++) {
+        pool.submit(work);
+    }
+    pool.wait();
+    double submit_rate = rate(kTasks, start);
+    
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < kTasks; i++) {
+        pool.post(work);
+    }
+    pool.wait();
+    double post_rate = rate(kTasks, start);
+    
+    std::cout << std::fixed << std::setprecision(2)
+              << "  enqueue (std::future): " << enqueue_rate << " Mtasks/s\n"
+              << "  submit (pooled Future): " << submit_rate << " Mtasks/s\n"
+              << "  post (no result):       " << post_rate << " Mtasks/s\n";
+}
+
+int main() {
+    std::cout << "=== Thread Pool Contention Benchmark ===\n\n";
+    std::cout << "Mtasks/s, empty tasks; locked = single mutex-guarded queue\n\n";
+    std::cout << "threads   flood(locked)  flood(stealing)  fan-out(locked)  fan-out(stealing)\n";
+
+    for (size_t threads = 1; threads <= 64; threads *= 2) {
+        double locked_flood, stealing_flood, locked_fan, stealing_fan;
+        {
+            LockedQueuePool pool(threads);
+            locked_flood = floodRate(pool, threads);
+            locked_fan = fanOutRate(pool);
+        }
+        {
+            ThreadPool pool(threads);
+            stealing_flood = floodRate(pool, threads);
+            stealing_fan = fanOutRate(pool);
+        }
+
+        std::cout << std::setw(7) << threads << std::fixed << std::setprecision(2)
+                  << std::setw(16) << locked_flood
+                  << std::setw(17) << stealing_flood
+                  << std::setw(17) << locked_fan
+                  << std::setw(19) << stealing_fan << "\n";
+    }
+
+    std::cout << "\n### Submission Paths (" << std::max(1u, std::thread::hardware_concurrency())
+              << " threads)\n";
+    benchmarkSubmission();
+    
+    return 0;
+}
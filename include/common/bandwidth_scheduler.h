@@ -0,0 +1,150 @@
+#pragma once
+
+#include "common/executor.h"
+#include "common/inline_task.h"
+#include "common/timer_wheel.h"
+#include <chrono>
+#include <coroutine>
+#include <memory>
+#include <optional>
+#include <string>
+#include <cstdint>
+
+namespace dropboxlite {
+
+// Hierarchical fair-share bandwidth scheduler for one direction of
+// traffic: a global cap over per-client caps over per-transfer caps.
+//
+// Requests queue per transfer and are granted one at a time whenever the
+// global bucket has credit. The next grant goes to the client with the
+// least weighted service so far (stride scheduling, like ThreadPool's
+// WeightedFair lanes), then to that client's least-served transfer, so
+// clients share the global rate in proportion to their weights however
+// many requests each has queued. A client or transfer held back by its own
+// cap is skipped and its share goes to the others; an idle one accrues no
+// credit. One client's 500 GB upload therefore gets its weighted share and
+// no more while small syncs are waiting.
+//
+// Grants are "send, then pay": a request is granted when its caps are out
+// of debt and its bytes are then charged to all three, so requests larger
+// than a bucket's burst still go through. Held-back requests are retried
+// from a TimerWheel, never by sleeping threads.
+//
+// Caps and weights can be changed at any time; publishMetrics() and
+// writeOpenMetrics() expose them with the traffic they shape. A rate of 0
+// means uncapped.
+class BandwidthScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+    class Transfer;
+
+    struct ClientStats {
+        size_t rate_limit;   // Bytes per second, 0 if uncapped
+        uint32_t weight;
+        uint64_t bytes;      // Granted so far
+        size_t queued;       // Requests waiting
+        size_t transfers;    // Open transfers
+    };
+
+    explicit BandwidthScheduler(size_t bytes_per_second = 0);
+    ~BandwidthScheduler();
+
+    BandwidthScheduler(const BandwidthScheduler&) = delete;
+    BandwidthScheduler& operator=(const BandwidthScheduler&) = delete;
+
+    // Start a transfer for client_id, sharing the client's bandwidth with
+    // its other transfers in proportion to weight
+    Transfer open(const std::string& client_id, uint32_t weight = 1, size_t bytes_per_second = 0);
+
+    void setGlobalRate(size_t bytes_per_second);
+    size_t globalRate() const;
+
+    // Cap and weight of one client, overriding the default
+    void setClientLimit(const std::string& client_id, size_t bytes_per_second, uint32_t weight = 1);
+    // Back to the default
+    void clearClientLimit(const std::string& client_id);
+    // For clients without their own limit
+    void setDefaultClientLimit(size_t bytes_per_second, uint32_t weight = 1);
+
+    // nullopt if the client has no transfers and no limit of its own
+    std::optional<ClientStats> clientStats(const std::string& client_id) const;
+
+    // Wheel for retrying held-back requests; TimerWheel::shared() if unset
+    void setTimerWheel(TimerWheel* wheel);
+
+    // Gauges <prefix>.{rate_limit,bytes,queued,clients}
+    void publishMetrics(const std::string& prefix) const;
+
+    // Per-client OpenMetrics families <prefix>_client_{rate_limit,weight,
+    // queued,transfers} (gauges) and <prefix>_client_bytes (counter), one
+    // sample per current client labelled client="<id>". Labels rather than
+    // metric names keep the registry from growing with every client seen.
+    // For MetricsServer::addExporter.
+    void writeOpenMetrics(std::string& out, const std::string& prefix) const;
+
+private:
+    struct State;
+    struct ClientNode;
+    struct TransferNode;
+
+    std::shared_ptr<State> state_;
+};
+
+// One flow through the scheduler (an upload or download stream). Closes
+// when destroyed; requests already queued are still granted.
+class BandwidthScheduler::Transfer {
+public:
+    Transfer() = default;
+    Transfer(Transfer&& other) noexcept;
+    Transfer& operator=(Transfer&& other) noexcept;
+    Transfer(const Transfer&) = delete;
+    Transfer& operator=(const Transfer&) = delete;
+    ~Transfer();
+
+    bool valid() const { return node_ != nullptr; }
+
+    // Block until bytes are granted
+    void acquire(size_t bytes);
+
+    // done runs once bytes are granted: on this thread if they are at
+    // once, else on whichever thread granted them (another transfer's
+    // caller or the timer wheel), so keep it short
+    void acquireAsync(size_t bytes, InlineTask done);
+
+    // co_await acquireAsync(executor, bytes) inside a Task; resumes on
+    // the executor's pool
+    auto acquireAsync(Executor& executor, size_t bytes) { return Awaiter{*this, executor, bytes}; }
+
+    void setWeight(uint32_t weight);
+    void setRate(size_t bytes_per_second);
+
+    // Bytes granted so far
+    uint64_t bytes() const;
+
+private:
+    friend class BandwidthScheduler;
+
+    struct Awaiter {
+        Transfer& transfer;
+        Executor& executor;
+        size_t bytes;
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            ThreadPool& pool = executor.pool();
+            Priority priority = pool.inheritedPriority();
+            transfer.acquireAsync(bytes, [&pool, handle, priority] {
+                pool.post(priority, [handle] { handle.resume(); });
+            });
+        }
+        void await_resume() noexcept {}
+    };
+
+    Transfer(std::shared_ptr<State> state, TransferNode* node) : state_(std::move(state)), node_(node) {}
+    void close();
+
+    std::shared_ptr<State> state_;
+    TransferNode* node_ = nullptr;
+};
+
+} // namespace dropboxlite
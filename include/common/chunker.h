@@ -3,13 +3,48 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <functional>
+#include <istream>
+#include <span>
+#include <optional>
+#include "common/digest.h"
+#include "common/gear_scan.h"
+#include "common/hash.h"
 
 namespace dropboxlite {
 
+class ThreadPool;
+
 struct ChunkInfo {
     size_t offset;
     size_t size;
-    std::string hash;
+    Digest hash;
+};
+
+// Everything a single read pass over a file yields
+struct FileFingerprint {
+    std::vector<ChunkInfo> chunks;
+    Digest file_hash;
+    size_t size;
+};
+
+// Receives each chunk as soon as its boundary is known. data points at the
+// chunk's bytes and is only valid for the duration of the call.
+using ChunkCallback = std::function<void(const ChunkInfo& chunk, const uint8_t* data)>;
+
+// Boundary detection algorithm used by Chunker
+enum class ChunkingAlgorithm {
+    Rabin,  // Legacy polynomial rolling hash, kept for boundary compatibility
+    Gear    // FastCDC gear hash with normalized chunking
+};
+
+// How chunkFile reads its input
+enum class FileInput {
+    Stream,  // Read through a fixed-size window (works on pipes and special files)
+    // mmap the file and chunk/hash straight from the mapped pages. Only for
+    // files nobody truncates while they are read: touching a mapped page
+    // past a shrunken end raises SIGBUS and kills the process.
+    Mapped
 };
 
 class Chunker {
@@ -20,17 +55,80 @@ public:
     static constexpr size_t kMaxChunkSize = 1024 * 1024;   // 1MB
     static constexpr uint64_t kMaskBits = 16;              // For ~64KB avg
     static constexpr uint64_t kMask = (1ULL << kMaskBits) - 1;
-    
-    Chunker() = default;
-    
+
+    // FastCDC normalized chunking (level 2): a stricter mask before the
+    // average size and a looser one after it. Masks use high bits (below
+    // bit 63) since low gear-hash bits only see the last few bytes.
+    static constexpr uint64_t kGearMaskS =
+        ((1ULL << (kMaskBits + 2)) - 1) << (63 - (kMaskBits + 2));
+    static constexpr uint64_t kGearMaskL =
+        ((1ULL << (kMaskBits - 2)) - 1) << (63 - (kMaskBits - 2));
+
+    // Streaming window: one max-size chunk being scanned plus room to refill
+    static constexpr size_t kStreamWindowSize = 2 * kMaxChunkSize;
+
+    // Parallel mode splits input into segments of at least this size
+    static constexpr size_t kMinSegmentSize = 4 * kMaxChunkSize;
+
+    // Chunks whose boundaries are known are hashed in groups of this many
+    // with Hash::digestBatch
+    static constexpr size_t kHashBatchSize = 16;
+
+    explicit Chunker(ChunkingAlgorithm algorithm = ChunkingAlgorithm::Gear)
+        : algorithm_(algorithm), scan_(GearScan::get(ScanKernel::Auto)) {}
+
+    ChunkingAlgorithm algorithm() const { return algorithm_; }
+
+    // Stream by default, since client files can change under us. Mapped
+    // input falls back to streaming if the file cannot be mapped.
+    void setFileInput(FileInput input) { file_input_ = input; }
+    FileInput fileInput() const { return file_input_; }
+
+    // Force a gear boundary-scan kernel (Auto picks the best for this CPU).
+    // Returns false and keeps the current kernel if the CPU lacks support.
+    bool setScanKernel(ScanKernel kernel);
+
+    // Strong hash for chunk and whole-file digests
+    void setHashAlgorithm(HashAlgorithm algorithm) { hash_algorithm_ = algorithm; }
+    HashAlgorithm hashAlgorithm() const { return hash_algorithm_; }
+
+    // Parallel mode (nullptr disables): in-memory and mapped input is split
+    // into segments scanned speculatively on the pool, then stitched so cut
+    // points match a sequential scan exactly. Chunk hashing is spread across
+    // the pool too. Must not be called from a task running on the same pool.
+    void setThreadPool(ThreadPool* pool) { pool_ = pool; }
+
     // Split file into variable-size chunks based on content
     // Returns empty vector on error
     std::vector<ChunkInfo> chunkFile(const std::string& filepath);
-    
+
+    // Stream file through a fixed window, emitting chunks as they are found.
+    // Memory stays at kStreamWindowSize regardless of file size.
+    // Returns false if the file cannot be opened or read.
+    bool chunkFile(const std::string& filepath, const ChunkCallback& callback);
+    bool chunkStream(std::istream& input, const ChunkCallback& callback);
+
+    // Chunk a file and hash the whole file in the same read pass, so callers
+    // never re-read it for the file digest. Returns nullopt on error.
+    std::optional<FileFingerprint> fingerprintFile(const std::string& filepath);
+    std::optional<Digest> fingerprintFile(const std::string& filepath,
+                                          const ChunkCallback& callback);
+
+    // Chunk and hash an in-memory range without copying it
+    void chunkSpan(std::span<const uint8_t> data, const ChunkCallback& callback);
+
     // Split data buffer into chunks
     // Uses FastCDC algorithm for better chunk distribution
     std::vector<ChunkInfo> chunkData(const std::vector<uint8_t>& data);
-    
+
+    // Length of the chunk starting at data[0], given size bytes available.
+    // Boundaries depend only on the chunk's own bytes, never on prior state.
+    size_t findBoundary(const uint8_t* data, size_t size) const;
+
+    // True if both chunk lists cut the data at the same offsets
+    static bool sameBoundaries(const std::vector<ChunkInfo>& a,
+                               const std::vector<ChunkInfo>& b);
+
     // Get chunking statistics
     struct ChunkStats {
         size_t total_chunks;
@@ -39,10 +137,26 @@ public:
         double avg_size;
     };
     ChunkStats getLastStats() const { return last_stats_; }
-    
+
 private:
-    bool isChunkBoundary(uint64_t hash, size_t current_size) const;
-    mutable ChunkStats last_stats_;
+    size_t findRabinBoundary(const uint8_t* data, size_t size) const;
+    size_t findGearBoundary(const uint8_t* data, size_t size) const;
+    std::vector<size_t> scanCuts(std::span<const uint8_t> data,
+                                 size_t begin, size_t end) const;
+    std::vector<size_t> findCutsParallel(std::span<const uint8_t> data) const;
+    void chunkSpanParallel(std::span<const uint8_t> data, const ChunkCallback& callback);
+    void hashChunks(std::span<ChunkInfo> chunks, const uint8_t* base, size_t base_offset) const;
+    void emitChunks(std::span<ChunkInfo> chunks, const uint8_t* base, size_t base_offset,
+                    const ChunkCallback& callback);
+    void resetStats() const;
+    void recordStats(size_t chunk_size) const;
+
+    ChunkingAlgorithm algorithm_;
+    FileInput file_input_ = FileInput::Stream;
+    GearScan::Kernel scan_;
+    HashAlgorithm hash_algorithm_ = HashAlgorithm::SHA256;
+    ThreadPool* pool_ = nullptr;
+    mutable ChunkStats last_stats_{0, 0, 0, 0.0};
 };
 
 } // namespace dropboxlite
@@ -1,21 +1,227 @@
 #pragma once
 
 #include <vector>
+#include <span>
+#include <memory>
+#include <optional>
+#include <functional>
 #include <cstdint>
+#include <cstddef>
 
 namespace dropboxlite {
 
+// Receives decompressed output; the span is only valid during the call
+using DecompressSink = std::function<void(std::span<const uint8_t> data)>;
+
+// Compression algorithm of a frame. Values are stored in chunk metadata and
+// sent on the wire, so they must never be renumbered.
+enum class Codec : uint8_t {
+    None = 0,  // Stored as-is
+    Zlib = 1,
+    Zstd = 2,  // Optional (BUILD_ZSTD)
+    LZ4 = 3    // Optional (BUILD_LZ4)
+};
+
+class CompressionDictionary;
+
+// A codec and its level; levels are codec-specific and ignored by None and
+// LZ4. A dictionary (zstd only) replaces the level with its own.
+struct CodecChoice {
+    Codec codec;
+    int level;
+    const CompressionDictionary* dictionary = nullptr;
+};
+
+// Cheap look at a sample of the data
+struct CompressionEstimate {
+    double entropy;      // Order-0 entropy of the sample, bits per byte
+    bool precompressed;  // Starts like a compressed or media format
+};
+
+// One compression algorithm, working on raw payloads; framing is done by
+// Compression
+class CompressionCodec {
+public:
+    virtual ~CompressionCodec() = default;
+    
+    virtual Codec id() const = 0;
+    virtual const char* name() const = 0;
+    virtual int defaultLevel() const = 0;
+    
+    // Worst-case payload size for input_size bytes of input
+    virtual size_t maxCompressedSize(size_t input_size) const = 0;
+    
+    // Upper bound on output bytes per payload byte of a valid stream
+    virtual uint64_t maxExpansion() const = 0;
+    
+    // Returns the payload length, or nullopt if out is too small
+    virtual std::optional<size_t> compress(std::span<const uint8_t> input,
+                                           std::span<uint8_t> out,
+                                           int level) const = 0;
+    
+    // out must be exactly the uncompressed size
+    virtual bool decompress(std::span<const uint8_t> input, std::span<uint8_t> out) const = 0;
+};
+
+// Trained zstd dictionary, for chunks too small to compress well alone.
+// The id is stored inside the dictionary and in the header of every zstd
+// frame compressed with it, so each frame names the dictionary version it
+// needs. Ids only ever increase; a retrained dictionary gets a new one.
+class CompressionDictionary {
+public:
+    // Ids below this are reserved by the zstd format
+    static constexpr uint32_t kMinId = 32768;
+    static constexpr size_t kDefaultCapacity = 64 * 1024;
+    static constexpr int kLevel = 3;
+
+    // Train from sample chunks; nullptr without zstd, or if the samples are
+    // too few or too uniform to learn from
+    static std::shared_ptr<const CompressionDictionary> train(
+        std::span<const std::span<const uint8_t>> samples,
+        uint32_t id,
+        size_t capacity = kDefaultCapacity);
+
+    // Wrap serialized dictionary bytes (as returned by data()); nullptr if invalid
+    static std::shared_ptr<const CompressionDictionary> load(std::vector<uint8_t> data);
+
+    ~CompressionDictionary();
+
+    CompressionDictionary(const CompressionDictionary&) = delete;
+    CompressionDictionary& operator=(const CompressionDictionary&) = delete;
+
+    uint32_t id() const { return id_; }
+    std::span<const uint8_t> data() const { return data_; }
+
+    // Digested forms for compression and decompression, built once
+    struct Compiled;
+    const Compiled& compiled() const { return *compiled_; }
+
+private:
+    CompressionDictionary(uint32_t id, std::vector<uint8_t> data, std::unique_ptr<Compiled> compiled);
+
+    uint32_t id_;
+    std::vector<uint8_t> data_;
+    std::unique_ptr<Compiled> compiled_;
+};
+
+// Compression in self-describing frames: a 3-byte magic, the codec, the
+// uncompressed length (8 bytes, little endian), then the codec's payload.
+// Knowing the length up front lets decompression allocate once and decode
+// in a single pass. Codec contexts are cached per thread and reset between
+// uses rather than rebuilt.
 class Compression {
 public:
-    // Compress data using zlib
+    static constexpr size_t kFrameHeaderSize = 12;
+    static constexpr int kDefaultLevel = 6;
+
+    // Compress data into a zlib frame; throws on failure. Empty input gives
+    // empty output.
     static std::vector<uint8_t> compress(const std::vector<uint8_t>& data);
-    
-    // Decompress data
+
+    // Decompress a frame of any codec; throws if it is malformed or truncated
     static std::vector<uint8_t> decompress(const std::vector<uint8_t>& data);
+
+    // Largest frame compressInto can produce for input_size bytes, any codec
+    static size_t maxCompressedSize(size_t input_size);
+
+    // Compress into out; returns the frame length, or nullopt if out is
+    // too small, the codec is not built in, or it fails. Sizing out with
+    // maxCompressedSize always fits.
+    static std::optional<size_t> compressInto(std::span<const uint8_t> input,
+                                              std::span<uint8_t> out,
+                                              CodecChoice choice);
+    static std::optional<size_t> compressInto(std::span<const uint8_t> input,
+                                              std::span<uint8_t> out,
+                                              int level = kDefaultLevel);
+
+    // Compress with the codec chooseCodec picks, storing the data as-is
+    // when that would not save space. Never fails for available codecs.
+    static std::vector<uint8_t> compressAdaptive(std::span<const uint8_t> data,
+                                                 const CompressionDictionary* dictionary = nullptr);
+
+    // Uncompressed length recorded in a frame header; nullopt if the header
+    // is invalid or claims more than the payload could expand to
+    static std::optional<uint64_t> decompressedSize(std::span<const uint8_t> frame);
+
+    // Codec recorded in a frame header
+    static std::optional<Codec> frameCodec(std::span<const uint8_t> frame);
+
+    // Decompress into out, which must be exactly decompressedSize(frame) bytes
+    static bool decompressInto(std::span<const uint8_t> frame, std::span<uint8_t> out);
+
+    // Codec registry; nullptr for codecs not built into this binary
+    static const CompressionCodec* codec(Codec codec);
+    static const char* codecName(Codec codec);
     
+    // Decode a stored or received codec id; nullopt if unknown
+    static std::optional<Codec> codecFromId(uint32_t id);
+
+    // Sample up to a few KB spread over data
+    static CompressionEstimate estimate(std::span<const uint8_t> data);
+
+    // Codec for data: None for small, already compressed or high-entropy
+    // input, a fast codec for very redundant data and a stronger one for
+    // text-like data. Chunks up to kDictionaryMaxSize use the dictionary
+    // if one is given, which also makes ones under 1 KB worth compressing.
+    static CodecChoice chooseCodec(std::span<const uint8_t> data,
+                                   const CompressionDictionary* dictionary = nullptr);
+
+    static constexpr size_t kDictionaryMaxSize = 16 * 1024;
+
+    // Make a dictionary available to decompression, which finds it by the
+    // id in each frame. Registering an id again replaces it.
+    static void registerDictionary(std::shared_ptr<const CompressionDictionary> dictionary);
+    static std::shared_ptr<const CompressionDictionary> findDictionary(uint32_t id);
+
     // Check if compression would be beneficial
     static bool shouldCompress(size_t data_size);
-    
+
+    // zlib frame built incrementally; the total length is declared up front
+    class CompressStream {
+    public:
+        explicit CompressStream(uint64_t total_size, int level = kDefaultLevel);
+        ~CompressStream();
+
+        CompressStream(const CompressStream&) = delete;
+        CompressStream& operator=(const CompressStream&) = delete;
+
+        // Append compressed output for data to out
+        bool update(std::span<const uint8_t> data, std::vector<uint8_t>& out);
+
+        // Flush the rest of the frame; false if the input did not add up to
+        // the declared total
+        bool finish(std::vector<uint8_t>& out);
+
+        struct State;
+
+    private:
+        std::unique_ptr<State> state_;
+    };
+
+    // zlib frame consumed in arbitrary pieces, output delivered to a sink
+    class DecompressStream {
+    public:
+        DecompressStream();
+        ~DecompressStream();
+
+        DecompressStream(const DecompressStream&) = delete;
+        DecompressStream& operator=(const DecompressStream&) = delete;
+
+        // False on a malformed frame, or output beyond the declared length
+        bool update(std::span<const uint8_t> data, const DecompressSink& sink);
+
+        // True once the whole frame has been consumed and verified
+        bool finished() const;
+
+        // Declared uncompressed length, once the header has arrived
+        std::optional<uint64_t> expectedSize() const;
+
+        struct State;
+
+    private:
+        std::unique_ptr<State> state_;
+    };
+
 private:
     static constexpr size_t kMinCompressionSize = 1024; // 1KB
 };
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common/compression.h"
+#include <string>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace dropboxlite {
+
+// Versioned compression dictionaries on disk: <root>/<scope>/<id>.zdict.
+// A scope is whatever the dictionary was trained for, e.g. a client or a
+// client's files of one type. Old versions are kept so frames that name
+// them stay decodable; new chunks use the newest version of their scope.
+class DictionaryStore {
+public:
+    explicit DictionaryStore(const std::string& root);
+    
+    // Load every stored dictionary and register it for decompression
+    bool initialize();
+    
+    // Train a dictionary from samples and store it as the scope's newest
+    // version. Returns its id, or nullopt if training or writing failed.
+    std::optional<uint32_t> train(const std::string& scope,
+                                  std::span<const std::span<const uint8_t>> samples);
+    
+    // Newest dictionary for scope; nullptr if it has none
+    std::shared_ptr<const CompressionDictionary> latest(const std::string& scope) const;
+    
+private:
+    std::string root_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const CompressionDictionary>> latest_;
+    uint32_t next_id_ = CompressionDictionary::kMinId;
+    
+    // Directory name for a scope; anything but [A-Za-z0-9_-] is escaped
+    static std::string scopeDirectory(const std::string& scope);
+    
+    void add(const std::string& directory, std::shared_ptr<const CompressionDictionary> dictionary);
+};
+
+} // namespace dropboxlite
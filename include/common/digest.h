@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace dropboxlite {
+
+// 32-byte content digest (SHA-256 or BLAKE3). Trivially copyable and cheap
+// to hash and compare; hex is only produced at the edges (chunk paths, logs).
+struct Digest {
+    static constexpr size_t kSize = 32;
+    
+    std::array<uint8_t, kSize> bytes{};
+    
+    const uint8_t* data() const { return bytes.data(); }
+    uint8_t* data() { return bytes.data(); }
+    static constexpr size_t size() { return kSize; }
+    
+    // Lowercase hex, 64 characters
+    std::string toHex() const;
+    
+    // Raw bytes as a std::string (protobuf bytes fields)
+    std::string toBytes() const {
+        return std::string(reinterpret_cast<const char*>(bytes.data()), kSize);
+    }
+    
+    static std::optional<Digest> fromHex(std::string_view hex);
+    static std::optional<Digest> fromBytes(const void* data, size_t size);
+    
+    // Accepts 32 raw bytes or 64 hex characters, so peers that still send
+    // hex digests keep working
+    static std::optional<Digest> parse(std::string_view value);
+    
+    auto operator<=>(const Digest&) const = default;
+    bool operator==(const Digest&) const = default;
+};
+
+static_assert(sizeof(Digest) == Digest::kSize, "Digest must be exactly 32 bytes");
+
+} // namespace dropboxlite
+
+template<>
+struct std::hash<dropboxlite::Digest> {
+    // SHA-256 output is uniformly distributed, so any 8 bytes make a good hash
+    size_t operator()(const dropboxlite::Digest& digest) const noexcept {
+        uint64_t value;
+        std::memcpy(&value, digest.bytes.data(), sizeof(value));
+        return static_cast<size_t>(value);
+    }
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "common/task.h"
+#include "common/thread_pool.h"
+#include "common/timer_wheel.h"
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include <cstdint>
+
+namespace dropboxlite {
+
+// Runs Task coroutines on a ThreadPool. A suspended coroutine holds no
+// thread: timers wait on a TimerWheel and blocking calls (file I/O,
+// SQLite) run on a small separate I/O pool, so thousands of sessions can be
+// in flight on a handful of workers. Every awaitable resumes its coroutine
+// on the pool, at the priority of the task that suspended it.
+class Executor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Executor(ThreadPool& pool, size_t io_threads = 2);
+    // Waits for spawned tasks, then stops the timer and I/O threads
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    ThreadPool& pool() { return pool_; }
+    TimerWheel& timers() { return timers_; }
+
+    // co_await schedule() continues on a pool worker
+    auto schedule() { return ScheduleAwaiter{*this, std::nullopt}; }
+    auto schedule(Priority priority) { return ScheduleAwaiter{*this, priority}; }
+
+    // Run f() on the pool and resume with its result
+    template<typename F>
+    Task<std::invoke_result_t<F&>> offload(F f) {
+        co_await schedule();
+        co_return f();
+    }
+
+    // Run a blocking call on the I/O threads and resume on the pool with
+    // its result or exception
+    template<typename F>
+    auto blocking(F f) { return BlockingAwaiter<F>{*this, std::move(f)}; }
+
+    auto sleepFor(Clock::duration delay) { return SleepAwaiter{*this, Clock::now() + delay}; }
+    auto sleepUntil(Clock::time_point deadline) { return SleepAwaiter{*this, deadline}; }
+
+    // File I/O on the I/O threads. Buffers must stay alive until the
+    // co_await completes.
+    // Bytes read (short only at end of file), or nullopt on error
+    auto readAt(int fd, uint64_t offset, std::span<uint8_t> out) {
+        return blocking([=] { return readAtBlocking(fd, offset, out); });
+    }
+    // True once all of data is written
+    auto writeAt(int fd, uint64_t offset, std::span<const uint8_t> data) {
+        return blocking([=] { return writeAtBlocking(fd, offset, data); });
+    }
+    // Whole file, or nullopt if it cannot be read
+    auto readFile(std::string filepath) {
+        return blocking([filepath = std::move(filepath)] { return readFileBlocking(filepath); });
+    }
+    // Create or replace filepath with data
+    auto writeFile(std::string filepath, std::span<const uint8_t> data) {
+        return blocking([filepath = std::move(filepath), data] {
+            return writeFileBlocking(filepath, data);
+        });
+    }
+
+    // Run task to completion in the background, starting on the pool.
+    // Exceptions it lets escape are logged and dropped.
+    void spawn(Task<void> task);
+
+    // Spawned tasks not yet finished
+    size_t inFlight() const;
+
+private:
+    struct ScheduleAwaiter {
+        Executor& executor;
+        std::optional<Priority> priority;
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            executor.resume(handle, priority.value_or(executor.pool_.inheritedPriority()));
+        }
+        void await_resume() noexcept {}
+    };
+
+    struct SleepAwaiter {
+        Executor& executor;
+        Clock::time_point deadline;
+
+        bool await_ready() noexcept { return deadline <= Clock::now(); }
+        void await_suspend(std::coroutine_handle<> handle) {
+            executor.addTimer(deadline, handle, executor.pool_.inheritedPriority());
+        }
+        void await_resume() noexcept {}
+    };
+
+    template<typename F>
+    struct BlockingAwaiter {
+        using Result = std::invoke_result_t<F&>;
+        using Value = std::conditional_t<std::is_void_v<Result>, std::monostate, Result>;
+
+        Executor& executor;
+        F fn;
+        std::optional<Value> value = std::nullopt;
+        std::exception_ptr error = nullptr;
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            Priority priority = executor.pool_.inheritedPriority();
+            executor.io_.post([this, handle, priority] {
+                try {
+                    if constexpr (std::is_void_v<Result>) {
+                        fn();
+                        value.emplace();
+                    } else {
+                        value.emplace(fn());
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                executor.resume(handle, priority);
+            });
+        }
+        Result await_resume() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            if constexpr (!std::is_void_v<Result>) {
+                return std::move(*value);
+            }
+        }
+    };
+
+    void resume(std::coroutine_handle<> handle, Priority priority);
+    void addTimer(Clock::time_point deadline, std::coroutine_handle<> handle, Priority priority);
+    detail::DetachedTask runSpawned(Task<void> task);
+
+    static std::optional<size_t> readAtBlocking(int fd, uint64_t offset, std::span<uint8_t> out);
+    static bool writeAtBlocking(int fd, uint64_t offset, std::span<const uint8_t> data);
+    static std::optional<std::vector<uint8_t>> readFileBlocking(const std::string& filepath);
+    static bool writeFileBlocking(const std::string& filepath, std::span<const uint8_t> data);
+
+    ThreadPool& pool_;
+    ThreadPool io_;
+    TimerWheel timers_;
+
+    mutable std::mutex spawn_mutex_;
+    std::condition_variable spawn_done_;
+    size_t spawned_ = 0;
+};
+
+} // namespace dropboxlite
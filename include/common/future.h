@@ -0,0 +1,158 @@
+#pragma once
+
+#include "common/object_pool.h"
+#include <atomic>
+#include <exception>
+#include <future>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <cstdint>
+
+namespace dropboxlite {
+
+template<typename T> class Future;
+template<typename T> class Promise;
+
+namespace detail {
+
+// Result slot shared by one Promise and one Future; recycled through an
+// ObjectPool when both are gone
+template<typename T>
+struct FutureState {
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    std::atomic<uint32_t> ready{0};
+    std::atomic<uint32_t> refs{1};
+    std::optional<Value> value;
+    std::exception_ptr error;
+
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ObjectPool<FutureState>::destroy(this);
+        }
+    }
+
+    void publish() {
+        ready.store(1, std::memory_order_release);
+        ready.notify_all();
+    }
+};
+
+} // namespace detail
+
+// Single-use result of a ThreadPool::submit task. Like std::future, but
+// the shared state comes from a pool instead of the heap and is handed
+// back once both ends are done with it.
+template<typename T>
+class Future {
+public:
+    Future() = default;
+    Future(Future&& other) noexcept : state_(std::exchange(other.state_, nullptr)) {}
+    Future& operator=(Future&& other) noexcept {
+        if (this != &other) {
+            reset();
+            state_ = std::exchange(other.state_, nullptr);
+        }
+        return *this;
+    }
+    ~Future() { reset(); }
+
+    bool valid() const { return state_ != nullptr; }
+
+    bool ready() const { return state_->ready.load(std::memory_order_acquire) != 0; }
+
+    void wait() const {
+        while (!ready()) {
+            state_->ready.wait(0, std::memory_order_acquire);
+        }
+    }
+
+    // Blocks for the result, rethrowing the task's exception; the future
+    // is empty afterwards
+    T get() {
+        wait();
+        detail::FutureState<T>* state = std::exchange(state_, nullptr);
+        struct Release {
+            detail::FutureState<T>* state;
+            ~Release() { state->release(); }
+        } release{state};
+
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*state->value);
+        }
+    }
+
+private:
+    friend class Promise<T>;
+    explicit Future(detail::FutureState<T>* state) : state_(state) {}
+
+    void reset() {
+        if (state_) {
+            std::exchange(state_, nullptr)->release();
+        }
+    }
+
+    detail::FutureState<T>* state_ = nullptr;
+};
+
+// Write end of a Future. Destroying a promise without setting it leaves a
+// broken_promise error for the future.
+template<typename T>
+class Promise {
+public:
+    Promise() : state_(ObjectPool<detail::FutureState<T>>::create()) {}
+    Promise(Promise&& other) noexcept : state_(std::exchange(other.state_, nullptr)) {}
+    Promise& operator=(Promise&&) = delete;
+    Promise(const Promise&) = delete;
+    ~Promise() {
+        if (state_) {
+            if (!state_->ready.load(std::memory_order_relaxed)) {
+                setException(std::make_exception_ptr(
+                    std::future_error(std::future_errc::broken_promise)));
+            }
+            state_->release();
+        }
+    }
+
+    // Call at most once, before the promise is moved into its task
+    Future<T> getFuture() {
+        state_->refs.fetch_add(1, std::memory_order_relaxed);
+        return Future<T>(state_);
+    }
+
+    template<typename... V>
+    void setValue(V&&... value) {
+        state_->value.emplace(std::forward<V>(value)...);
+        state_->publish();
+    }
+
+    void setException(std::exception_ptr error) {
+        state_->error = std::move(error);
+        state_->publish();
+    }
+
+    // Run f and store its result or exception
+    template<typename F, typename... Args>
+    void setFrom(F& f, Args&... args) {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                f(args...);
+                setValue();
+            } else {
+                setValue(f(args...));
+            }
+        } catch (...) {
+            setException(std::current_exception());
+        }
+    }
+
+private:
+    detail::FutureState<T>* state_;
+};
+
+} // namespace dropboxlite
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace dropboxlite {
+
+// Candidate-boundary scan kernels for gear-hash chunking
+enum class ScanKernel {
+    Auto,    // Best kernel supported by this CPU
+    Scalar,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+class GearScan {
+public:
+    // Returns the first position i in [begin, end) whose gear fingerprint,
+    // hashed from data[origin] onward, has (fp & mask) == 0; end if none.
+    // mask must not use bit 63.
+    using Kernel = size_t (*)(const uint8_t* data, size_t origin,
+                              size_t begin, size_t end, uint64_t mask);
+    
+    // Best kernel for this CPU, detected once from CPUID
+    static ScanKernel best();
+    static bool isSupported(ScanKernel kernel);
+    
+    // Auto resolves to best(); unsupported kernels return nullptr
+    static Kernel get(ScanKernel kernel);
+    static const char* name(ScanKernel kernel);
+    
+private:
+    GearScan() = default;
+};
+
+} // namespace dropboxlite
@@ -2,17 +2,154 @@
 
 #include <string>
 #include <vector>
+#include <span>
+#include <array>
 #include <cstdint>
+#include <optional>
+#include <memory>
+#include "common/digest.h"
+
+struct evp_md_ctx_st;
 
 namespace dropboxlite {
 
+class ThreadPool;
+
+// Strong hash used for chunk and file identity. Both produce 32-byte
+// digests; the algorithm is stored alongside every digest (metadata DB and
+// wire format) so peers hashing differently can still interoperate.
+enum class HashAlgorithm : uint8_t {
+    SHA256 = 0,  // OpenSSL, SHA-NI where available
+    BLAKE3 = 1   // Built in; chunks hashed in parallel SIMD lanes
+};
+
+// How whole files are read for hashing
+struct FileHashOptions {
+    // Bytes per read (rounded up to a page). One buffer is hashed while the
+    // next is being filled.
+    size_t block_size = 1 << 20;
+    
+    // BLAKE3 files at least this large are mapped and hashed as independent
+    // subtrees on pool (nullptr disables). The digest is unchanged; SHA256
+    // is inherently serial and always streams.
+    uint64_t parallel_threshold = 64ull << 20;
+    ThreadPool* pool = nullptr;
+};
+
+// Compression kernel for batched SHA256
+enum class Sha256Kernel {
+    Auto,    // Best supported by this CPU
+    Scalar,  // One message at a time through OpenSSL
+    SHANI,   // SHA extensions, two messages interleaved
+    AVX2     // Eight messages, one per 32-bit vector lane
+};
+
 class Hash {
 public:
-    // Compute SHA256 hash of data
+    // Digest of data with the given strong hash
+    static Digest digest(HashAlgorithm algorithm, std::span<const uint8_t> data);
+    static std::optional<Digest> fileDigest(HashAlgorithm algorithm, const std::string& filepath);
+    static std::optional<Digest> fileDigest(HashAlgorithm algorithm, const std::string& filepath,
+                                            const FileHashOptions& options);
+    
+    // Many independent inputs at once: SHA256 goes through sha256Batch,
+    // BLAKE3 already spreads each input across SIMD lanes
+    static void digestBatch(HashAlgorithm algorithm,
+                            std::span<const std::span<const uint8_t>> inputs,
+                            std::span<Digest> digests);
+    
+    static const char* algorithmName(HashAlgorithm algorithm);
+    
+    // Decode a stored or received algorithm id; nullopt if unknown
+    static std::optional<HashAlgorithm> algorithmFromId(uint32_t id);
+    
+    // Compute SHA256 digest of data
+    static Digest sha256Digest(std::span<const uint8_t> data);
+    static std::optional<Digest> sha256FileDigest(const std::string& filepath);
+
+    // Hash many independent messages at once, keeping several in flight so
+    // the compression pipeline stays full. digests[i] is the hash of
+    // inputs[i]; digests must have at least inputs.size() elements.
+    // Unsupported kernels fall back to Scalar.
+    static void sha256Batch(std::span<const std::span<const uint8_t>> inputs,
+                            std::span<Digest> digests,
+                            Sha256Kernel kernel = Sha256Kernel::Auto);
+    static std::vector<Digest> sha256Batch(std::span<const std::span<const uint8_t>> inputs);
+
+    static Sha256Kernel bestSha256Kernel();
+    static bool isSupported(Sha256Kernel kernel);
+    static const char* sha256KernelName(Sha256Kernel kernel);
+    
+    // BLAKE3 (unkeyed, 32-byte output). Full 1 KiB chunks are compressed
+    // eight at a time in SIMD lanes and the tree is reduced level by level.
+    static Digest blake3(std::span<const uint8_t> data);
+    
+    // Same digest, with large inputs split into subtrees hashed on pool
+    static Digest blake3(std::span<const uint8_t> data, ThreadPool* pool);
+    
+    // Hex-string forms of the above, for display and external interfaces
+    static std::string sha256(std::span<const uint8_t> data);
     static std::string sha256(const std::vector<uint8_t>& data);
     static std::string sha256(const std::string& data);
     static std::string sha256File(const std::string& filepath);
     
+    // Incremental SHA256 for data that arrives in pieces
+    class Sha256Stream {
+    public:
+        Sha256Stream();
+        ~Sha256Stream();
+        
+        Sha256Stream(const Sha256Stream&) = delete;
+        Sha256Stream& operator=(const Sha256Stream&) = delete;
+        
+        void update(std::span<const uint8_t> data);
+        
+        // Digest of everything passed to update(); the stream restarts after
+        Digest finish();
+        
+    private:
+        evp_md_ctx_st* ctx_;
+    };
+    
+    // Incremental BLAKE3
+    class Blake3Stream {
+    public:
+        Blake3Stream();
+        ~Blake3Stream();
+        
+        Blake3Stream(const Blake3Stream&) = delete;
+        Blake3Stream& operator=(const Blake3Stream&) = delete;
+        
+        void update(std::span<const uint8_t> data);
+        
+        // Digest of everything passed to update(); the stream restarts after
+        Digest finish();
+        
+        struct State;
+        
+    private:
+        std::unique_ptr<State> state_;
+    };
+    
+    // Incremental digest with the algorithm chosen at runtime
+    class Stream {
+    public:
+        explicit Stream(HashAlgorithm algorithm = HashAlgorithm::SHA256);
+        ~Stream();
+        
+        Stream(const Stream&) = delete;
+        Stream& operator=(const Stream&) = delete;
+        
+        HashAlgorithm algorithm() const { return algorithm_; }
+        void update(std::span<const uint8_t> data);
+        Digest finish();
+        
+    private:
+        HashAlgorithm algorithm_;
+        std::unique_ptr<Sha256Stream> sha256_;
+        std::unique_ptr<Blake3Stream> blake3_;
+    };
+    
     // Rolling hash for efficient chunking (Rabin-Karp)
     class RollingHash {
     public:
@@ -31,6 +168,24 @@ public:
         static constexpr uint64_t kMod = 1e9 + 9;
     };
     
+    // Gear hash for FastCDC chunking: one shift and one table add per byte.
+    // Bit k of the fingerprint depends only on the last k+1 bytes, so
+    // boundary masks should select high bits.
+    class GearHash {
+    public:
+        GearHash() : hash_(0) {}
+        
+        void reset() { hash_ = 0; }
+        uint64_t hash() const { return hash_; }
+        void append(uint8_t byte) { hash_ = (hash_ << 1) + table()[byte]; }
+        
+        // 256 pseudo-random 64-bit values, fixed so boundaries are stable
+        static const std::array<uint64_t, 256>& table();
+        
+    private:
+        uint64_t hash_;
+    };
+    
 private:
     Hash() = default;
 };
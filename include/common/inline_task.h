@@ -0,0 +1,108 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <cstddef>
+
+namespace dropboxlite {
+
+// Move-only void() callable with inline storage. Callables up to
+// kInlineSize bytes that move without throwing live inside the task;
+// larger ones fall back to one heap allocation. Unlike std::function it
+// accepts move-only callables (promises, unique_ptrs, buffers) and never
+// copies them.
+class InlineTask {
+public:
+    static constexpr size_t kInlineSize = 48;
+
+    InlineTask() noexcept = default;
+
+    template<typename F,
+             typename Fn = std::decay_t<F>,
+             typename = std::enable_if_t<!std::is_same_v<Fn, InlineTask> &&
+                                         std::is_invocable_v<Fn&>>>
+    InlineTask(F&& f) {
+        if constexpr (fitsInline<Fn>()) {
+            ::new (storage_) Fn(std::forward<F>(f));
+            ops_ = &kInlineOps<Fn>;
+        } else {
+            ::new (storage_) Fn*(new Fn(std::forward<F>(f)));
+            ops_ = &kHeapOps<Fn>;
+        }
+    }
+
+    InlineTask(InlineTask&& other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    InlineTask& operator=(InlineTask&& other) noexcept {
+        if (this != &other) {
+            reset();
+            ops_ = other.ops_;
+            if (ops_) {
+                ops_->move(storage_, other.storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    InlineTask(const InlineTask&) = delete;
+    InlineTask& operator=(const InlineTask&) = delete;
+
+    ~InlineTask() { reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+private:
+    // Move constructs into dst and destroys src
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template<typename Fn>
+    static constexpr bool fitsInline() {
+        return sizeof(Fn) <= kInlineSize &&
+               alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template<typename Fn>
+    static constexpr Ops kInlineOps = {
+        [](void* storage) { (*static_cast<Fn*>(storage))(); },
+        [](void* dst, void* src) noexcept {
+            ::new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* storage) noexcept { static_cast<Fn*>(storage)->~Fn(); },
+    };
+
+    template<typename Fn>
+    static constexpr Ops kHeapOps = {
+        [](void* storage) { (**static_cast<Fn**>(storage))(); },
+        [](void* dst, void* src) noexcept {
+            ::new (dst) Fn*(*static_cast<Fn**>(src));
+        },
+        [](void* storage) noexcept { delete *static_cast<Fn**>(storage); },
+    };
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+};
+
+} // namespace dropboxlite
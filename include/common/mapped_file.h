@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+namespace dropboxlite {
+
+// Read-only memory mapping of a whole file for zero-copy scanning.
+// Advises the kernel of sequential access (and transparent hugepages where
+// supported) so readahead keeps ahead of the chunker.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    // Map file; returns false if it cannot be opened or mapped.
+    // Empty files succeed with an empty span.
+    bool open(const std::string& filepath);
+    void close();
+    
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    std::span<const uint8_t> span() const { return {data_, size_}; }
+    
+private:
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace dropboxlite
@@ -1,18 +1,223 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <memory>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include <cstdint>
 
 namespace dropboxlite {
 
-// Performance metrics collection
+namespace detail {
+
+constexpr size_t kMetricShards = 32;
+
+// Shard of the calling thread; threads are dealt out round-robin on first
+// use, so up to kMetricShards threads never share one
+size_t nextMetricShard();
+
+inline size_t metricShard() {
+    thread_local size_t shard = nextMetricShard();
+    return shard;
+}
+
+struct alignas(64) PaddedCounter {
+    std::atomic<int64_t> value{0};
+};
+
+} // namespace detail
+
+// Monotonic count. Each thread adds to its own cache line, so add() is
+// one uncontended atomic add; value() sums the shards.
+class Counter {
+public:
+    void add(int64_t n = 1) {
+        shards_[detail::metricShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    
+    int64_t value() const;
+    void reset();
+    
+private:
+    std::array<detail::PaddedCounter, detail::kMetricShards> shards_;
+};
+
+// Current value of something; last set() wins
+class Gauge {
+public:
+    void set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    void add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+    
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Options for a Histogram, fixed when it is first registered
+struct HistogramOptions {
+    // Buckets per power of two are 2^precision_bits, so values are kept
+    // to within 2^-precision_bits of their true value (5: ~3%). 1 to 10.
+    int precision_bits = 5;
+    
+    // Also keep these trailing windows (see WindowedHistogram). None by
+    // default: each one adds a clock read and a shared slice update to
+    // every record(), so ask for them where recent percentiles matter,
+    // e.g. {std::chrono::minutes(1), std::chrono::minutes(5)} for an SLO.
+    std::vector<std::chrono::seconds> windows;
+};
+
+// Recorded values merged into log-linear buckets, as in HdrHistogram:
+// exact below 2^precision_bits, then 2^precision_bits equal buckets per
+// power of two, up to 2^kMaxExponent (values above land in the top
+// bucket; max stays exact). Percentiles are reported as the top of their
+// bucket.
+class HistogramSnapshot {
+public:
+    static constexpr int kMaxExponent = 40;
+    
+    explicit HistogramSnapshot(int precision_bits = 5);
+    
+    int64_t count = 0;
+    int64_t sum = 0;
+    int64_t min = 0;
+    int64_t max = 0;
+    
+    double mean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+    
+    // Value at or below which a fraction q (0..1) of samples fall, to
+    // the histogram's precision; 0 when empty
+    int64_t percentile(double q) const;
+    
+    // Add other's samples; precisions may differ
+    void merge(const HistogramSnapshot& other);
+    
+    // Empty at precision_bits, keeping the bucket storage
+    void clear(int precision_bits);
+    
+    int precisionBits() const { return precision_bits_; }
+    const std::vector<uint64_t>& buckets() const { return buckets_; }
+    
+    // Bucket layout, shared with the live histograms
+    static size_t bucketCount(int precision_bits);
+    static size_t bucketOf(int64_t value, int precision_bits);
+    static int64_t bucketTop(size_t bucket, int precision_bits);
+    
+private:
+    friend class Histogram;
+    friend class WindowedHistogram;
+    
+    // Fold in live bucket counts; sum and extremes come from the
+    // recorder's own totals so they stay exact
+    void addBuckets(const std::atomic<uint64_t>* buckets, int64_t bucket_sum,
+                    int64_t bucket_min, int64_t bucket_max);
+    
+    int precision_bits_;
+    std::vector<uint64_t> buckets_;
+};
+
+// Samples from roughly the last `window` (to within one slice): a ring of
+// time slices, each reused once it falls out of the window. Slices are
+// shared by all threads, so unlike Histogram concurrent records do
+// contend on cache lines, but never on a lock.
+class WindowedHistogram {
+public:
+    WindowedHistogram(std::chrono::seconds window, int precision_bits, size_t slices = 6);
+    ~WindowedHistogram();
+    
+    void record(int64_t value);
+    HistogramSnapshot snapshot() const;
+    // Into an existing snapshot, reusing its storage
+    void snapshot(HistogramSnapshot& into) const;
+    void reset();
+    
+    std::chrono::seconds window() const { return window_; }
+    
+private:
+    struct Slice;
+    
+    std::chrono::seconds window_;
+    int precision_bits_;
+    int64_t slice_ns_;
+    std::vector<std::unique_ptr<Slice>> slices_;
+};
+
+// Distribution of recorded values, e.g. latencies in microseconds, with
+// percentiles. Each thread records into its own shard (allocated on first
+// use); snapshot() merges them. Trailing windows, if configured, are fed
+// by the same record().
+class Histogram {
+public:
+    using Snapshot = HistogramSnapshot;
+    
+    explicit Histogram(const HistogramOptions& options = {});
+    ~Histogram();
+    
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+    
+    void record(int64_t value);
+    void record(std::chrono::microseconds duration) { record(duration.count()); }
+    
+    // Since start (or the last reset)
+    Snapshot snapshot() const;
+    // Into an existing snapshot, reusing its storage
+    void snapshot(Snapshot& into) const;
+    void reset();
+    
+    const std::vector<std::unique_ptr<WindowedHistogram>>& windows() const { return windows_; }
+    int precisionBits() const { return precision_bits_; }
+    
+private:
+    struct Shard;
+    
+    Shard& shard();
+    
+    int precision_bits_;
+    std::array<std::atomic<Shard*>, detail::kMetricShards> shards_{};
+    std::vector<std::unique_ptr<WindowedHistogram>> windows_;
+};
+
+// Bytes moved since the first add()
+class Throughput {
+public:
+    void add(size_t bytes);
+    
+    uint64_t totalBytes() const { return static_cast<uint64_t>(bytes_.value()); }
+    double bytesPerSecond() const;
+    void reset();
+    
+private:
+    Counter bytes_;
+    std::atomic<int64_t> start_ns_{0};
+};
+
+// Performance metrics collection.
+//
+// Hot paths should register once and keep the handle:
+//
+//     static Counter& uploads = Metrics::instance().counter("uploads");
+//     uploads.add();
+//
+// Handles live as long as the process and updating one takes no lock.
+// The name-based calls below look the name up on every call (a shared
+// lock and a string hash) and suit occasional updates.
 class Metrics {
 public:
     static Metrics& instance();
     
+    // Registration: the same name always returns the same handle
+    Counter& counter(const std::string& name);
+    Gauge& gauge(const std::string& name);
+    // options apply when name is first registered
+    Histogram& histogram(const std::string& name, const HistogramOptions& options = {});
+    Throughput& throughput(const std::string& name);
+    
     // Counter operations
     void incrementCounter(const std::string& name, int64_t value = 1);
     int64_t getCounter(const std::string& name) const;
@@ -31,49 +236,108 @@ public:
     // Get all metrics as string
     std::string toString() const;
     
-    // Reset all metrics
+    // Append every metric to out as OpenMetrics text families. Names have
+    // characters other than [a-zA-Z0-9_:] replaced by '_'; counters gain
+    // "_total", throughput becomes a "<name>_bytes" counter and histograms
+    // are summaries with p50/p90/p99/p999 (each window labelled
+    // window="<seconds>s"). A metric whose family name is already taken
+    // (e.g. gauges "a.b_c" and "a_b.c", both a_b_c) is left out, and
+    // logged when registered, since a duplicate family makes the whole
+    // exposition invalid; the first registered keeps it. Reusing out
+    // across calls avoids reallocating it. Callers may append families of
+    // their own before "# EOF".
+    void appendOpenMetrics(std::string& out) const;
+    // appendOpenMetrics and the closing "# EOF": a complete exposition
+    void writeOpenMetrics(std::string& out) const;
+    
+    // Zero all metrics; names stay registered so handles remain valid
     void reset();
     
 private:
     Metrics() = default;
     
-    mutable std::mutex mutex_;
-    std::unordered_map<std::string, std::atomic<int64_t>> counters_;
-    std::unordered_map<std::string, std::atomic<int64_t>> gauges_;
-    
-    struct LatencyStats {
-        std::atomic<int64_t> count{0};
-        std::atomic<int64_t> sum_us{0};
-        std::atomic<int64_t> min_us{INT64_MAX};
-        std::atomic<int64_t> max_us{0};
-    };
-    std::unordered_map<std::string, LatencyStats> latencies_;
-    
-    struct ThroughputStats {
-        std::atomic<size_t> total_bytes{0};
-        std::chrono::steady_clock::time_point start_time;
-    };
-    std::unordered_map<std::string, ThroughputStats> throughput_;
+    template<typename T>
+    using Registry = std::unordered_map<std::string, std::unique_ptr<T>>;
+    
+    // suffix is what the exported family name adds to the metric's name
+    template<typename T, typename... Args>
+    T& lookup(Registry<T>& registry, std::string_view suffix, const std::string& name,
+              const Args&... args);
+    template<typename T>
+    const T* find(const Registry<T>& registry, const std::string& name) const;
+    
+    mutable std::shared_mutex mutex_;  // Guards the registries, not the values
+    Registry<Counter> counters_;
+    Registry<Gauge> gauges_;
+    Registry<Histogram> latencies_;
+    Registry<Throughput> throughput_;
+    
+    // Exported family names taken so far, and the metrics left out of the
+    // export because theirs was already taken
+    std::unordered_set<std::string> families_;
+    std::unordered_set<const void*> unexported_;
+    
+    bool exported(const void* metric) const {
+        return unexported_.empty() || !unexported_.count(metric);
+    }
 };
 
+// Pieces of the OpenMetrics text format, for components that render
+// families of their own (see MetricsServer::addExporter), e.g. one sample
+// per client labelled client="<id>" rather than a metric name per client
+namespace openmetrics {
+
+// name and suffix with characters other than [a-zA-Z0-9_:] replaced by '_'
+void appendName(std::string& out, std::string_view name, std::string_view suffix = {});
+// "# TYPE <name><suffix> <type>" line
+void appendFamily(std::string& out, std::string_view name, std::string_view suffix,
+                  std::string_view type);
+// Add key="value" to a label list, escaping value
+void appendLabel(std::string& labels, std::string_view key, std::string_view value);
+// "<name><suffix>{labels} value" line; labels as built by appendLabel,
+// or empty for none
+void appendSample(std::string& out, std::string_view name, std::string_view suffix,
+                  std::string_view labels, int64_t value);
+// Same, for values that are not whole numbers, e.g. seconds
+void appendFloatSample(std::string& out, std::string_view name, std::string_view suffix,
+                       std::string_view labels, double value);
+
+// Remove the families at or after from whose names already appear
+// earlier in text (each family runs from its "# TYPE" line to the next);
+// returns the names removed
+std::vector<std::string> dropDuplicateFamilies(std::string& text, size_t from);
+
+} // namespace openmetrics
+
 // RAII timer for automatic latency recording
 class ScopedTimer {
 public:
-    explicit ScopedTimer(const std::string& metric_name)
-        : metric_name_(metric_name),
+    explicit ScopedTimer(Histogram& histogram)
+        : histogram_(histogram),
           start_(std::chrono::steady_clock::now()) {}
     
+    explicit ScopedTimer(const std::string& metric_name)
+        : ScopedTimer(Metrics::instance().histogram(metric_name)) {}
+    
     ~ScopedTimer() {
         auto end = std::chrono::steady_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start_);
-        Metrics::instance().recordLatency(metric_name_, duration);
+        histogram_.record(std::chrono::duration_cast<std::chrono::microseconds>(end - start_));
     }
     
 private:
-    std::string metric_name_;
+    Histogram& histogram_;
     std::chrono::steady_clock::time_point start_;
 };
 
-#define MEASURE_LATENCY(name) dropboxlite::ScopedTimer _timer_##__LINE__(name)
+#define DROPBOXLITE_CONCAT_INNER(a, b) a##b
+#define DROPBOXLITE_CONCAT(a, b) DROPBOXLITE_CONCAT_INNER(a, b)
+
+// Time the rest of the scope into histogram name, registered once per call
+// site; name must not change between calls
+#define MEASURE_LATENCY(name) \
+    static dropboxlite::Histogram& DROPBOXLITE_CONCAT(_histogram_, __LINE__) = \
+        dropboxlite::Metrics::instance().histogram(name); \
+    dropboxlite::ScopedTimer DROPBOXLITE_CONCAT(_timer_, __LINE__)( \
+        DROPBOXLITE_CONCAT(_histogram_, __LINE__))
 
 } // namespace dropboxlite
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "common/metrics.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <cstdint>
+
+namespace dropboxlite {
+
+// Resource usage of this process, from /proc
+struct ProcessStats {
+    int64_t resident_bytes;
+    int64_t virtual_bytes;
+    int64_t open_fds;
+    int64_t max_fds;
+    int64_t threads;
+    double cpu_seconds;   // User plus system time
+
+    // nullopt where /proc is unavailable
+    static std::optional<ProcessStats> read();
+};
+
+// Minimal HTTP listener for Prometheus-style scrapers: GET /metrics (or
+// /) returns Metrics::instance() in OpenMetrics text format, any other
+// path 404. One thread serves one connection at a time, which is plenty
+// for a scrape every few seconds. Rendering reads the lock-free metric
+// handles under the registry's shared lock, so it never blocks recorders,
+// and writes into a buffer reused between scrapes.
+//
+// Every scrape first refreshes the process.* gauges (resident_bytes,
+// virtual_bytes, open_fds, max_fds, threads) and runs the collectors,
+// which publish whatever is only sampled on demand:
+//
+//     server.addCollector([&pool] { pool.publishMetrics("server.thread_pool"); });
+//
+// CPU time, a running total, is rendered as the counter
+// process_cpu_seconds_total rather than through the registry.
+class MetricsServer {
+public:
+    MetricsServer();
+    // Stops the listener
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // Listen on address:port (0 picks a free port, see port()); false if
+    // already started or the socket cannot be bound
+    bool start(uint16_t port, const std::string& address = "0.0.0.0");
+    void stop();
+
+    // Port being listened on, 0 if not started
+    uint16_t port() const { return port_.load(std::memory_order_relaxed); }
+
+    // Run before every scrape, on the listener thread
+    void addCollector(std::function<void()> collector);
+    
+    // Append OpenMetrics families of their own to every scrape, after the
+    // registered metrics (see the openmetrics helpers in metrics.h). A
+    // family whose name is already in the scrape is dropped and logged.
+    void addExporter(std::function<void(std::string&)> exporter);
+
+    // Body of a scrape, without serving one
+    std::string scrape();
+
+private:
+    void run();
+    void serve(int client);
+    // Refresh gauges and render into body_
+    void render();
+
+    Gauge& resident_bytes_;
+    Gauge& virtual_bytes_;
+    Gauge& open_fds_;
+    Gauge& max_fds_;
+    Gauge& threads_;
+
+    std::mutex collectors_mutex_;  // Guards collectors_ and exporters_
+    std::vector<std::function<void()>> collectors_;
+    std::vector<std::function<void(std::string&)>> exporters_;
+
+    std::mutex render_mutex_;  // Guards body_ and reported_duplicates_
+    std::string body_;
+    std::unordered_set<std::string> reported_duplicates_;  // Logged once each
+
+    int listen_fd_ = -1;
+    std::atomic<uint16_t> port_{0};
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+} // namespace dropboxlite
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "common/numa_topology.h"
+#include "common/thread_pool.h"
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace dropboxlite {
+
+// One ThreadPool per NUMA node, its workers pinned to that node's CPUs, so
+// a task runs next to the memory it works on instead of pulling it across
+// the interconnect. Allocate buffers with allocate(node) (or on a node
+// worker, which first-touches locally) and hand the work to postNear():
+// hashing then reads node-local memory.
+class NumaPools {
+public:
+    // threads_per_node 0 means one thread per CPU of the node
+    explicit NumaPools(const NumaTopology& topology = NumaTopology::system(),
+                       size_t threads_per_node = 0);
+
+    const NumaTopology& topology() const { return topology_; }
+    size_t nodeCount() const { return pools_.size(); }
+
+    // Pool of node id; the caller's node for an unknown id
+    ThreadPool& pool(int node);
+    ThreadPool& localPool() { return pool(topology_.currentNode()); }
+
+    // Pool of the node holding data's page, falling back to the caller's
+    ThreadPool& poolFor(const void* data) { return pool(NumaTopology::nodeOfAddress(data)); }
+
+    // Run f on the node that owns data
+    template<typename F>
+    void postNear(const void* data, F&& f) { poolFor(data).post(std::forward<F>(f)); }
+    template<typename F>
+    auto submitNear(const void* data, F&& f) { return poolFor(data).submit(std::forward<F>(f)); }
+
+    // Buffer placed on node (the caller's if negative)
+    NodeBuffer allocate(size_t size, int node = -1);
+
+    // Publish each node pool's lane gauges as thread_pool.node<id>.*
+    void publishMetrics() const;
+
+    // Wait for every pool to go idle
+    void wait();
+
+private:
+    NumaTopology topology_;
+    std::vector<std::unique_ptr<ThreadPool>> pools_;  // In topology order
+    std::vector<int> pool_of_node_;                   // Node id -> index, or -1
+};
+
+} // namespace dropboxlite
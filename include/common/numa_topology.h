@@ -0,0 +1,85 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace dropboxlite {
+
+struct NumaNode {
+    int id;
+    std::vector<int> cpus;
+};
+
+// NUMA nodes and their CPUs, as the kernel reports them under /sys.
+// Hosts without that directory (other kernels, some containers) look like
+// one node holding every CPU, so callers need no special case.
+class NumaTopology {
+public:
+    // Nodes listed under root; memory-only nodes (no CPUs) are left out
+    static NumaTopology detect(const std::string& root = "/sys/devices/system/node");
+
+    // This process's topology: detect(), restricted to the CPUs the
+    // process may run on. Read once.
+    static const NumaTopology& system();
+
+    // Parse a kernel CPU list such as "0-3,8-11"
+    static std::vector<int> parseCpuList(const std::string& list);
+
+    // Same topology without CPUs outside allowed, dropping emptied nodes
+    NumaTopology restrictTo(const std::vector<int>& allowed) const;
+
+    const std::vector<NumaNode>& nodes() const { return nodes_; }
+    size_t nodeCount() const { return nodes_.size(); }
+
+    // Node id of cpu, or -1 if unknown
+    int nodeOfCpu(int cpu) const;
+
+    // Node of the CPU the calling thread is running on; the first node if
+    // that cannot be told
+    int currentNode() const;
+
+    // Node holding the page at address, or -1 if unknown: the page is not
+    // resident (checked first, without faulting it in) or the kernel has
+    // no NUMA support
+    static int nodeOfAddress(const void* address);
+
+private:
+    void index();
+
+    std::vector<NumaNode> nodes_;
+    std::vector<int> cpu_to_node_;
+};
+
+// Page-aligned anonymous buffer whose pages the kernel is asked to place
+// on one node. The placement is a hint: without NUMA support, or when the
+// node is full, pages land wherever the kernel puts them.
+class NodeBuffer {
+public:
+    NodeBuffer() = default;
+    // Throws std::bad_alloc if the memory cannot be mapped
+    NodeBuffer(size_t size, int node);
+    ~NodeBuffer();
+
+    NodeBuffer(NodeBuffer&& other) noexcept;
+    NodeBuffer& operator=(NodeBuffer&& other) noexcept;
+    NodeBuffer(const NodeBuffer&) = delete;
+    NodeBuffer& operator=(const NodeBuffer&) = delete;
+
+    uint8_t* data() { return data_; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    std::span<uint8_t> span() { return {data_, size_}; }
+    int node() const { return node_; }
+
+private:
+    void release();
+
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    int node_ = -1;
+};
+
+} // namespace dropboxlite
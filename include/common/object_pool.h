@@ -0,0 +1,129 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <new>
+#include <cstddef>
+
+namespace dropboxlite {
+
+// Recycling allocator for one hot object type. Each thread keeps a cache
+// of free slots, so create/destroy are a few pointer moves; caches trade
+// whole batches with a shared depot, so objects created on one thread and
+// destroyed on another (tasks, future state) flow back without a lock per
+// object. Slots are never returned to the system: memory stays at the
+// peak number of live objects.
+template<typename T>
+class ObjectPool {
+public:
+    template<typename... Args>
+    static T* create(Args&&... args) {
+        Slot* slot = cache().pop();
+        try {
+            return ::new (slot->storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            cache().push(slot);
+            throw;
+        }
+    }
+
+    static void destroy(T* object) {
+        object->~T();
+        cache().push(reinterpret_cast<Slot*>(object));
+    }
+
+private:
+    static constexpr size_t kBatch = 64;
+
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    // Free batches, each a list of kBatch slots
+    struct Depot {
+        std::mutex mutex;
+        std::vector<Slot*> batches;
+    };
+
+    struct Cache {
+        Slot* head = nullptr;
+        size_t count = 0;
+
+        ~Cache() {
+            while (count >= kBatch) {
+                flush();
+            }
+            if (head) {
+                Depot& shared = depot();
+                std::lock_guard<std::mutex> lock(shared.mutex);
+                shared.batches.push_back(head);
+            }
+        }
+
+        Slot* pop() {
+            if (!head) {
+                refill();
+            }
+            if (!head) {
+                return static_cast<Slot*>(::operator new(sizeof(Slot)));
+            }
+            Slot* slot = head;
+            head = slot->next;
+            count--;
+            return slot;
+        }
+
+        void push(Slot* slot) {
+            slot->next = head;
+            head = slot;
+            if (++count >= 2 * kBatch) {
+                flush();
+            }
+        }
+
+        void refill() {
+            Depot& shared = depot();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            if (shared.batches.empty()) {
+                return;
+            }
+            head = shared.batches.back();
+            shared.batches.pop_back();
+            count = 0;
+            for (Slot* slot = head; slot; slot = slot->next) {
+                count++;
+            }
+        }
+
+        // Hand the first kBatch slots to the depot
+        void flush() {
+            Slot* batch = head;
+            Slot* last = head;
+            for (size_t i = 1; i < kBatch; i++) {
+                last = last->next;
+            }
+            head = last->next;
+            last->next = nullptr;
+            count -= kBatch;
+
+            Depot& shared = depot();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            shared.batches.push_back(batch);
+        }
+    };
+
+    // Never destroyed, so thread caches can drain into it at any exit
+    static Depot& depot() {
+        static Depot* shared = new Depot;
+        return *shared;
+    }
+
+    static Cache& cache() {
+        thread_local Cache local;
+        return local;
+    }
+};
+
+} // namespace dropboxlite
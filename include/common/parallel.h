@@ -0,0 +1,398 @@
+#pragma once
+
+#include "common/thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+namespace dropboxlite {
+
+namespace detail {
+
+// Hands out [begin, end) in shrinking pieces: each claim takes a share of
+// what is left (guided scheduling), so early pieces are large and cheap to
+// schedule while the tail is fine-grained enough to balance. The calling
+// thread works too and then waits only for helpers that actually started,
+// so a loop run from inside the pool cannot deadlock on queued helpers.
+class RangeClaimer {
+public:
+    RangeClaimer(size_t begin, size_t end, size_t min_grain, size_t participants)
+        : next_(begin), end_(end), min_grain_(min_grain),
+          divisor_(2 * std::max<size_t>(1, participants)) {}
+
+    bool claim(size_t& lo, size_t& hi) {
+        size_t current = next_.load(std::memory_order_relaxed);
+        while (current < end_) {
+            size_t grain = std::max(min_grain_, (end_ - current) / divisor_);
+            size_t stop = std::min(end_, current + grain);
+            if (next_.compare_exchange_weak(current, stop, std::memory_order_relaxed)) {
+                lo = current;
+                hi = stop;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Stop handing out work, after an exception
+    void cancel() { next_.store(end_, std::memory_order_relaxed); }
+
+    void fail(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = std::move(error);
+        }
+        cancel();
+    }
+
+    // Helper entry: false if the caller already finished, in which case
+    // the helper must not touch anything the caller owns
+    bool enter() {
+        active_.fetch_add(1, std::memory_order_seq_cst);
+        if (closed_.load(std::memory_order_seq_cst)) {
+            leave();
+            return false;
+        }
+        return true;
+    }
+
+    void leave() {
+        if (active_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            active_.notify_all();
+        }
+    }
+
+    // Caller: wait for the helpers that got in, then rethrow their error
+    void close() {
+        closed_.store(true, std::memory_order_seq_cst);
+        int active;
+        while ((active = active_.load(std::memory_order_seq_cst)) != 0) {
+            active_.wait(active, std::memory_order_seq_cst);
+        }
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    std::atomic<size_t> next_;
+    size_t end_;
+    size_t min_grain_;
+    size_t divisor_;
+    std::atomic<int> active_{0};
+    std::atomic<bool> closed_{false};
+    std::mutex mutex_;
+    std::exception_ptr error_;
+};
+
+// Runs worker() on the calling thread and up to pool.size() helpers
+template<typename Worker>
+void runClaimers(ThreadPool& pool, size_t pieces, const std::shared_ptr<RangeClaimer>& claimer,
+                 Worker& worker) {
+    size_t helpers = std::min(pool.size(), pieces) - 1;
+    for (size_t i = 0; i < helpers; i++) {
+        pool.post([claimer, &worker] {
+            if (!claimer->enter()) {
+                return;
+            }
+            try {
+                worker();
+            } catch (...) {
+                claimer->fail(std::current_exception());
+            }
+            claimer->leave();
+        });
+    }
+    try {
+        worker();
+    } catch (...) {
+        claimer->fail(std::current_exception());
+    }
+    claimer->close();
+}
+
+} // namespace detail
+
+// Call body(lo, hi) over disjoint subranges covering [begin, end), in
+// parallel on pool. Subranges are never smaller than min_grain (except the
+// last). Returns when every subrange is done; the first exception thrown by
+// body is rethrown here.
+template<typename Body>
+void parallelFor(ThreadPool& pool, size_t begin, size_t end, Body&& body, size_t min_grain = 1) {
+    min_grain = std::max<size_t>(1, min_grain);
+    if (begin >= end) {
+        return;
+    }
+    size_t pieces = (end - begin + min_grain - 1) / min_grain;
+    if (pool.size() < 2 || pieces < 2) {
+        body(begin, end);
+        return;
+    }
+
+    auto claimer = std::make_shared<detail::RangeClaimer>(begin, end, min_grain, pool.size());
+    auto worker = [&] {
+        size_t lo, hi;
+        while (claimer->claim(lo, hi)) {
+            body(lo, hi);
+        }
+    };
+    detail::runClaimers(pool, pieces, claimer, worker);
+}
+
+// Reduce map(lo, hi) over subranges of [begin, end) with combine, starting
+// each participant from identity. combine must be associative and
+// commutative: subranges are combined in no particular order.
+template<typename T, typename Map, typename Combine>
+T parallelReduce(ThreadPool& pool, size_t begin, size_t end, T identity,
+                 Map&& map, Combine&& combine, size_t min_grain = 1) {
+    min_grain = std::max<size_t>(1, min_grain);
+    if (begin >= end) {
+        return identity;
+    }
+    size_t pieces = (end - begin + min_grain - 1) / min_grain;
+    if (pool.size() < 2 || pieces < 2) {
+        return combine(std::move(identity), map(begin, end));
+    }
+
+    std::mutex mutex;
+    T result = identity;
+    auto claimer = std::make_shared<detail::RangeClaimer>(begin, end, min_grain, pool.size());
+    auto worker = [&] {
+        T local = identity;
+        size_t lo, hi;
+        bool any = false;
+        while (claimer->claim(lo, hi)) {
+            local = combine(std::move(local), map(lo, hi));
+            any = true;
+        }
+        if (any) {
+            std::lock_guard<std::mutex> lock(mutex);
+            result = combine(std::move(result), std::move(local));
+        }
+    };
+    detail::runClaimers(pool, pieces, claimer, worker);
+    return result;
+}
+
+enum class StageMode {
+    Serial,   // One item at a time, in the order the source produced them
+    Parallel  // Any number of items at once
+};
+
+// Bounded pipeline over items of type T, e.g. read -> chunk -> hash ->
+// compress -> write. A serial source fills items and each stage transforms
+// them in place. At most max_in_flight items exist at once: the source
+// waits for one to leave the last stage before producing another, which is
+// the backpressure. Items are recycled, so buffers inside T keep their
+// capacity from one use to the next.
+//
+// Parallel stages run as pool tasks; a serial stage is drained by
+// whichever thread delivers the item it is waiting for. run() blocks, so
+// call it from outside the pool.
+template<typename T>
+class Pipeline {
+public:
+    // Fill the item and return true, or return false when exhausted
+    using Source = std::function<bool(T& item)>;
+    using Stage = std::function<void(T& item)>;
+
+    explicit Pipeline(size_t max_in_flight) : max_in_flight_(std::max<size_t>(1, max_in_flight)) {}
+
+    Pipeline& source(Source fn) {
+        source_ = std::move(fn);
+        return *this;
+    }
+
+    Pipeline& stage(StageMode mode, Stage fn) {
+        stages_.push_back(std::make_unique<StageState>(mode, std::move(fn)));
+        return *this;
+    }
+
+    // Run to completion; the first exception from the source or a stage
+    // stops production and is rethrown once in-flight items have drained
+    void run(ThreadPool& pool) {
+        pool_ = &pool;
+        items_.resize(max_in_flight_);
+        free_.clear();
+        for (size_t i = max_in_flight_; i > 0; i--) {
+            free_.push_back(i - 1);
+        }
+        for (auto& stage : stages_) {
+            stage->next_sequence = 0;
+        }
+        in_flight_ = 0;
+        error_ = nullptr;
+        failed_ = false;
+
+        for (uint64_t sequence = 0; !failed_.load(std::memory_order_relaxed); sequence++) {
+            // Backpressure: wait for a free item
+            size_t count;
+            while ((count = in_flight_.load(std::memory_order_acquire)) == max_in_flight_) {
+                in_flight_.wait(count, std::memory_order_acquire);
+            }
+
+            size_t slot = takeSlot();
+            bool produced = false;
+            try {
+                produced = source_(items_[slot]);
+            } catch (...) {
+                fail(std::current_exception());
+            }
+            if (!produced) {
+                releaseSlot(slot);
+                break;
+            }
+
+            in_flight_.fetch_add(1, std::memory_order_acq_rel);
+            forward(slot, sequence, 0, false);
+        }
+
+        size_t count;
+        while ((count = in_flight_.load(std::memory_order_acquire)) != 0) {
+            in_flight_.wait(count, std::memory_order_acquire);
+        }
+        // Tasks may still be on their way out after finishing the last item
+        {
+            std::unique_lock<std::mutex> lock(tasks_mutex_);
+            tasks_done_.wait(lock, [this] { return tasks_ == 0; });
+        }
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    struct StageState {
+        StageState(StageMode mode, Stage fn) : mode(mode), fn(std::move(fn)) {}
+
+        StageMode mode;
+        Stage fn;
+
+        // Serial stages: items that arrived early, keyed by sequence
+        std::mutex mutex;
+        std::map<uint64_t, size_t> waiting;
+        uint64_t next_sequence = 0;
+        bool draining = false;
+    };
+
+    void forward(size_t slot, uint64_t sequence, size_t index, bool on_pool) {
+        while (index < stages_.size()) {
+            StageState& stage = *stages_[index];
+            if (stage.mode == StageMode::Serial) {
+                deliverSerial(slot, sequence, index);
+                return;
+            }
+            if (!on_pool) {
+                {
+                    std::lock_guard<std::mutex> lock(tasks_mutex_);
+                    tasks_++;
+                }
+                pool_->post([this, slot, sequence, index] {
+                    forward(slot, sequence, index, true);
+                    taskDone();
+                });
+                return;
+            }
+            apply(stage, slot);
+            index++;
+        }
+        finish(slot);
+    }
+
+    // Queue the item at a serial stage and, unless another thread is
+    // already draining it, run every item that is now in order
+    void deliverSerial(size_t slot, uint64_t sequence, size_t index) {
+        StageState& stage = *stages_[index];
+        std::unique_lock<std::mutex> lock(stage.mutex);
+        stage.waiting.emplace(sequence, slot);
+        if (stage.draining) {
+            return;
+        }
+        stage.draining = true;
+        while (!stage.waiting.empty() && stage.waiting.begin()->first == stage.next_sequence) {
+            auto [ready_sequence, ready_slot] = *stage.waiting.begin();
+            stage.waiting.erase(stage.waiting.begin());
+            stage.next_sequence++;
+            lock.unlock();
+
+            apply(stage, ready_slot);
+            // Later parallel stages go back to the pool rather than
+            // holding up this drain
+            forward(ready_slot, ready_sequence, index + 1, false);
+
+            lock.lock();
+        }
+        stage.draining = false;
+    }
+
+    void apply(StageState& stage, size_t slot) {
+        if (failed_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        try {
+            stage.fn(items_[slot]);
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    }
+
+    void finish(size_t slot) {
+        releaseSlot(slot);
+        in_flight_.fetch_sub(1, std::memory_order_acq_rel);
+        in_flight_.notify_all();
+    }
+
+    void taskDone() {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        if (--tasks_ == 0) {
+            tasks_done_.notify_all();
+        }
+    }
+
+    size_t takeSlot() {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        size_t slot = free_.back();
+        free_.pop_back();
+        return slot;
+    }
+
+    void releaseSlot(size_t slot) {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        free_.push_back(slot);
+    }
+
+    void fail(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        if (!error_) {
+            error_ = std::move(error);
+        }
+        failed_ = true;
+    }
+
+    size_t max_in_flight_;
+    Source source_;
+    std::vector<std::unique_ptr<StageState>> stages_;
+    ThreadPool* pool_ = nullptr;
+
+    std::vector<T> items_;
+    std::mutex free_mutex_;
+    std::vector<size_t> free_;
+    std::atomic<size_t> in_flight_{0};
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_;
+
+    // Posted tasks not yet returned; run() waits for them so none touches
+    // the pipeline after it is gone
+    std::mutex tasks_mutex_;
+    std::condition_variable tasks_done_;
+    size_t tasks_ = 0;
+};
+
+} // namespace dropboxlite
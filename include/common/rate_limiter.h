@@ -1,15 +1,28 @@
 #pragma once
 
+#include "common/inline_task.h"
+#include "common/timer_wheel.h"
 #include <chrono>
-#include <mutex>
 #include <atomic>
+#include <coroutine>
+#include <cstdint>
 
 namespace dropboxlite {
 
-// Token bucket rate limiter for bandwidth control
+class Executor;
+
+// Token bucket rate limiter for bandwidth control.
+//
+// Lock-free: the bucket is one atomic timestamp in nanoseconds (GCRA).
+// Credit is how far that time lies behind now, capped at the burst, and
+// taking n bytes moves it n / rate seconds forward with a single CAS.
+// Waiters reserve their bytes up front and then sleep exactly until they
+// are covered, so they are served in arrival order with no polling.
 class RateLimiter {
 public:
-    // bytes_per_second: maximum throughput
+    using Clock = std::chrono::steady_clock;
+    
+    // bytes_per_second: maximum throughput (0 means unlimited)
     // burst_size: maximum burst capacity
     explicit RateLimiter(size_t bytes_per_second, size_t burst_size = 0);
     
@@ -19,23 +32,58 @@ public:
     // Try to acquire tokens (non-blocking)
     bool tryAcquire(size_t bytes);
     
-    // Set new rate
+    // Take bytes now, going into debt if needed, and return when they are
+    // covered; the caller must not send before then. Requests larger than
+    // the burst are allowed and simply wait longer.
+    Clock::time_point reserve(size_t bytes);
+    
+    // Non-blocking acquire: done runs once the bytes are covered, at once
+    // on this thread if they already are, else on the timer wheel's thread
+    // (keep it short, e.g. post to a pool)
+    void acquireAsync(size_t bytes, InlineTask done);
+    
+    // co_await acquireAsync(executor, bytes) inside a Task (with
+    // common/executor.h included); resumes on the executor's pool
+    auto acquireAsync(Executor& executor, size_t bytes) { return Awaiter{executor, reserve(bytes)}; }
+    
+    // Wheel for callback-style acquireAsync; TimerWheel::shared() if unset
+    void setTimerWheel(TimerWheel* wheel) { wheel_ = wheel; }
+    
+    // Set new rate; the burst follows it. Credit already in the bucket
+    // carries over, capped at the new burst.
     void setRate(size_t bytes_per_second);
     
     // Get current rate
-    size_t getRate() const { return bytes_per_second_; }
+    size_t getRate() const { return bytes_per_second_.load(std::memory_order_relaxed); }
     
     // Get available tokens
     size_t available() const;
     
+    // Earliest time the bucket is out of debt (in the past when it holds
+    // credit); a reservation made from then on is not held back by
+    // earlier ones
+    Clock::time_point nextAvailable() const;
+    
 private:
-    void refill();
+    // Sleeps on the executor until a reservation is covered; suspending is
+    // out of line so this header needs only a declaration of Executor
+    struct Awaiter {
+        Executor& executor;
+        Clock::time_point deadline;
+        
+        bool await_ready() const noexcept { return deadline <= Clock::now(); }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const noexcept {}
+    };
+    
+    static int64_t nowNanos();
+    int64_t nanosFor(size_t bytes) const;
     
-    size_t bytes_per_second_;
-    size_t burst_size_;
-    std::atomic<double> tokens_;
-    std::chrono::steady_clock::time_point last_refill_;
-    mutable std::mutex mutex_;
+    std::atomic<size_t> bytes_per_second_;
+    std::atomic<size_t> burst_size_;
+    std::atomic<int64_t> burst_ns_;
+    std::atomic<int64_t> tat_ns_;  // Time all taken bytes are paid for
+    std::atomic<TimerWheel*> wheel_{nullptr};
 };
 
 } // namespace dropboxlite
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "common/future.h"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace dropboxlite {
+
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    // Resumed when the task finishes; nothing if it was never awaited
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Hand control straight to the awaiting coroutine (symmetric
+    // transfer), so long await chains don't grow the stack
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            return handle.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template<typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    template<typename U>
+    void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+
+    T result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+// Fire-and-forget coroutine: starts at once and frees itself at the end
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+// Lazily started coroutine producing a T. Nothing runs until the task is
+// co_awaited; the awaiting coroutine is resumed, on whichever thread the
+// task finished on, with the value or the task's exception. Owning and
+// move-only: destroying an unfinished task destroys its frame.
+template<typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() noexcept = default;
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool valid() const noexcept { return static_cast<bool>(handle_); }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() noexcept { return !handle || handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter{handle_};
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template<typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+template<typename T>
+DetachedTask completeInto(Task<T> task, Promise<T> promise) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            promise.setValue();
+        } else {
+            promise.setValue(co_await std::move(task));
+        }
+    } catch (...) {
+        promise.setException(std::current_exception());
+    }
+}
+
+} // namespace detail
+
+// Start task on the calling thread and block until it finishes. For the
+// edges of async code (main, tests, synchronous RPC handlers); calling it
+// from a pool worker ties that worker up for the duration.
+template<typename T>
+T syncWait(Task<T> task) {
+    Promise<T> promise;
+    Future<T> result = promise.getFuture();
+    detail::completeInto(std::move(task), std::move(promise));
+    return result.get();
+}
+
+} // namespace dropboxlite
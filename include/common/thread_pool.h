@@ -1,19 +1,71 @@
 #pragma once
 
+#include "common/inline_task.h"
+#include "common/future.h"
+#include <array>
+#include <chrono>
+#include <string>
 #include <vector>
-#include <queue>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <functional>
 #include <future>
 #include <atomic>
+#include <memory>
+#include <stdexcept>
 
 namespace dropboxlite {
 
-// High-performance thread pool for parallel operations
+// Scheduling class of a task. Each has its own queues, so interactive work
+// (a user opening a file) never waits behind a backlog of bulk hashing.
+enum class Priority : uint8_t {
+    Interactive = 0,
+    Normal = 1,
+    Background = 2
+};
+
+// How workers choose between lanes that have work
+enum class LanePolicy : uint8_t {
+    Strict,       // Always the highest-priority lane with work anywhere in the pool
+    WeightedFair  // Lanes share workers in proportion to their weights
+};
+
+struct LaneConfig {
+    uint32_t weight = 1;                  // Share under WeightedFair
+    size_t max_running = 0;               // Concurrency cap, 0 for none
+    std::chrono::milliseconds max_wait{0}; // Served ahead of policy once
+                                           // it waits this long, 0 for never
+};
+
+struct LaneStats {
+    size_t queued;
+    size_t running;
+    uint64_t completed;
+    double avg_wait_us;   // Enqueue to start, over all completed tasks
+    int64_t max_wait_us;  // Since the last publishMetrics
+};
+
+// High-performance thread pool for parallel operations.
+//
+// Work-stealing: each worker owns a Chase-Lev deque. Tasks enqueued from a
+// worker go onto its own deque and are popped newest first, which keeps
+// recursive fan-out cache-warm; idle workers steal the oldest task from a
+// random victim. Tasks from outside the pool land in per-worker inboxes
+// spread round-robin, so producers rarely meet on one lock. Idle workers
+// park on a futex and a producer only wakes one when none is already
+// searching for work.
+//
+// Every priority lane has its own deques and inboxes; a worker picks the
+// lane first (policy, caps and aging) and only then looks for a task in
+// it. Tasks without an explicit priority take their parent task's, or
+// Normal when submitted from outside the pool.
+//
+// Tasks are InlineTasks recycled through an ObjectPool, so post() of a
+// small callable does not touch the heap, and submit() adds only a pooled
+// result slot. enqueue() still pays for std::future's shared state.
 class ThreadPool {
 public:
+    static constexpr size_t kLanes = 3;
+    
     explicit ThreadPool(size_t num_threads = std::thread::hardware_concurrency());
     ~ThreadPool();
     
@@ -21,6 +73,45 @@ public:
     template<typename F, typename... Args>
     auto enqueue(F&& f, Args&&... args) 
         -> std::future<typename std::invoke_result<F, Args...>::type>;
+    template<typename F, typename... Args>
+    auto enqueue(Priority priority, F&& f, Args&&... args)
+        -> std::future<typename std::invoke_result<F, Args...>::type>;
+    
+    // Same, with a pooled Future; for tasks submitted at high rates
+    template<typename F, typename... Args>
+    auto submit(F&& f, Args&&... args)
+        -> Future<std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>&...>>;
+    template<typename F, typename... Args>
+    auto submit(Priority priority, F&& f, Args&&... args)
+        -> Future<std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>&...>>;
+    
+    // Fire and forget: no result, no allocation for small callables. The
+    // task must not throw; an escaping exception terminates the process.
+    template<typename F>
+    void post(F&& f);
+    template<typename F>
+    void post(Priority priority, F&& f);
+    
+    // Lane scheduling; defaults are Strict with no caps or aging. Safe to
+    // change while tasks run.
+    void setLanePolicy(LanePolicy policy) { policy_ = policy; }
+    void setLaneConfig(Priority priority, const LaneConfig& config);
+    
+    LaneStats laneStats(Priority priority) const;
+    
+    // Copy lane stats into Metrics as gauges named
+    // <prefix>.<lane>.{queue_depth,running,completed,wait_avg_us,wait_max_us}
+    void publishMetrics(const std::string& prefix = "thread_pool") const;
+    
+    static const char* priorityName(Priority priority);
+    
+    // Priority of the task running on this thread if it is one of this
+    // pool's workers, else Normal; what tasks posted from here inherit
+    Priority inheritedPriority() const;
+    
+    // Restrict every worker to the given CPUs (e.g. one NUMA node's);
+    // false if the OS refused. Workers still float among those CPUs.
+    bool pinWorkers(const std::vector<int>& cpus);
     
     // Get number of active threads
     size_t size() const { return workers_.size(); }
@@ -32,41 +123,111 @@ public:
     void wait();
     
 private:
+    struct Task {
+        InlineTask fn;
+        int64_t enqueued_ns;
+        Priority priority;
+    };
+    struct Worker;
+    struct WorkerLane;
+    
+    struct Lane {
+        std::atomic<size_t> queued{0};
+        std::atomic<size_t> running{0};
+        std::atomic<uint64_t> completed{0};
+        std::atomic<int64_t> wait_ns{0};
+        mutable std::atomic<int64_t> max_wait_ns{0};
+        std::atomic<int64_t> last_served_ns{0};
+        
+        std::atomic<uint32_t> weight{1};
+        std::atomic<size_t> max_running{0};
+        std::atomic<int64_t> max_wait_ns_config{0};
+    };
+    
+    void schedule(Priority priority, InlineTask&& fn);
+    void workerLoop(size_t index);
+    Task* findTask(Worker& self, bool steal);
+    Task* takeFromLane(Worker& self, size_t lane, bool steal);
+    bool acquireSlot(size_t lane);
+    Task* park(Worker& self);
+    void run(Task* task);
+    void wakeOne();
+    
     std::vector<std::thread> workers_;
-    std::queue<std::function<void()>> tasks_;
+    std::vector<std::unique_ptr<Worker>> queues_;
+    std::array<Lane, kLanes> lanes_;
+    std::atomic<LanePolicy> policy_;
     
-    mutable std::mutex queue_mutex_;
-    std::condition_variable condition_;
-    std::condition_variable wait_condition_;
     std::atomic<bool> stop_;
-    std::atomic<size_t> active_tasks_;
+    std::atomic<size_t> unfinished_;  // Enqueued, not yet completed
+    std::atomic<size_t> searching_;   // Workers looking for work
+    std::atomic<size_t> sleepers_;    // Workers parked or about to park
+    std::atomic<bool> waking_;        // A wake has been sent, not yet taken
+    std::atomic<uint32_t> wake_epoch_;
 };
 
 // Template implementation
 template<typename F, typename... Args>
 auto ThreadPool::enqueue(F&& f, Args&&... args) 
     -> std::future<typename std::invoke_result<F, Args...>::type> {
+    return enqueue(inheritedPriority(), std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template<typename F, typename... Args>
+auto ThreadPool::enqueue(Priority priority, F&& f, Args&&... args)
+    -> std::future<typename std::invoke_result<F, Args...>::type> {
     
     using return_type = typename std::invoke_result<F, Args...>::type;
     
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-    );
+    std::promise<return_type> promise;
+    std::future<return_type> result = promise.get_future();
     
-    std::future<return_type> result = task->get_future();
-    
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-        
-        if (stop_) {
-            throw std::runtime_error("enqueue on stopped ThreadPool");
+    schedule(priority, [promise = std::move(promise), f = std::forward<F>(f),
+                        ...args = std::forward<Args>(args)]() mutable {
+        try {
+            if constexpr (std::is_void_v<return_type>) {
+                f(args...);
+                promise.set_value();
+            } else {
+                promise.set_value(f(args...));
+            }
+        } catch (...) {
+            promise.set_exception(std::current_exception());
         }
-        
-        tasks_.emplace([task]() { (*task)(); });
-    }
+    });
+    return result;
+}
+
+template<typename F, typename... Args>
+auto ThreadPool::submit(F&& f, Args&&... args)
+    -> Future<std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>&...>> {
+    return submit(inheritedPriority(), std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template<typename F, typename... Args>
+auto ThreadPool::submit(Priority priority, F&& f, Args&&... args)
+    -> Future<std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>&...>> {
+    
+    using return_type = std::invoke_result_t<std::decay_t<F>&, std::decay_t<Args>&...>;
     
-    condition_.notify_one();
+    Promise<return_type> promise;
+    Future<return_type> result = promise.getFuture();
+    
+    schedule(priority, [promise = std::move(promise), f = std::forward<F>(f),
+                        ...args = std::forward<Args>(args)]() mutable {
+        promise.setFrom(f, args...);
+    });
     return result;
 }
 
+template<typename F>
+void ThreadPool::post(F&& f) {
+    schedule(inheritedPriority(), std::forward<F>(f));
+}
+
+template<typename F>
+void ThreadPool::post(Priority priority, F&& f) {
+    schedule(priority, std::forward<F>(f));
+}
+
 } // namespace dropboxlite
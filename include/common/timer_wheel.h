@@ -0,0 +1,69 @@
+#pragma once
+
+#include "common/inline_task.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace dropboxlite {
+
+// Hashed timer wheel: deadlines are rounded up to a tick and hashed into
+// a ring of slots, so scheduling is O(1) however many timers are pending.
+// One thread fires them, sleeping until the next occupied slot rather
+// than waking every tick. Callbacks run on that thread and must be short;
+// hand real work to a pool.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TimerWheel(Clock::duration tick = std::chrono::milliseconds(1), size_t slots = 1024);
+    // Stops the thread; callbacks that have not fired are dropped
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Run fn no earlier than deadline, and within about a tick of it;
+    // past deadlines fire on the next tick
+    void schedule(Clock::time_point deadline, InlineTask fn);
+    void scheduleAfter(Clock::duration delay, InlineTask fn) {
+        schedule(Clock::now() + delay, std::move(fn));
+    }
+
+    // Timers not yet fired
+    size_t pending() const;
+
+    Clock::duration tick() const { return tick_; }
+
+    // Process-wide wheel, for components without one of their own
+    static TimerWheel& shared();
+
+private:
+    struct Entry {
+        InlineTask fn;
+        uint64_t tick;
+        Entry* next;
+    };
+
+    uint64_t ticksUntil(Clock::time_point time, bool round_up) const;
+    uint64_t nextOccupied() const;
+    void run();
+
+    Clock::duration tick_;
+    Clock::time_point start_;
+    std::vector<Entry*> slots_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    uint64_t current_ = 0;            // Next tick to fire
+    uint64_t wake_tick_ = UINT64_MAX; // Tick the thread sleeps until
+    size_t pending_ = 0;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace dropboxlite
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace dropboxlite {
+
+// Chase-Lev work-stealing deque of pointers (the C11 formulation of Lê et
+// al., "Correct and Efficient Work-Stealing for Weak Memory Models"). The
+// owning thread pushes and pops at the bottom without locking; any thread
+// may steal from the top. The ring grows when full; retired rings are kept
+// until destruction, since a thief may still be reading one.
+template<typename T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 256)
+        : top_(0), bottom_(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        rings_.push_back(std::make_unique<Ring>(size));
+        ring_.store(rings_.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner only
+    void push(T* item) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        if (b - t > static_cast<int64_t>(ring->mask)) {
+            ring = grow(ring, t, b);
+        }
+        ring->put(b, item);
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only; newest item first, nullptr if empty
+    T* pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Ring* ring = ring_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T* item = ring->get(b);
+        if (t == b) {
+            // Last item: race any thief for it
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread; oldest item first, nullptr if empty or another thread won
+    // the race for it
+    T* steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+
+        Ring* ring = ring_.load(std::memory_order_acquire);
+        T* item = ring->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    // Approximate when other threads are pushing or stealing
+    size_t size() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    struct Ring {
+        explicit Ring(size_t size) : mask(size - 1), slots(new std::atomic<T*>[size]) {}
+
+        T* get(int64_t i) const {
+            return slots[static_cast<size_t>(i) & mask].load(std::memory_order_relaxed);
+        }
+        void put(int64_t i, T* item) {
+            slots[static_cast<size_t>(i) & mask].store(item, std::memory_order_relaxed);
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<T*>[]> slots;
+    };
+
+    Ring* grow(Ring* ring, int64_t t, int64_t b) {
+        auto bigger = std::make_unique<Ring>(2 * (ring->mask + 1));
+        for (int64_t i = t; i < b; i++) {
+            bigger->put(i, ring->get(i));
+        }
+        Ring* next = bigger.get();
+        rings_.push_back(std::move(bigger));
+        ring_.store(next, std::memory_order_release);
+        return next;
+    }
+
+    // Top and bottom on separate cache lines: thieves hammer one, the
+    // owner the other
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+    std::atomic<Ring*> ring_;
+    std::vector<std::unique_ptr<Ring>> rings_; // Owner only
+};
+
+} // namespace dropboxlite
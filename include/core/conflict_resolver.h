@@ -2,6 +2,8 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
+#include "common/digest.h"
 
 namespace dropboxlite {
 
@@ -14,8 +16,8 @@ enum class ConflictStrategy {
 
 struct ConflictInfo {
     std::string path;
-    std::string local_hash;
-    std::string remote_hash;
+    Digest local_hash;
+    Digest remote_hash;
     int64_t local_modified_time;
     int64_t remote_modified_time;
     int32_t local_version;
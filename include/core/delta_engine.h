@@ -4,7 +4,7 @@
 #include "core/metadata_db.h"
 #include <vector>
 #include <string>
-#include <set>
+#include <unordered_set>
 
 namespace dropboxlite {
 
@@ -12,6 +12,7 @@ struct DeltaInfo {
     std::vector<ChunkInfo> new_chunks;      // Chunks to upload
     std::vector<ChunkInfo> existing_chunks; // Chunks already on server
     size_t bytes_to_transfer;
+    Digest file_hash;                       // Whole-file digest, same read pass
 };
 
 class DeltaEngine {
@@ -20,21 +21,21 @@ public:
     
     // Compute delta between local file and server version
     DeltaInfo computeDelta(const std::string& filepath,
-                          const std::vector<std::string>& server_chunk_hashes);
+                          const std::vector<Digest>& server_chunk_hashes);
     
     // Apply delta to reconstruct file
     bool applyDelta(const std::string& filepath,
                    const std::vector<ChunkInfo>& chunks,
                    const std::vector<uint8_t>& chunk_data);
     
-    // Check if files are identical based on hash
+    // Check if two local files have identical contents
     bool areFilesIdentical(const std::string& path1, const std::string& path2);
     
 private:
     MetadataDB& db_;
     Chunker chunker_;
     
-    std::set<std::string> convertToSet(const std::vector<std::string>& hashes);
+    std::unordered_set<Digest> convertToSet(const std::vector<Digest>& hashes);
 };
 
 } // namespace dropboxlite
@@ -5,6 +5,9 @@
 #include <optional>
 #include <memory>
 #include <sqlite3.h>
+#include "common/digest.h"
+#include "common/hash.h"
+#include "common/compression.h"
 
 namespace dropboxlite {
 
@@ -12,11 +15,12 @@ struct FileRecord {
     std::string path;
     int64_t size;
     int64_t modified_time;
-    std::string hash;
+    Digest hash;
     int32_t version;
     bool is_directory;
     bool deleted;
     int64_t last_sync_time;
+    HashAlgorithm hash_algorithm = HashAlgorithm::SHA256;
 };
 
 class MetadataDB {
@@ -34,11 +38,20 @@ public:
     std::vector<FileRecord> getModifiedSince(int64_t timestamp);
     bool deleteFile(const std::string& path);
     
+    // Digest of a file under an algorithm other than the one it was
+    // recorded with, cached while its recorded digest is still source
+    std::optional<Digest> getAlternateDigest(const std::string& path, HashAlgorithm algorithm,
+                                             const Digest& source);
+    bool putAlternateDigest(const std::string& path, HashAlgorithm algorithm,
+                            const Digest& source, const Digest& digest);
+    
     // Chunk tracking for deduplication
     bool insertChunk(const std::string& file_path, int32_t index, 
-                     const std::string& hash, int64_t offset, int32_t size);
-    std::vector<std::string> getFileChunks(const std::string& file_path);
-    bool hasChunk(const std::string& hash);
+                     const Digest& hash, int64_t offset, int32_t size,
+                     HashAlgorithm algorithm = HashAlgorithm::SHA256,
+                     Codec codec = Codec::None);
+    std::vector<Digest> getFileChunks(const std::string& file_path);
+    bool hasChunk(const Digest& hash);
     
     // Sync state
     bool updateLastSyncTime(int64_t timestamp);
@@ -70,6 +83,8 @@ private:
     std::string db_path_;
     
     bool executeSQL(const std::string& sql);
+    bool migrateHexDigests(const char* table);
+    bool addColumnIfMissing(const char* table, const char* column, const char* definition);
     std::string getErrorMessage();
 };
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "core/metadata_db.h"
+#include "common/hash.h"
+#include "common/dictionary_store.h"
 #include <string>
 #include <vector>
 #include <mutex>
@@ -8,6 +10,8 @@
 
 namespace dropboxlite {
 
+class ThreadPool;
+
 class StorageManager {
 public:
     explicit StorageManager(const std::string& storage_root);
@@ -15,23 +19,66 @@ public:
     // Initialize storage
     bool initialize();
     
-    // Store file chunk
+    // Chunks are kept on disk as compression frames (codec and original
+    // size in a small header) and decoded on read. With compression off
+    // they are framed but stored as-is.
+    void setCompressionAtRest(bool enabled) { compress_at_rest_ = enabled; }
+    
+    // Run scrubbing on a pool; nullptr (the default) scrubs on the
+    // calling thread
+    void setThreadPool(ThreadPool* pool) { pool_ = pool; }
+    
+    // Store a client's compressed frame as received instead of
+    // recompressing the chunk
+    void setKeepClientFrames(bool enabled) { keep_client_frames_ = enabled; }
+    
+    // Store file chunk; codec records how the client sent it
     bool storeChunk(const std::string& client_id,
                    const std::string& filepath,
                    int32_t chunk_index,
                    const std::vector<uint8_t>& data,
-                   const std::string& hash);
+                   const Digest& hash,
+                   HashAlgorithm algorithm = HashAlgorithm::SHA256,
+                   Codec codec = Codec::None);
+    
+    // A chunk as received from a client, before its hash is checked.
+    // data is already decompressed; codec records how it was sent and, for
+    // compressed chunks, frame holds the payload exactly as received.
+    struct ChunkUpload {
+        int32_t index;
+        std::vector<uint8_t> data;
+        Digest hash;
+        HashAlgorithm algorithm = HashAlgorithm::SHA256;
+        Codec codec = Codec::None;
+        std::vector<uint8_t> frame;
+    };
+    
+    // Verify a group of uploaded chunks against their claimed hashes (hashed
+    // together in one batch per algorithm) and store them. Returns false if any chunk does
+    // not match its hash or cannot be stored.
+    bool storeChunks(const std::string& client_id,
+                     const std::string& filepath,
+                     const std::vector<ChunkUpload>& chunks);
     
-    // Retrieve file chunk
-    std::vector<uint8_t> getChunk(const std::string& hash);
+    // Retrieve file chunk, decompressed
+    std::vector<uint8_t> getChunk(const Digest& hash);
     
     // Check if chunk exists (deduplication)
-    bool hasChunk(const std::string& hash);
+    bool hasChunk(const Digest& hash);
     
-    // Finalize file after all chunks uploaded
+    // Finalize file after all chunks uploaded; the whole-file digest is
+    // computed with the client's algorithm
     bool finalizeFile(const std::string& client_id,
                      const std::string& filepath,
-                     int32_t total_chunks);
+                     int32_t total_chunks,
+                     HashAlgorithm algorithm = HashAlgorithm::SHA256);
+    
+    // Digest of a stored file under the given algorithm. Uses the recorded
+    // digest when it matches, otherwise re-hashes the stored file once and
+    // caches the result in the client's database.
+    std::optional<Digest> getFileDigest(const std::string& client_id,
+                                        const FileRecord& record,
+                                        HashAlgorithm algorithm);
     
     // Get file metadata
     std::optional<FileRecord> getFileMetadata(const std::string& client_id,
@@ -52,17 +99,50 @@ public:
     };
     StorageStats getStats() const;
     
+    // Train a compression dictionary from this client's small stored
+    // chunks, or only those of files with the given extension (without the
+    // dot). Returns the new dictionary's id.
+    std::optional<uint32_t> trainDictionary(const std::string& client_id,
+                                            const std::string& extension = "");
+    
+    // Newest dictionary for a file: its type's if trained, else its client's
+    std::shared_ptr<const CompressionDictionary> dictionaryFor(const std::string& client_id,
+                                                               const std::string& filepath) const;
+    
+    // Re-hash every stored chunk and return the ones whose content no
+    // longer matches the digest they are stored under (under any algorithm)
+    std::vector<Digest> scrubChunks();
+    
 private:
     std::string storage_root_;
+    DictionaryStore dictionaries_;
+    bool compress_at_rest_ = true;
+    bool keep_client_frames_ = true;
+    ThreadPool* pool_ = nullptr;
     std::unordered_map<std::string, std::unique_ptr<MetadataDB>> client_dbs_;
     mutable std::mutex db_mutex_;
     
-    std::string getChunkPath(const std::string& hash);
+    std::string getChunkPath(const Digest& hash);
     std::string getClientStoragePath(const std::string& client_id);
     std::string getTempFilePath(const std::string& client_id,
                                const std::string& filepath);
     
     MetadataDB* getClientDB(const std::string& client_id);
+    
+    // Write a chunk file unless one exists: client_frame as-is if given,
+    // else data compressed here
+    bool writeChunk(const std::string& client_id,
+                    const std::string& filepath,
+                    const Digest& hash,
+                    std::span<const uint8_t> data,
+                    std::span<const uint8_t> client_frame);
+    
+    // Frame chunks stored raw before compression at rest, once per store,
+    // so every chunk on disk is a frame and none is told apart by sniffing
+    bool migrateLegacyChunks();
+    
+    static std::string dictionaryScope(const std::string& client_id,
+                                       const std::string& extension);
 };
 
 } // namespace dropboxlite
@@ -2,9 +2,12 @@
 
 #include "server/storage_manager.h"
 #include "core/conflict_resolver.h"
+#include "common/bandwidth_scheduler.h"
 #include "sync.grpc.pb.h"
 #include <grpcpp/grpcpp.h>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace dropboxlite {
 
@@ -41,16 +44,51 @@ public:
                           const HeartbeatRequest* request,
                           HeartbeatResponse* response) override;
     
+    // Ingress (uploads) and egress (downloads) shaping; uncapped until
+    // configured
+    BandwidthScheduler& uploadBandwidth() { return upload_bandwidth_; }
+    BandwidthScheduler& downloadBandwidth() { return download_bandwidth_; }
+    
+    // Apply caps from a limits file, one setting per line (bytes per
+    // second, 0 for uncapped; '#' starts a comment):
+    //
+    //     upload <rate>                   global ingress cap
+    //     download <rate>                 global egress cap
+    //     client_upload <rate> [weight]   default per-client caps
+    //     client_download <rate> [weight]
+    //     client <id> upload|download <rate> [weight]
+    //
+    // Settings missing from the file revert to uncapped, so it can be
+    // edited and reloaded while running. On a malformed file nothing
+    // changes and false is returned.
+    bool loadBandwidthLimits(const std::string& path);
+    
+    // Pool for storage work (chunk scrubbing); see StorageManager
+    void setThreadPool(ThreadPool* pool) { storage_->setThreadPool(pool); }
+    
 private:
     std::unique_ptr<StorageManager> storage_;
     std::unique_ptr<ConflictResolver> conflict_resolver_;
+    BandwidthScheduler upload_bandwidth_;
+    BandwidthScheduler download_bandwidth_;
+    // Clients given their own limit by the last limits file
+    std::vector<std::string> limited_uploaders_;
+    std::vector<std::string> limited_downloaders_;
     
     // Helper methods
     std::vector<FileChange> computeChanges(const std::string& client_id,
                                           const std::vector<FileMetadata>& local_files,
                                           int64_t last_sync_time);
     
-    bool detectConflict(const FileMetadata& local, const FileRecord& server);
+    bool detectConflict(const std::string& client_id,
+                        const FileMetadata& local,
+                        const FileRecord& server);
+    
+    // Compare the client's digest with the server's, re-hashing the stored
+    // file when the two were computed with different algorithms
+    bool contentDiffers(const std::string& client_id,
+                        const FileMetadata& local,
+                        const FileRecord& server);
 };
 
 } // namespace dropboxlite
@@ -0,0 +1,433 @@
+#include "common/bandwidth_scheduler.h"
+#include "common/future.h"
+#include "common/metrics.h"
+#include "common/rate_limiter.h"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dropboxlite {
+
+namespace {
+
+// Service charged per byte to a weight-1 client or transfer
+constexpr uint64_t kStride = 1 << 16;
+
+uint64_t strideFor(size_t bytes, uint32_t weight) {
+    return static_cast<uint64_t>(bytes) * kStride / std::max<uint32_t>(1, weight);
+}
+
+template<typename T>
+void eraseFrom(std::vector<T*>& list, T* item) {
+    auto it = std::find(list.begin(), list.end(), item);
+    if (it != list.end()) {
+        *it = list.back();
+        list.pop_back();
+    }
+}
+
+} // namespace
+
+struct BandwidthScheduler::TransferNode {
+    struct Request {
+        size_t bytes;
+        InlineTask done;
+    };
+
+    TransferNode(ClientNode* client, uint32_t weight, size_t bytes_per_second)
+        : client(client), weight(std::max<uint32_t>(1, weight)), limit(bytes_per_second) {}
+
+    ClientNode* client;
+    uint32_t weight;
+    RateLimiter limit;
+    std::deque<Request> queue;
+    uint64_t pass = 0;
+    uint64_t bytes = 0;
+    bool closed = false;
+};
+
+struct BandwidthScheduler::ClientNode {
+    ClientNode(std::string id, size_t bytes_per_second, uint32_t weight)
+        : id(std::move(id)), weight(std::max<uint32_t>(1, weight)), limit(bytes_per_second) {}
+
+    std::string id;
+    uint32_t weight;
+    RateLimiter limit;
+    bool configured = false;  // Has its own limit rather than the default
+
+    std::vector<std::unique_ptr<TransferNode>> transfers;
+    std::vector<TransferNode*> active;  // Transfers with queued requests
+    uint64_t pass = 0;
+    uint64_t vtime = 0;  // Pass of the transfer served last
+    uint64_t bytes = 0;
+    size_t queued = 0;
+};
+
+struct BandwidthScheduler::State {
+    explicit State(size_t bytes_per_second) : global(bytes_per_second) {}
+
+    mutable std::mutex mutex;
+    RateLimiter global;
+    std::unordered_map<std::string, std::unique_ptr<ClientNode>> clients;
+    std::vector<ClientNode*> active;  // Clients with queued requests
+    uint64_t vtime = 0;               // Pass of the client served last
+    uint64_t bytes = 0;
+    size_t queued = 0;
+
+    size_t default_rate = 0;
+    uint32_t default_weight = 1;
+
+    TimerWheel* wheel = nullptr;
+    Clock::time_point wake_at = Clock::time_point::max();
+    std::weak_ptr<State> self;
+
+    ClientNode& client(const std::string& id) {
+        auto& node = clients[id];
+        if (!node) {
+            node = std::make_unique<ClientNode>(id, default_rate, default_weight);
+        }
+        return *node;
+    }
+
+    void enqueue(TransferNode* transfer, size_t bytes, InlineTask done) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ClientNode* owner = transfer->client;
+            // Newly active nodes start level with the others, not with
+            // credit saved up while idle
+            if (transfer->queue.empty()) {
+                transfer->pass = std::max(transfer->pass, owner->vtime);
+                owner->active.push_back(transfer);
+            }
+            if (owner->queued == 0) {
+                owner->pass = std::max(owner->pass, vtime);
+                active.push_back(owner);
+            }
+            transfer->queue.push_back({bytes, std::move(done)});
+            owner->queued++;
+            queued++;
+        }
+        pump();
+    }
+
+    // Grant whatever can go now; completions run outside the lock
+    void pump() {
+        std::vector<InlineTask> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            grant(Clock::now(), ready);
+        }
+        for (InlineTask& done : ready) {
+            done();
+        }
+    }
+
+    void grant(Clock::time_point now, std::vector<InlineTask>& ready) {
+        while (!active.empty()) {
+            Clock::time_point global_ready = global.nextAvailable();
+            if (global_ready > now) {
+                arm(global_ready);
+                return;
+            }
+
+            // Least-served client whose cap allows it, then its
+            // least-served transfer whose cap allows it
+            ClientNode* best = nullptr;
+            TransferNode* best_transfer = nullptr;
+            Clock::time_point held_until = Clock::time_point::max();
+            for (ClientNode* candidate : active) {
+                if (best && candidate->pass >= best->pass) {
+                    continue;
+                }
+                Clock::time_point client_ready = candidate->limit.nextAvailable();
+                if (client_ready > now) {
+                    held_until = std::min(held_until, client_ready);
+                    continue;
+                }
+                TransferNode* pick = nullptr;
+                for (TransferNode* transfer : candidate->active) {
+                    if (pick && transfer->pass >= pick->pass) {
+                        continue;
+                    }
+                    Clock::time_point transfer_ready = transfer->limit.nextAvailable();
+                    if (transfer_ready > now) {
+                        held_until = std::min(held_until, transfer_ready);
+                        continue;
+                    }
+                    pick = transfer;
+                }
+                if (pick) {
+                    best = candidate;
+                    best_transfer = pick;
+                }
+            }
+            if (!best) {
+                arm(held_until);
+                return;
+            }
+
+            TransferNode::Request request = std::move(best_transfer->queue.front());
+            best_transfer->queue.pop_front();
+            global.reserve(request.bytes);
+            best->limit.reserve(request.bytes);
+            best_transfer->limit.reserve(request.bytes);
+
+            vtime = best->pass;
+            best->pass += strideFor(request.bytes, best->weight);
+            best->vtime = best_transfer->pass;
+            best_transfer->pass += strideFor(request.bytes, best_transfer->weight);
+
+            bytes += request.bytes;
+            best->bytes += request.bytes;
+            best_transfer->bytes += request.bytes;
+            queued--;
+            best->queued--;
+            ready.push_back(std::move(request.done));
+
+            bool drained = best_transfer->queue.empty();
+            if (drained) {
+                eraseFrom(best->active, best_transfer);
+            }
+            if (best->queued == 0) {
+                eraseFrom(active, best);
+            }
+            // Either may free best
+            if (drained && best_transfer->closed) {
+                removeTransfer(best_transfer);
+            } else if (best->queued == 0) {
+                removeClientIfUnused(best);
+            }
+        }
+    }
+
+    // Pump again at time, unless an earlier wakeup is already due
+    void arm(Clock::time_point time) {
+        if (time == Clock::time_point::max() || time >= wake_at) {
+            return;
+        }
+        wake_at = time;
+        (wheel ? *wheel : TimerWheel::shared()).schedule(time, [weak = self] {
+            if (auto state = weak.lock()) {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->wake_at = Clock::time_point::max();
+                }
+                state->pump();
+            }
+        });
+    }
+
+    void removeTransfer(TransferNode* transfer) {
+        ClientNode* owner = transfer->client;
+        auto it = std::find_if(owner->transfers.begin(), owner->transfers.end(),
+                               [transfer](const auto& node) { return node.get() == transfer; });
+        if (it != owner->transfers.end()) {
+            owner->transfers.erase(it);
+        }
+        removeClientIfUnused(owner);
+    }
+
+    void removeClientIfUnused(ClientNode* owner) {
+        if (owner->transfers.empty() && owner->queued == 0 && !owner->configured) {
+            clients.erase(owner->id);
+        }
+    }
+};
+
+BandwidthScheduler::BandwidthScheduler(size_t bytes_per_second)
+    : state_(std::make_shared<State>(bytes_per_second)) {
+    state_->self = state_;
+}
+
+BandwidthScheduler::~BandwidthScheduler() = default;
+
+BandwidthScheduler::Transfer BandwidthScheduler::open(const std::string& client_id, uint32_t weight,
+                                                      size_t bytes_per_second) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    ClientNode& owner = state_->client(client_id);
+    owner.transfers.push_back(std::make_unique<TransferNode>(&owner, weight, bytes_per_second));
+    return Transfer(state_, owner.transfers.back().get());
+}
+
+void BandwidthScheduler::setGlobalRate(size_t bytes_per_second) {
+    state_->global.setRate(bytes_per_second);
+    state_->pump();
+}
+
+size_t BandwidthScheduler::globalRate() const {
+    return state_->global.getRate();
+}
+
+void BandwidthScheduler::setClientLimit(const std::string& client_id, size_t bytes_per_second,
+                                        uint32_t weight) {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        ClientNode& owner = state_->client(client_id);
+        owner.configured = true;
+        owner.limit.setRate(bytes_per_second);
+        owner.weight = std::max<uint32_t>(1, weight);
+    }
+    state_->pump();
+}
+
+void BandwidthScheduler::clearClientLimit(const std::string& client_id) {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        auto it = state_->clients.find(client_id);
+        if (it == state_->clients.end()) {
+            return;
+        }
+        ClientNode& owner = *it->second;
+        owner.configured = false;
+        owner.limit.setRate(state_->default_rate);
+        owner.weight = state_->default_weight;
+        state_->removeClientIfUnused(&owner);
+    }
+    state_->pump();
+}
+
+void BandwidthScheduler::setDefaultClientLimit(size_t bytes_per_second, uint32_t weight) {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->default_rate = bytes_per_second;
+        state_->default_weight = std::max<uint32_t>(1, weight);
+        for (auto& [id, owner] : state_->clients) {
+            if (!owner->configured) {
+                owner->limit.setRate(state_->default_rate);
+                owner->weight = state_->default_weight;
+            }
+        }
+    }
+    state_->pump();
+}
+
+std::optional<BandwidthScheduler::ClientStats>
+BandwidthScheduler::clientStats(const std::string& client_id) const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    auto it = state_->clients.find(client_id);
+    if (it == state_->clients.end()) {
+        return std::nullopt;
+    }
+    const ClientNode& owner = *it->second;
+    return ClientStats{owner.limit.getRate(), owner.weight, owner.bytes, owner.queued,
+                       owner.transfers.size()};
+}
+
+void BandwidthScheduler::setTimerWheel(TimerWheel* wheel) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->wheel = wheel;
+}
+
+void BandwidthScheduler::publishMetrics(const std::string& prefix) const {
+    // Copied out first so Metrics is not called under the scheduler lock
+    int64_t rate_limit, bytes, queued, clients;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        rate_limit = state_->global.getRate();
+        bytes = state_->bytes;
+        queued = state_->queued;
+        clients = state_->clients.size();
+    }
+    auto& metrics = Metrics::instance();
+    metrics.setGauge(prefix + ".rate_limit", rate_limit);
+    metrics.setGauge(prefix + ".bytes", bytes);
+    metrics.setGauge(prefix + ".queued", queued);
+    metrics.setGauge(prefix + ".clients", clients);
+}
+
+void BandwidthScheduler::writeOpenMetrics(std::string& out, const std::string& prefix) const {
+    using namespace openmetrics;
+    struct Family {
+        const char* name;    // Appended to prefix
+        const char* sample;  // Counters' samples end in _total
+        const char* type;
+        int64_t (*value)(const ClientNode&);
+    };
+    static constexpr Family kFamilies[] = {
+        {"_client_rate_limit", "_client_rate_limit", "gauge",
+         [](const ClientNode& c) { return static_cast<int64_t>(c.limit.getRate()); }},
+        {"_client_weight", "_client_weight", "gauge",
+         [](const ClientNode& c) { return static_cast<int64_t>(c.weight); }},
+        {"_client_queued", "_client_queued", "gauge",
+         [](const ClientNode& c) { return static_cast<int64_t>(c.queued); }},
+        {"_client_transfers", "_client_transfers", "gauge",
+         [](const ClientNode& c) { return static_cast<int64_t>(c.transfers.size()); }},
+        {"_client_bytes", "_client_bytes_total", "counter",
+         [](const ClientNode& c) { return static_cast<int64_t>(c.bytes); }},
+    };
+
+    // Plain appends, so rendering under the lock holds up grants only
+    // briefly
+    std::string labels;
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    for (const Family& family : kFamilies) {
+        appendFamily(out, prefix, family.name, family.type);
+        for (const auto& [id, owner] : state_->clients) {
+            labels.clear();
+            appendLabel(labels, "client", id);
+            appendSample(out, prefix, family.sample, labels, family.value(*owner));
+        }
+    }
+}
+
+BandwidthScheduler::Transfer::Transfer(Transfer&& other) noexcept
+    : state_(std::move(other.state_)), node_(std::exchange(other.node_, nullptr)) {}
+
+BandwidthScheduler::Transfer& BandwidthScheduler::Transfer::operator=(Transfer&& other) noexcept {
+    if (this != &other) {
+        close();
+        state_ = std::move(other.state_);
+        node_ = std::exchange(other.node_, nullptr);
+    }
+    return *this;
+}
+
+BandwidthScheduler::Transfer::~Transfer() {
+    close();
+}
+
+void BandwidthScheduler::Transfer::close() {
+    if (!node_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    node_->closed = true;
+    if (node_->queue.empty()) {
+        state_->removeTransfer(node_);
+    }
+    node_ = nullptr;
+}
+
+void BandwidthScheduler::Transfer::acquire(size_t bytes) {
+    Promise<void> promise;
+    Future<void> granted = promise.getFuture();
+    acquireAsync(bytes, [promise = std::move(promise)]() mutable { promise.setValue(); });
+    granted.wait();
+}
+
+void BandwidthScheduler::Transfer::acquireAsync(size_t bytes, InlineTask done) {
+    state_->enqueue(node_, bytes, std::move(done));
+}
+
+void BandwidthScheduler::Transfer::setWeight(uint32_t weight) {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        node_->weight = std::max<uint32_t>(1, weight);
+    }
+    state_->pump();
+}
+
+void BandwidthScheduler::Transfer::setRate(size_t bytes_per_second) {
+    node_->limit.setRate(bytes_per_second);
+    state_->pump();
+}
+
+uint64_t BandwidthScheduler::Transfer::bytes() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return node_->bytes;
+}
+
+} // namespace dropboxlite
@@ -0,0 +1,599 @@
+#include "common/hash.h"
+#include "common/thread_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DROPBOXLITE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace dropboxlite {
+
+namespace {
+
+constexpr uint32_t kIV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+constexpr size_t kBlockLen = 64;
+constexpr size_t kChunkLen = 1024;
+constexpr size_t kBlocksPerChunk = kChunkLen / kBlockLen;
+constexpr size_t kMaxTreeDepth = 54; // 2^54 chunks of 1 KiB = 2^64 bytes
+
+enum : uint8_t {
+    kChunkStart = 1 << 0,
+    kChunkEnd = 1 << 1,
+    kParent = 1 << 2,
+    kRoot = 1 << 3
+};
+
+// Message word order for each of the seven rounds (the permutation applied
+// round by round)
+constexpr uint8_t kSchedule[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+uint32_t loadLittleEndian(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+void storeLittleEndian(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+    p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+void g(uint32_t* v, int a, int b, int c, int d, uint32_t mx, uint32_t my) {
+    v[a] = v[a] + v[b] + mx;
+    v[d] = rotr(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = rotr(v[b] ^ v[c], 12);
+    v[a] = v[a] + v[b] + my;
+    v[d] = rotr(v[d] ^ v[a], 8);
+    v[c] = v[c] + v[d];
+    v[b] = rotr(v[b] ^ v[c], 7);
+}
+
+// Full 16-word compression output; the first 8 words are the chaining value
+void compress(const uint32_t cv[8], const uint8_t block[kBlockLen], uint8_t block_len,
+              uint64_t counter, uint8_t flags, uint32_t out[16]) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = loadLittleEndian(block + 4 * i);
+    }
+
+    uint32_t v[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        kIV[0], kIV[1], kIV[2], kIV[3],
+        static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+        block_len, flags
+    };
+
+    for (const auto& s : kSchedule) {
+        g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+        g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+        g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+        g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+        g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+        g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+        g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        out[i] = v[i] ^ v[i + 8];
+        out[i + 8] = v[i + 8] ^ cv[i];
+    }
+}
+
+void compressChainingValue(uint32_t cv[8], const uint8_t block[kBlockLen], uint8_t block_len,
+                           uint64_t counter, uint8_t flags) {
+    uint32_t out[16];
+    compress(cv, block, block_len, counter, flags, out);
+    std::memcpy(cv, out, 8 * sizeof(uint32_t));
+}
+
+// Hashes num_inputs equal-length inputs of `blocks` full blocks each, writing
+// one 32-byte chaining value per input to out. Chunk counters start at
+// counter and advance per input when increment_counter is set.
+using HashManyFn = void (*)(const uint8_t* const* inputs, size_t num_inputs, size_t blocks,
+                            uint64_t counter, bool increment_counter, uint8_t flags,
+                            uint8_t flags_start, uint8_t flags_end, uint8_t* out);
+
+void hashManyPortable(const uint8_t* const* inputs, size_t num_inputs, size_t blocks,
+                      uint64_t counter, bool increment_counter, uint8_t flags,
+                      uint8_t flags_start, uint8_t flags_end, uint8_t* out) {
+    for (size_t i = 0; i < num_inputs; i++) {
+        uint32_t cv[8];
+        std::memcpy(cv, kIV, sizeof(cv));
+
+        for (size_t b = 0; b < blocks; b++) {
+            uint8_t block_flags = flags;
+            if (b == 0) block_flags |= flags_start;
+            if (b + 1 == blocks) block_flags |= flags_end;
+            compressChainingValue(cv, inputs[i] + b * kBlockLen, kBlockLen, counter, block_flags);
+        }
+
+        for (int w = 0; w < 8; w++) {
+            storeLittleEndian(out + 32 * i + 4 * w, cv[w]);
+        }
+        if (increment_counter) {
+            counter++;
+        }
+    }
+}
+
+#ifdef DROPBOXLITE_X86
+
+#define BLAKE3_AVX2 __attribute__((target("avx2"), always_inline)) inline
+
+BLAKE3_AVX2 __m256i rotr16(__m256i x) {
+    const __m256i mask = _mm256_setr_epi8(
+        2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+        2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    return _mm256_shuffle_epi8(x, mask);
+}
+
+BLAKE3_AVX2 __m256i rotr8(__m256i x) {
+    const __m256i mask = _mm256_setr_epi8(
+        1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+        1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+    return _mm256_shuffle_epi8(x, mask);
+}
+
+template<int N>
+BLAKE3_AVX2 __m256i rotr(__m256i x) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N));
+}
+
+BLAKE3_AVX2 void g8(__m256i* v, int a, int b, int c, int d, __m256i mx, __m256i my) {
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), mx);
+    v[d] = rotr16(_mm256_xor_si256(v[d], v[a]));
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = rotr<12>(_mm256_xor_si256(v[b], v[c]));
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), my);
+    v[d] = rotr8(_mm256_xor_si256(v[d], v[a]));
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = rotr<7>(_mm256_xor_si256(v[b], v[c]));
+}
+
+// 8x8 transpose of 32-bit words: row i of the output holds word i of every
+// input row
+BLAKE3_AVX2 void transpose8(__m256i* rows) {
+    __m256i t0 = _mm256_unpacklo_epi32(rows[0], rows[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(rows[0], rows[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(rows[2], rows[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(rows[2], rows[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(rows[4], rows[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(rows[4], rows[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(rows[6], rows[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(rows[6], rows[7]);
+
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    rows[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    rows[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    rows[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    rows[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    rows[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    rows[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    rows[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    rows[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+// Eight inputs at once, one per 32-bit lane
+__attribute__((target("avx2")))
+void hash8Avx2(const uint8_t* const* inputs, size_t blocks, uint64_t counter,
+               bool increment_counter, uint8_t flags, uint8_t flags_start,
+               uint8_t flags_end, uint8_t* out) {
+    __m256i h[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm256_set1_epi32(static_cast<int>(kIV[i]));
+    }
+
+    alignas(32) uint32_t counter_lo[8];
+    alignas(32) uint32_t counter_hi[8];
+    for (int l = 0; l < 8; l++) {
+        uint64_t c = counter + (increment_counter ? l : 0);
+        counter_lo[l] = static_cast<uint32_t>(c);
+        counter_hi[l] = static_cast<uint32_t>(c >> 32);
+    }
+    __m256i lo = _mm256_load_si256(reinterpret_cast<const __m256i*>(counter_lo));
+    __m256i hi = _mm256_load_si256(reinterpret_cast<const __m256i*>(counter_hi));
+
+    for (size_t b = 0; b < blocks; b++) {
+        uint8_t block_flags = flags;
+        if (b == 0) block_flags |= flags_start;
+        if (b + 1 == blocks) block_flags |= flags_end;
+
+        __m256i m[16];
+        for (int l = 0; l < 8; l++) {
+            const uint8_t* block = inputs[l] + b * kBlockLen;
+            m[l] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+            m[l + 8] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+        }
+        transpose8(m);
+        transpose8(m + 8);
+
+        __m256i v[16] = {
+            h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+            _mm256_set1_epi32(static_cast<int>(kIV[0])), _mm256_set1_epi32(static_cast<int>(kIV[1])),
+            _mm256_set1_epi32(static_cast<int>(kIV[2])), _mm256_set1_epi32(static_cast<int>(kIV[3])),
+            lo, hi, _mm256_set1_epi32(kBlockLen), _mm256_set1_epi32(block_flags)
+        };
+
+        for (const auto& s : kSchedule) {
+            g8(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+            g8(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+            g8(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+            g8(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+            g8(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+            g8(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            g8(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+            g8(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+
+        for (int i = 0; i < 8; i++) {
+            h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+        }
+    }
+
+    transpose8(h);
+    for (int l = 0; l < 8; l++) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32 * l), h[l]);
+    }
+}
+
+void hashManyAvx2(const uint8_t* const* inputs, size_t num_inputs, size_t blocks,
+                  uint64_t counter, bool increment_counter, uint8_t flags,
+                  uint8_t flags_start, uint8_t flags_end, uint8_t* out) {
+    while (num_inputs >= 8) {
+        hash8Avx2(inputs, blocks, counter, increment_counter, flags, flags_start, flags_end, out);
+        inputs += 8;
+        num_inputs -= 8;
+        out += 8 * 32;
+        if (increment_counter) {
+            counter += 8;
+        }
+    }
+    hashManyPortable(inputs, num_inputs, blocks, counter, increment_counter,
+                     flags, flags_start, flags_end, out);
+}
+
+#undef BLAKE3_AVX2
+
+#endif // DROPBOXLITE_X86
+
+HashManyFn detectHashMany() {
+#ifdef DROPBOXLITE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return hashManyAvx2;
+    }
+#endif
+    return hashManyPortable;
+}
+
+HashManyFn hashMany() {
+    static const HashManyFn kHashMany = detectHashMany();
+    return kHashMany;
+}
+
+// Chaining values of full chunks, kHashManyLanes at a time
+constexpr size_t kHashManyLanes = 8;
+
+void hashChunks(const uint8_t* data, size_t count, uint64_t first_chunk, uint8_t* out) {
+    const uint8_t* inputs[kHashManyLanes];
+    for (size_t i = 0; i < count; i += kHashManyLanes) {
+        size_t n = std::min(kHashManyLanes, count - i);
+        for (size_t j = 0; j < n; j++) {
+            inputs[j] = data + (i + j) * kChunkLen;
+        }
+        hashMany()(inputs, n, kBlocksPerChunk, first_chunk + i, true,
+                   0, kChunkStart, kChunkEnd, out + 32 * i);
+    }
+}
+
+// Parents of adjacent chaining-value pairs in cvs, kHashManyLanes at a time
+void hashParents(const uint8_t* cvs, size_t pairs, uint8_t* out) {
+    const uint8_t* inputs[kHashManyLanes];
+    for (size_t i = 0; i < pairs; i += kHashManyLanes) {
+        size_t n = std::min(kHashManyLanes, pairs - i);
+        for (size_t j = 0; j < n; j++) {
+            inputs[j] = cvs + 64 * (i + j);
+        }
+        hashMany()(inputs, n, 1, 0, false, kParent, 0, 0, out + 32 * i);
+    }
+}
+
+// First output block of the root node; its counter is the output block
+// index, not the chunk index
+Digest rootDigest(const uint32_t cv[8], const uint8_t block[kBlockLen], uint8_t block_len,
+                  uint8_t flags) {
+    uint32_t out[16];
+    compress(cv, block, block_len, 0, flags | kRoot, out);
+
+    Digest digest;
+    for (int i = 0; i < 8; i++) {
+        storeLittleEndian(digest.data() + 4 * i, out[i]);
+    }
+    return digest;
+}
+
+} // namespace
+
+// Chunk being filled plus the stack of completed subtree chaining values:
+// entry i covers 2^k chunks, with k decreasing up the stack
+struct Hash::Blake3Stream::State {
+    uint32_t cv_stack[kMaxTreeDepth + 1][8];
+    size_t stack_len = 0;
+
+    uint32_t chunk_cv[8];
+    uint64_t chunk_counter = 0;
+    uint8_t block[kBlockLen];
+    size_t block_len = 0;
+    size_t blocks_compressed = 0;
+
+    size_t chunkLength() const { return blocks_compressed * kBlockLen + block_len; }
+
+    void resetChunk(uint64_t counter) {
+        std::memcpy(chunk_cv, kIV, sizeof(chunk_cv));
+        chunk_counter = counter;
+        block_len = 0;
+        blocks_compressed = 0;
+    }
+
+    uint8_t chunkStartFlag() const { return blocks_compressed == 0 ? kChunkStart : 0; }
+
+    void updateChunk(const uint8_t* data, size_t size) {
+        while (size > 0) {
+            // A full buffered block is only compressed once more input arrives,
+            // since the chunk's last block needs the CHUNK_END flag
+            if (block_len == kBlockLen) {
+                compressChainingValue(chunk_cv, block, kBlockLen, chunk_counter, chunkStartFlag());
+                blocks_compressed++;
+                block_len = 0;
+            }
+            size_t take = std::min(kBlockLen - block_len, size);
+            std::memcpy(block + block_len, data, take);
+            block_len += take;
+            data += take;
+            size -= take;
+        }
+    }
+
+    void finishChunk(uint32_t cv[8]) const {
+        uint8_t padded[kBlockLen] = {};
+        std::memcpy(padded, block, block_len);
+        std::memcpy(cv, chunk_cv, 8 * sizeof(uint32_t));
+        compressChainingValue(cv, padded, static_cast<uint8_t>(block_len), chunk_counter,
+                              chunkStartFlag() | kChunkEnd);
+    }
+
+    // total_chunks counts this chunk; each trailing zero bit completes a subtree
+    void pushChunk(const uint32_t chunk[8], uint64_t total_chunks) {
+        uint32_t cv[8];
+        std::memcpy(cv, chunk, sizeof(cv));
+        while ((total_chunks & 1) == 0) {
+            uint8_t parent[kBlockLen];
+            stack_len--;
+            for (int i = 0; i < 8; i++) {
+                storeLittleEndian(parent + 4 * i, cv_stack[stack_len][i]);
+                storeLittleEndian(parent + 32 + 4 * i, cv[i]);
+            }
+            std::memcpy(cv, kIV, sizeof(cv));
+            compressChainingValue(cv, parent, kBlockLen, 0, kParent);
+            total_chunks >>= 1;
+        }
+        std::memcpy(cv_stack[stack_len++], cv, sizeof(cv));
+    }
+};
+
+Hash::Blake3Stream::Blake3Stream() : state_(std::make_unique<State>()) {
+    state_->resetChunk(0);
+}
+
+Hash::Blake3Stream::~Blake3Stream() = default;
+
+void Hash::Blake3Stream::update(std::span<const uint8_t> data) {
+    State& s = *state_;
+
+    while (!data.empty()) {
+        if (s.chunkLength() == kChunkLen) {
+            uint32_t cv[8];
+            s.finishChunk(cv);
+            s.pushChunk(cv, s.chunk_counter + 1);
+            s.resetChunk(s.chunk_counter + 1);
+        }
+
+        // Whole chunks that are certainly not the last go through the SIMD
+        // kernel kHashManyLanes at a time
+        if (s.chunkLength() == 0 && data.size() > kHashManyLanes * kChunkLen) {
+            uint8_t cvs[kHashManyLanes * 32];
+            hashChunks(data.data(), kHashManyLanes, s.chunk_counter, cvs);
+            for (size_t i = 0; i < kHashManyLanes; i++) {
+                uint32_t cv[8];
+                for (int w = 0; w < 8; w++) {
+                    cv[w] = loadLittleEndian(cvs + 32 * i + 4 * w);
+                }
+                s.pushChunk(cv, s.chunk_counter + i + 1);
+            }
+            s.resetChunk(s.chunk_counter + kHashManyLanes);
+            data = data.subspan(kHashManyLanes * kChunkLen);
+            continue;
+        }
+
+        size_t take = std::min(kChunkLen - s.chunkLength(), data.size());
+        s.updateChunk(data.data(), take);
+        data = data.subspan(take);
+    }
+}
+
+Digest Hash::Blake3Stream::finish() {
+    State& s = *state_;
+
+    // The root is the chunk itself when there is only one, otherwise the
+    // parent that folds the stack down onto the current chunk
+    uint8_t block[kBlockLen] = {};
+    uint32_t cv[8];
+    uint8_t block_len;
+    uint8_t flags;
+
+    if (s.stack_len == 0) {
+        std::memcpy(block, s.block, s.block_len);
+        std::memcpy(cv, s.chunk_cv, sizeof(cv));
+        block_len = static_cast<uint8_t>(s.block_len);
+        flags = s.chunkStartFlag() | kChunkEnd;
+    } else {
+        uint32_t right[8];
+        s.finishChunk(right);
+        for (size_t i = s.stack_len; i-- > 0;) {
+            for (int w = 0; w < 8; w++) {
+                storeLittleEndian(block + 4 * w, s.cv_stack[i][w]);
+                storeLittleEndian(block + 32 + 4 * w, right[w]);
+            }
+            if (i > 0) {
+                std::memcpy(right, kIV, sizeof(right));
+                compressChainingValue(right, block, kBlockLen, 0, kParent);
+            }
+        }
+        std::memcpy(cv, kIV, sizeof(cv));
+        block_len = kBlockLen;
+        flags = kParent;
+    }
+
+    Digest digest = rootDigest(cv, block, block_len, flags);
+
+    s.stack_len = 0;
+    s.resetChunk(0);
+    return digest;
+}
+
+namespace {
+
+// Chaining values of every chunk in data (the last may be partial), the
+// first being chunk number first_chunk of the whole input. Returns the count.
+size_t leafChainingValues(std::span<const uint8_t> data, uint64_t first_chunk,
+                          std::vector<uint8_t>& cvs) {
+    size_t full_chunks = data.size() / kChunkLen;
+    size_t tail = data.size() % kChunkLen;
+    size_t count = full_chunks + (tail > 0 ? 1 : 0);
+
+    cvs.resize(32 * count);
+    hashChunks(data.data(), full_chunks, first_chunk, cvs.data());
+
+    if (tail > 0) {
+        Hash::Blake3Stream::State last;
+        last.resetChunk(first_chunk + full_chunks);
+        last.updateChunk(data.data() + full_chunks * kChunkLen, tail);
+        uint32_t cv[8];
+        last.finishChunk(cv);
+        for (int w = 0; w < 8; w++) {
+            storeLittleEndian(cvs.data() + 32 * full_chunks + 4 * w, cv[w]);
+        }
+    }
+    return count;
+}
+
+// Reduce up to max_levels tree levels, stopping once min_count nodes remain.
+// Pairing neighbours level by level and carrying an odd one up yields
+// BLAKE3's left-balanced tree.
+size_t reduceLevels(std::vector<uint8_t>& cvs, size_t count, size_t max_levels, size_t min_count) {
+    std::vector<uint8_t> next(32 * ((count + 1) / 2));
+    for (size_t level = 0; level < max_levels && count > min_count; level++) {
+        size_t pairs = count / 2;
+        hashParents(cvs.data(), pairs, next.data());
+        if (count % 2 == 1) {
+            std::memcpy(next.data() + 32 * pairs, cvs.data() + 32 * (count - 1), 32);
+        }
+        count = (count + 1) / 2;
+        std::swap(cvs, next);
+    }
+    return count;
+}
+
+Digest rootOfPair(const uint8_t* cvs) {
+    uint32_t iv[8];
+    std::memcpy(iv, kIV, sizeof(iv));
+    return rootDigest(iv, cvs, kBlockLen, kParent);
+}
+
+} // namespace
+
+Digest Hash::blake3(std::span<const uint8_t> data) {
+    if (data.size() <= kChunkLen) {
+        Blake3Stream stream;
+        stream.update(data);
+        return stream.finish();
+    }
+
+    // Every chunk is a leaf; all full chunks are hashed side by side, then
+    // each tree level is reduced pairwise
+    std::vector<uint8_t> cvs;
+    size_t count = leafChainingValues(data, 0, cvs);
+    reduceLevels(cvs, count, SIZE_MAX, 2);
+    return rootOfPair(cvs.data());
+}
+
+Digest Hash::blake3(std::span<const uint8_t> data, ThreadPool* pool) {
+    constexpr size_t kMinSegmentLevels = 10; // 1 MiB subtrees
+    constexpr size_t kSegmentsPerThread = 4;
+
+    if (!pool || pool->size() < 2 || data.size() < (kChunkLen << (kMinSegmentLevels + 1))) {
+        return blake3(data);
+    }
+
+    // Segments are aligned power-of-two runs of chunks, so each one is a
+    // complete subtree (the last possibly ragged) and reduces to a single
+    // chaining value independently of the others
+    size_t chunks = (data.size() + kChunkLen - 1) / kChunkLen;
+    size_t levels = kMinSegmentLevels;
+    while ((size_t{1} << levels) * pool->size() * kSegmentsPerThread < chunks) {
+        levels++;
+    }
+    size_t segment_bytes = kChunkLen << levels;
+    size_t segments = (data.size() + segment_bytes - 1) / segment_bytes;
+
+    std::vector<uint8_t> cvs(32 * segments);
+    std::vector<Future<void>> pending;
+    pending.reserve(segments);
+    for (size_t i = 0; i < segments; i++) {
+        pending.push_back(pool->submit([&, i] {
+            size_t offset = i * segment_bytes;
+            auto segment = data.subspan(offset, std::min(segment_bytes, data.size() - offset));
+            std::vector<uint8_t> local;
+            size_t count = leafChainingValues(segment, offset / kChunkLen, local);
+            reduceLevels(local, count, levels, 1);
+            std::memcpy(cvs.data() + 32 * i, local.data(), 32);
+        }));
+    }
+    for (auto& done : pending) {
+        done.get();
+    }
+
+    reduceLevels(cvs, segments, SIZE_MAX, 2);
+    return rootOfPair(cvs.data());
+}
+
+} // namespace dropboxlite
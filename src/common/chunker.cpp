@@ -1,110 +1,359 @@
 #include "common/chunker.h"
 #include "common/hash.h"
+#include "common/mapped_file.h"
+#include "common/thread_pool.h"
+#include "common/parallel.h"
 #include <fstream>
 #include <algorithm>
+#include <cstring>
 
 namespace dropboxlite {
 
 std::vector<ChunkInfo> Chunker::chunkFile(const std::string& filepath) {
+    std::vector<ChunkInfo> chunks;
+    
+    bool ok = chunkFile(filepath, [&chunks](const ChunkInfo& chunk, const uint8_t*) {
+        chunks.push_back(chunk);
+    });
+    
+    if (!ok) {
+        return {};
+    }
+    return chunks;
+}
+
+bool Chunker::chunkFile(const std::string& filepath, const ChunkCallback& callback) {
+    if (file_input_ == FileInput::Mapped) {
+        MappedFile mapped;
+        if (mapped.open(filepath)) {
+            chunkSpan(mapped.span(), callback);
+            return true;
+        }
+        // Fall back to streaming for inputs that cannot be mapped
+    }
+    
     std::ifstream file(filepath, std::ios::binary);
     if (!file) {
-        return {};
+        return false;
+    }
+    
+    return chunkStream(file, callback);
+}
+
+std::optional<FileFingerprint> Chunker::fingerprintFile(const std::string& filepath) {
+    FileFingerprint fingerprint;
+    fingerprint.size = 0;
+    
+    auto file_hash = fingerprintFile(filepath, [&](const ChunkInfo& chunk, const uint8_t*) {
+        fingerprint.chunks.push_back(chunk);
+        fingerprint.size += chunk.size;
+    });
+    
+    if (!file_hash) {
+        return std::nullopt;
+    }
+    fingerprint.file_hash = *file_hash;
+    return fingerprint;
+}
+
+std::optional<Digest> Chunker::fingerprintFile(const std::string& filepath,
+                                               const ChunkCallback& callback) {
+    // Chunks arrive in file order, so the whole-file digest can be
+    // accumulated from the same bytes the chunk digests were computed over
+    Hash::Stream file_hash(hash_algorithm_);
+    
+    bool ok = chunkFile(filepath, [&](const ChunkInfo& chunk, const uint8_t* data) {
+        file_hash.update(std::span<const uint8_t>(data, chunk.size));
+        callback(chunk, data);
+    });
+    
+    if (!ok) {
+        return std::nullopt;
+    }
+    return file_hash.finish();
+}
+
+bool Chunker::chunkStream(std::istream& input, const ChunkCallback& callback) {
+    std::vector<uint8_t> window(kStreamWindowSize);
+    size_t begin = 0;   // First unconsumed byte in window
+    size_t end = 0;     // One past the last valid byte in window
+    size_t offset = 0;  // Stream offset of window[begin]
+    bool eof = false;
+    std::vector<ChunkInfo> pending;
+    
+    resetStats();
+    
+    while (!eof) {
+        // Slide the undecided tail (< kMaxChunkSize) to the front and refill
+        if (begin > 0) {
+            std::memmove(window.data(), window.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        
+        input.read(reinterpret_cast<char*>(window.data() + end), window.size() - end);
+        end += input.gcount();
+        
+        if (!input) {
+            if (input.bad()) {
+                return false;
+            }
+            eof = true;
+        }
+        
+        // A boundary is final once kMaxChunkSize bytes are visible (or at EOF).
+        // Chunks found in this pass stay in the window until the next slide,
+        // so they are hashed together as a batch.
+        const uint8_t* pass_base = window.data() + begin;
+        size_t pass_offset = offset;
+        pending.clear();
+        
+        while (begin < end && (eof || end - begin >= kMaxChunkSize)) {
+            size_t size = findBoundary(window.data() + begin, end - begin);
+            pending.push_back({offset, size, Digest{}});
+            
+            begin += size;
+            offset += size;
+            
+            if (pending.size() == kHashBatchSize) {
+                emitChunks(pending, pass_base, pass_offset, callback);
+                pending.clear();
+            }
+        }
+        emitChunks(pending, pass_base, pass_offset, callback);
     }
     
-    // Read entire file
-    file.seekg(0, std::ios::end);
-    size_t file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    return true;
+}
+
+void Chunker::chunkSpan(std::span<const uint8_t> data, const ChunkCallback& callback) {
+    if (pool_ && data.size() >= 2 * kMinSegmentSize) {
+        chunkSpanParallel(data, callback);
+        return;
+    }
     
-    std::vector<uint8_t> data(file_size);
-    file.read(reinterpret_cast<char*>(data.data()), file_size);
+    resetStats();
     
-    return chunkData(data);
+    std::vector<ChunkInfo> pending;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t size = findBoundary(data.data() + offset, data.size() - offset);
+        pending.push_back({offset, size, Digest{}});
+        offset += size;
+        
+        if (pending.size() == kHashBatchSize) {
+            emitChunks(pending, data.data(), 0, callback);
+            pending.clear();
+        }
+    }
+    emitChunks(pending, data.data(), 0, callback);
+}
+
+void Chunker::hashChunks(std::span<ChunkInfo> chunks, const uint8_t* base,
+                         size_t base_offset) const {
+    std::vector<std::span<const uint8_t>> inputs;
+    inputs.reserve(chunks.size());
+    for (const auto& chunk : chunks) {
+        inputs.emplace_back(base + (chunk.offset - base_offset), chunk.size);
+    }
+    
+    std::vector<Digest> digests(chunks.size());
+    Hash::digestBatch(hash_algorithm_, inputs, digests);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        chunks[i].hash = digests[i];
+    }
+}
+
+void Chunker::emitChunks(std::span<ChunkInfo> chunks, const uint8_t* base, size_t base_offset,
+                         const ChunkCallback& callback) {
+    hashChunks(chunks, base, base_offset);
+    for (const auto& chunk : chunks) {
+        callback(chunk, base + (chunk.offset - base_offset));
+        recordStats(chunk.size);
+    }
 }
 
 std::vector<ChunkInfo> Chunker::chunkData(const std::vector<uint8_t>& data) {
     std::vector<ChunkInfo> chunks;
     
-    if (data.empty()) {
-        last_stats_ = {0, 0, 0, 0.0};
-        return chunks;
+    chunkSpan(data, [&chunks](const ChunkInfo& chunk, const uint8_t*) {
+        chunks.push_back(chunk);
+    });
+    
+    return chunks;
+}
+
+std::vector<size_t> Chunker::scanCuts(std::span<const uint8_t> data,
+                                      size_t begin, size_t end) const {
+    // Chunk starts reachable from begin, plus the first start at or past end
+    std::vector<size_t> cuts;
+    size_t pos = begin;
+    while (pos < end) {
+        cuts.push_back(pos);
+        pos += findBoundary(data.data() + pos, data.size() - pos);
+    }
+    cuts.push_back(pos);
+    return cuts;
+}
+
+std::vector<size_t> Chunker::findCutsParallel(std::span<const uint8_t> data) const {
+    size_t segments = std::max<size_t>(1, pool_->size() * 4);
+    size_t segment_size = std::max(kMinSegmentSize, (data.size() + segments - 1) / segments);
+    
+    // Speculatively scan every segment as if a chunk started at its first byte
+    std::vector<Future<std::vector<size_t>>> futures;
+    for (size_t begin = 0; begin < data.size(); begin += segment_size) {
+        size_t end = std::min(begin + segment_size, data.size());
+        futures.push_back(pool_->submit([this, data, begin, end] {
+            return scanCuts(data, begin, end);
+        }));
+    }
+    
+    // Stitch: segment 0 is exact. For later segments, follow the true chain
+    // from where the previous segment left it until it lands on a speculative
+    // cut; from there both chains are identical.
+    std::vector<size_t> starts;
+    size_t next = 0; // True first chunk start at or past the current segment
+    
+    for (size_t k = 0; k < futures.size(); k++) {
+        auto speculative = futures[k].get();
+        size_t segment_end = std::min((k + 1) * segment_size, data.size());
+        
+        while (next < segment_end &&
+               !std::binary_search(speculative.begin(), speculative.end() - 1, next)) {
+            starts.push_back(next);
+            next += findBoundary(data.data() + next, data.size() - next);
+        }
+        
+        if (next < segment_end) {
+            auto it = std::lower_bound(speculative.begin(), speculative.end() - 1, next);
+            starts.insert(starts.end(), it, speculative.end() - 1);
+            next = speculative.back();
+        }
     }
     
-    // FastCDC-inspired chunking with gear hash
+    return starts;
+}
+
+void Chunker::chunkSpanParallel(std::span<const uint8_t> data, const ChunkCallback& callback) {
+    auto starts = findCutsParallel(data);
+    
+    std::vector<ChunkInfo> chunks(starts.size());
+    for (size_t i = 0; i < starts.size(); i++) {
+        size_t end = i + 1 < starts.size() ? starts[i + 1] : data.size();
+        chunks[i].offset = starts[i];
+        chunks[i].size = end - starts[i];
+    }
+    
+    // Hash in contiguous runs, at least a full multi-buffer batch each
+    constexpr size_t kMinHashRun = 8;
+    parallelFor(*pool_, 0, chunks.size(), [&](size_t first, size_t last) {
+        hashChunks(std::span(chunks).subspan(first, last - first), data.data(), 0);
+    }, kMinHashRun);
+    
+    resetStats();
+    for (const auto& chunk : chunks) {
+        callback(chunk, data.data() + chunk.offset);
+        recordStats(chunk.size);
+    }
+}
+
+size_t Chunker::findBoundary(const uint8_t* data, size_t size) const {
+    if (algorithm_ == ChunkingAlgorithm::Rabin) {
+        return findRabinBoundary(data, size);
+    }
+    return findGearBoundary(data, size);
+}
+
+size_t Chunker::findRabinBoundary(const uint8_t* data, size_t size) const {
     Hash::RollingHash rolling_hash(48); // 48-byte window
-    size_t chunk_start = 0;
-    size_t min_size = 0;
-    size_t max_size = 0;
-    size_t total_size = 0;
     
     // Normalize cut point (FastCDC optimization)
     size_t normalized_chunk_size = kMinChunkSize + (kAvgChunkSize - kMinChunkSize) / 2;
+    size_t limit = std::min(size, kMaxChunkSize);
     
-    for (size_t i = 0; i < data.size(); i++) {
+    for (size_t i = 0; i < limit; i++) {
         rolling_hash.append(data[i]);
-        size_t chunk_size = i + 1 - chunk_start;
-        
-        // Check for chunk boundary conditions
-        bool is_boundary = false;
-        bool max_size_reached = chunk_size >= kMaxChunkSize;
-        bool is_last_byte = (i == data.size() - 1);
+        size_t chunk_size = i + 1;
         
         // Use different masks for different regions (FastCDC)
         if (chunk_size >= kMinChunkSize && chunk_size < normalized_chunk_size) {
             // Smaller mask for early region (more likely to cut)
-            is_boundary = (rolling_hash.hash() & (kMask >> 1)) == 0;
+            if ((rolling_hash.hash() & (kMask >> 1)) == 0) {
+                return chunk_size;
+            }
         } else if (chunk_size >= normalized_chunk_size) {
             // Normal mask for main region
-            is_boundary = (rolling_hash.hash() & kMask) == 0;
-        }
-        
-        if (is_boundary || max_size_reached || is_last_byte) {
-            // Create chunk
-            std::vector<uint8_t> chunk_data(
-                data.begin() + chunk_start,
-                data.begin() + i + 1
-            );
-            
-            ChunkInfo chunk;
-            chunk.offset = chunk_start;
-            chunk.size = chunk_data.size();
-            chunk.hash = Hash::sha256(chunk_data);
-            
-            chunks.push_back(chunk);
-            
-            // Update stats
-            if (min_size == 0 || chunk.size < min_size) min_size = chunk.size;
-            if (chunk.size > max_size) max_size = chunk.size;
-            total_size += chunk.size;
-            
-            chunk_start = i + 1;
-            rolling_hash.reset();
+            if ((rolling_hash.hash() & kMask) == 0) {
+                return chunk_size;
+            }
         }
     }
     
-    // Store statistics
-    last_stats_ = {
-        chunks.size(),
-        min_size,
-        max_size,
-        chunks.empty() ? 0.0 : static_cast<double>(total_size) / chunks.size()
-    };
+    return limit;
+}
+
+size_t Chunker::findGearBoundary(const uint8_t* data, size_t size) const {
+    // Cut-point skipping: nothing below the minimum size can be a boundary
+    if (size <= kMinChunkSize) {
+        return size;
+    }
     
-    return chunks;
+    size_t normal = std::min(size, kAvgChunkSize);
+    size_t limit = std::min(size, kMaxChunkSize);
+    
+    // Hashing starts at kMinChunkSize; the second region continues the same
+    // fingerprint, which the kernel rebuilds from the preceding window
+    size_t cut = scan_(data, kMinChunkSize, kMinChunkSize, normal, kGearMaskS);
+    if (cut < normal) {
+        return cut + 1;
+    }
+    
+    cut = scan_(data, kMinChunkSize, normal, limit, kGearMaskL);
+    if (cut < limit) {
+        return cut + 1;
+    }
+    
+    return limit;
 }
 
-bool Chunker::isChunkBoundary(uint64_t hash, size_t current_size) const {
-    // FastCDC: Use bit masking instead of modulo for better performance
-    if (current_size < kMinChunkSize) {
+bool Chunker::setScanKernel(ScanKernel kernel) {
+    auto scan = GearScan::get(kernel);
+    if (!scan) {
         return false;
     }
     
-    // Adaptive masking based on chunk size
-    if (current_size < kAvgChunkSize) {
-        return (hash & (kMask >> 1)) == 0; // More aggressive cutting
+    scan_ = scan;
+    return true;
+}
+
+bool Chunker::sameBoundaries(const std::vector<ChunkInfo>& a,
+                             const std::vector<ChunkInfo>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].offset != b[i].offset || a[i].size != b[i].size) {
+            return false;
+        }
     }
     
-    return (hash & kMask) == 0;
+    return true;
+}
+
+void Chunker::resetStats() const {
+    last_stats_ = {0, 0, 0, 0.0};
+}
+
+void Chunker::recordStats(size_t chunk_size) const {
+    auto& stats = last_stats_;
+    
+    if (stats.min_size == 0 || chunk_size < stats.min_size) stats.min_size = chunk_size;
+    if (chunk_size > stats.max_size) stats.max_size = chunk_size;
+    
+    stats.total_chunks++;
+    stats.avg_size += (static_cast<double>(chunk_size) - stats.avg_size) / stats.total_chunks;
 }
 
 } // namespace dropboxlite
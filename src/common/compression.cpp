@@ -1,29 +1,477 @@
 #include "common/compression.h"
 #include <zlib.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
+#include <unordered_map>
+
+#ifdef DROPBOXLITE_HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+#ifdef DROPBOXLITE_HAVE_LZ4
+#include <lz4.h>
+#endif
 
 namespace dropboxlite {
 
+namespace {
+
+constexpr uint8_t kFrameMagic[3] = {'D', 'L', 'Z'};
+constexpr size_t kCodecCount = 4;
+
+constexpr size_t kCachedContexts = 4;
+constexpr size_t kStreamBufferSize = 64 * 1024;
+
+// zlib counts in 32 bits; larger buffers are fed in pieces
+constexpr size_t kMaxZlibPiece = std::numeric_limits<uInt>::max();
+
+struct ZContext {
+    z_stream z{};
+    bool deflater = false;
+    int level = 0;
+
+    ~ZContext() {
+        if (deflater) {
+            deflateEnd(&z);
+        } else {
+            inflateEnd(&z);
+        }
+    }
+};
+
+// Idle contexts of this thread, reset and handed out again instead of
+// paying deflateInit/inflateInit (and their window allocations) every call
+struct ContextCache {
+    std::vector<std::unique_ptr<ZContext>> deflaters;
+    std::vector<std::unique_ptr<ZContext>> inflaters;
+
+    ~ContextCache() { alive = false; }
+
+    // Cleared on thread exit so late releases are simply freed
+    static thread_local bool alive;
+};
+
+thread_local bool ContextCache::alive = false;
+thread_local ContextCache t_contexts;
+
+struct ContextRelease {
+    void operator()(ZContext* context) const {
+        std::unique_ptr<ZContext> owned(context);
+        if (!ContextCache::alive) {
+            return;
+        }
+        auto& cache = context->deflater ? t_contexts.deflaters : t_contexts.inflaters;
+        if (cache.size() < kCachedContexts) {
+            cache.push_back(std::move(owned));
+        }
+    }
+};
+
+using ContextLease = std::unique_ptr<ZContext, ContextRelease>;
+
+ContextCache& contexts() {
+    ContextCache::alive = true;
+    return t_contexts;
+}
+
+ContextLease acquireDeflater(int level) {
+    auto& cache = contexts().deflaters;
+    if (!cache.empty()) {
+        // Prefer a context already at this level; otherwise retune one
+        auto it = std::find_if(cache.begin(), cache.end(),
+                               [&](const auto& context) { return context->level == level; });
+        if (it == cache.end()) {
+            it = cache.end() - 1;
+        }
+        ContextLease lease(it->release());
+        cache.erase(it);
+
+        if (deflateReset(&lease->z) != Z_OK) {
+            return nullptr;
+        }
+        if (lease->level != level) {
+            if (deflateParams(&lease->z, level, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return nullptr;
+            }
+            lease->level = level;
+        }
+        return lease;
+    }
+
+    ContextLease lease(new ZContext);
+    lease->deflater = true;
+    lease->level = level;
+    if (deflateInit(&lease->z, level) != Z_OK) {
+        return nullptr;
+    }
+    return lease;
+}
+
+ContextLease acquireInflater() {
+    auto& cache = contexts().inflaters;
+    if (!cache.empty()) {
+        ContextLease lease(cache.back().release());
+        cache.pop_back();
+        if (inflateReset(&lease->z) != Z_OK) {
+            return nullptr;
+        }
+        return lease;
+    }
+
+    ContextLease lease(new ZContext);
+    if (inflateInit(&lease->z) != Z_OK) {
+        return nullptr;
+    }
+    return lease;
+}
+
+// One deflate/inflate call over at most kMaxZlibPiece bytes each way;
+// in_left and out_left are reduced by what was consumed and produced
+int step(z_stream& z, size_t& in_left, size_t& out_left, int (*fn)(z_streamp, int), int flush) {
+    uInt in = static_cast<uInt>(std::min(in_left, kMaxZlibPiece));
+    uInt out = static_cast<uInt>(std::min(out_left, kMaxZlibPiece));
+    z.avail_in = in;
+    z.avail_out = out;
+    int rc = fn(&z, flush);
+    in_left -= in - z.avail_in;
+    out_left -= out - z.avail_out;
+    return rc;
+}
+
+void writeHeader(uint8_t* out, Codec codec, uint64_t size) {
+    std::memcpy(out, kFrameMagic, sizeof(kFrameMagic));
+    out[3] = static_cast<uint8_t>(codec);
+    for (int i = 0; i < 8; i++) {
+        out[4 + i] = static_cast<uint8_t>(size >> (8 * i));
+    }
+}
+
+struct FrameHeader {
+    Codec codec;
+    uint64_t size;
+};
+
+std::optional<FrameHeader> readHeader(const uint8_t* header) {
+    if (std::memcmp(header, kFrameMagic, sizeof(kFrameMagic)) != 0) {
+        return std::nullopt;
+    }
+    auto codec = Compression::codecFromId(header[3]);
+    if (!codec) {
+        return std::nullopt;
+    }
+    uint64_t size = 0;
+    for (int i = 0; i < 8; i++) {
+        size |= static_cast<uint64_t>(header[4 + i]) << (8 * i);
+    }
+    return FrameHeader{*codec, size};
+}
+
+// Dictionaries that decompression can find by id
+struct DictionaryRegistry {
+    std::shared_mutex mutex;
+    std::unordered_map<uint32_t, std::shared_ptr<const CompressionDictionary>> dictionaries;
+};
+
+DictionaryRegistry& dictionaryRegistry() {
+    static DictionaryRegistry registry;
+    return registry;
+}
+
+} // namespace
+
+#ifdef DROPBOXLITE_HAVE_ZSTD
+struct CompressionDictionary::Compiled {
+    ZSTD_CDict* cdict = nullptr;
+    ZSTD_DDict* ddict = nullptr;
+
+    ~Compiled() {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+    }
+};
+#else
+struct CompressionDictionary::Compiled {};
+#endif
+
+namespace {
+
+class StoredCodec final : public CompressionCodec {
+public:
+    Codec id() const override { return Codec::None; }
+    const char* name() const override { return "none"; }
+    int defaultLevel() const override { return 0; }
+    size_t maxCompressedSize(size_t input_size) const override { return input_size; }
+    uint64_t maxExpansion() const override { return 1; }
+
+    std::optional<size_t> compress(std::span<const uint8_t> input, std::span<uint8_t> out,
+                                   int) const override {
+        if (out.size() < input.size()) {
+            return std::nullopt;
+        }
+        std::copy(input.begin(), input.end(), out.begin());
+        return input.size();
+    }
+
+    bool decompress(std::span<const uint8_t> input, std::span<uint8_t> out) const override {
+        if (input.size() != out.size()) {
+            return false;
+        }
+        std::copy(input.begin(), input.end(), out.begin());
+        return true;
+    }
+};
+
+class ZlibCodec final : public CompressionCodec {
+public:
+    Codec id() const override { return Codec::Zlib; }
+    const char* name() const override { return "zlib"; }
+    int defaultLevel() const override { return Compression::kDefaultLevel; }
+    size_t maxCompressedSize(size_t input_size) const override { return compressBound(input_size); }
+
+    // Deflate cannot expand data by more than about 1032:1
+    uint64_t maxExpansion() const override { return 1032; }
+
+    std::optional<size_t> compress(std::span<const uint8_t> input, std::span<uint8_t> out,
+                                   int level) const override {
+        auto context = acquireDeflater(level);
+        if (!context) {
+            return std::nullopt;
+        }
+
+        z_stream& z = context->z;
+        z.next_in = const_cast<Bytef*>(input.data());
+        z.next_out = out.data();
+        size_t in_left = input.size();
+        size_t out_left = out.size();
+
+        int rc = Z_OK;
+        while (rc == Z_OK && out_left > 0) {
+            int flush = in_left <= kMaxZlibPiece ? Z_FINISH : Z_NO_FLUSH;
+            rc = step(z, in_left, out_left, deflate, flush);
+        }
+        if (rc != Z_STREAM_END) {
+            return std::nullopt;
+        }
+        return out.size() - out_left;
+    }
+
+    bool decompress(std::span<const uint8_t> input, std::span<uint8_t> out) const override {
+        auto context = acquireInflater();
+        if (!context) {
+            return false;
+        }
+
+        z_stream& z = context->z;
+        z.next_in = const_cast<Bytef*>(input.data());
+        z.next_out = out.data();
+        size_t in_left = input.size();
+        size_t out_left = out.size();
+
+        int rc = Z_OK;
+        while (rc == Z_OK) {
+            rc = step(z, in_left, out_left, inflate, Z_NO_FLUSH);
+        }
+
+        // The stream must end exactly at the declared size and the input's end
+        return rc == Z_STREAM_END && out_left == 0 && in_left == 0;
+    }
+};
+
+#ifdef DROPBOXLITE_HAVE_ZSTD
+ZSTD_CCtx* zstdCompressContext() {
+    thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context(
+        ZSTD_createCCtx(), ZSTD_freeCCtx);
+    return context.get();
+}
+
+ZSTD_DCtx* zstdDecompressContext() {
+    thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(
+        ZSTD_createDCtx(), ZSTD_freeDCtx);
+    return context.get();
+}
+
+class ZstdCodec final : public CompressionCodec {
+public:
+    Codec id() const override { return Codec::Zstd; }
+    const char* name() const override { return "zstd"; }
+    int defaultLevel() const override { return 3; }
+    size_t maxCompressedSize(size_t input_size) const override { return ZSTD_compressBound(input_size); }
+
+    // An RLE block spends 4 bytes on up to 128 KB; twice that for slack
+    uint64_t maxExpansion() const override { return 65536; }
+
+    std::optional<size_t> compress(std::span<const uint8_t> input, std::span<uint8_t> out,
+                                   int level) const override {
+        ZSTD_CCtx* context = zstdCompressContext();
+        if (!context) {
+            return std::nullopt;
+        }
+        size_t size = ZSTD_compressCCtx(context, out.data(), out.size(),
+                                        input.data(), input.size(), level);
+        if (ZSTD_isError(size)) {
+            return std::nullopt;
+        }
+        return size;
+    }
+
+    std::optional<size_t> compress(std::span<const uint8_t> input, std::span<uint8_t> out,
+                                   const CompressionDictionary& dictionary) const {
+        ZSTD_CCtx* context = zstdCompressContext();
+        if (!context) {
+            return std::nullopt;
+        }
+        size_t size = ZSTD_compress_usingCDict(context, out.data(), out.size(),
+                                               input.data(), input.size(),
+                                               dictionary.compiled().cdict);
+        if (ZSTD_isError(size)) {
+            return std::nullopt;
+        }
+        return size;
+    }
+
+    // Frames made with a dictionary carry its id; it must be registered
+    bool decompress(std::span<const uint8_t> input, std::span<uint8_t> out) const override {
+        ZSTD_DCtx* context = zstdDecompressContext();
+        if (!context) {
+            return false;
+        }
+
+        size_t size;
+        uint32_t dictionary_id = ZSTD_getDictID_fromFrame(input.data(), input.size());
+        if (dictionary_id != 0) {
+            auto dictionary = Compression::findDictionary(dictionary_id);
+            if (!dictionary) {
+                return false;
+            }
+            size = ZSTD_decompress_usingDDict(context, out.data(), out.size(),
+                                              input.data(), input.size(),
+                                              dictionary->compiled().ddict);
+        } else {
+            size = ZSTD_decompressDCtx(context, out.data(), out.size(), input.data(), input.size());
+        }
+        return !ZSTD_isError(size) && size == out.size();
+    }
+};
+#endif
+
+#ifdef DROPBOXLITE_HAVE_LZ4
+class Lz4Codec final : public CompressionCodec {
+public:
+    Codec id() const override { return Codec::LZ4; }
+    const char* name() const override { return "lz4"; }
+    int defaultLevel() const override { return 1; }
+
+    // LZ4_compressBound, without its int overflow
+    size_t maxCompressedSize(size_t input_size) const override {
+        return input_size + input_size / 255 + 16;
+    }
+
+    uint64_t maxExpansion() const override { return 256; }
+
+    std::optional<size_t> compress(std::span<const uint8_t> input, std::span<uint8_t> out,
+                                   int) const override {
+        if (input.size() > LZ4_MAX_INPUT_SIZE) {
+            return std::nullopt;
+        }
+        thread_local std::vector<char> state(LZ4_sizeofState());
+        int capacity = static_cast<int>(std::min<size_t>(out.size(), INT32_MAX));
+        int size = LZ4_compress_fast_extState(state.data(),
+                                              reinterpret_cast<const char*>(input.data()),
+                                              reinterpret_cast<char*>(out.data()),
+                                              static_cast<int>(input.size()), capacity, 1);
+        if (size <= 0) {
+            return std::nullopt;
+        }
+        return static_cast<size_t>(size);
+    }
+
+    bool decompress(std::span<const uint8_t> input, std::span<uint8_t> out) const override {
+        if (input.size() > INT32_MAX || out.size() > INT32_MAX) {
+            return false;
+        }
+        int size = LZ4_decompress_safe(reinterpret_cast<const char*>(input.data()),
+                                       reinterpret_cast<char*>(out.data()),
+                                       static_cast<int>(input.size()),
+                                       static_cast<int>(out.size()));
+        return size >= 0 && static_cast<size_t>(size) == out.size();
+    }
+};
+#endif
+
+const std::array<const CompressionCodec*, kCodecCount>& registry() {
+    static const StoredCodec stored;
+    static const ZlibCodec zlib;
+#ifdef DROPBOXLITE_HAVE_ZSTD
+    static const ZstdCodec zstd;
+    const CompressionCodec* zstd_codec = &zstd;
+#else
+    const CompressionCodec* zstd_codec = nullptr;
+#endif
+#ifdef DROPBOXLITE_HAVE_LZ4
+    static const Lz4Codec lz4;
+    const CompressionCodec* lz4_codec = &lz4;
+#else
+    const CompressionCodec* lz4_codec = nullptr;
+#endif
+    static const std::array<const CompressionCodec*, kCodecCount> codecs = {
+        &stored, &zlib, zstd_codec, lz4_codec
+    };
+    return codecs;
+}
+
+// First built-in codec of the preferences, with its level
+CodecChoice firstAvailable(std::initializer_list<CodecChoice> preferences) {
+    for (const auto& choice : preferences) {
+        if (Compression::codec(choice.codec)) {
+            return choice;
+        }
+    }
+    return {Codec::None, 0};
+}
+
+// Leading bytes of formats that are already compressed
+bool looksPrecompressed(std::span<const uint8_t> data) {
+    auto starts = [&](std::initializer_list<uint8_t> magic, size_t offset = 0) {
+        return data.size() >= offset + magic.size() &&
+               std::equal(magic.begin(), magic.end(), data.begin() + offset);
+    };
+    return starts({0xff, 0xd8, 0xff}) ||                    // JPEG
+           starts({0x89, 'P', 'N', 'G'}) ||                 // PNG
+           starts({'G', 'I', 'F', '8'}) ||                  // GIF
+           starts({0x1f, 0x8b}) ||                          // gzip
+           starts({'P', 'K', 0x03, 0x04}) ||                // zip, docx, jar
+           starts({0x28, 0xb5, 0x2f, 0xfd}) ||              // zstd
+           starts({0x04, 0x22, 0x4d, 0x18}) ||              // LZ4 frame
+           starts({'B', 'Z', 'h'}) ||                       // bzip2
+           starts({0xfd, '7', 'z', 'X', 'Z'}) ||            // xz
+           starts({'7', 'z', 0xbc, 0xaf}) ||                // 7z
+           starts({'f', 't', 'y', 'p'}, 4) ||               // MP4, MOV, HEIC
+           starts({'O', 'g', 'g', 'S'}) ||                  // Ogg
+           starts({'I', 'D', '3'}) ||                       // MP3
+           starts({0x1a, 0x45, 0xdf, 0xa3});                // Matroska, WebM
+}
+
+} // namespace
+
 std::vector<uint8_t> Compression::compress(const std::vector<uint8_t>& data) {
     if (data.empty()) {
         return {};
     }
-    
-    uLongf compressed_size = compressBound(data.size());
-    std::vector<uint8_t> compressed(compressed_size);
-    
-    int result = ::compress(
-        compressed.data(),
-        &compressed_size,
-        data.data(),
-        data.size()
-    );
-    
-    if (result != Z_OK) {
+
+    std::vector<uint8_t> compressed(maxCompressedSize(data.size()));
+    auto size = compressInto(data, compressed);
+    if (!size) {
         throw std::runtime_error("Compression failed");
     }
-    
-    compressed.resize(compressed_size);
+
+    compressed.resize(*size);
     return compressed;
 }
 
@@ -31,36 +479,480 @@ std::vector<uint8_t> Compression::decompress(const std::vector<uint8_t>& data) {
     if (data.empty()) {
         return {};
     }
-    
-    // Start with 4x the compressed size
-    uLongf decompressed_size = data.size() * 4;
-    std::vector<uint8_t> decompressed(decompressed_size);
-    
-    int result = Z_BUF_ERROR;
-    while (result == Z_BUF_ERROR) {
-        result = uncompress(
-            decompressed.data(),
-            &decompressed_size,
-            data.data(),
-            data.size()
-        );
-        
-        if (result == Z_BUF_ERROR) {
-            decompressed_size *= 2;
-            decompressed.resize(decompressed_size);
-        }
-    }
-    
-    if (result != Z_OK) {
+
+    // The header gives the exact size: one allocation, one decoding pass
+    auto size = decompressedSize(data);
+    if (!size) {
+        throw std::runtime_error("Decompression failed: invalid frame header");
+    }
+
+    std::vector<uint8_t> decompressed(*size);
+    if (!decompressInto(data, decompressed)) {
         throw std::runtime_error("Decompression failed");
     }
-    
-    decompressed.resize(decompressed_size);
+
     return decompressed;
 }
 
+size_t Compression::maxCompressedSize(size_t input_size) {
+    size_t bound = 0;
+    for (const auto* codec : registry()) {
+        if (codec) {
+            bound = std::max(bound, codec->maxCompressedSize(input_size));
+        }
+    }
+    return kFrameHeaderSize + bound;
+}
+
+std::optional<size_t> Compression::compressInto(std::span<const uint8_t> input,
+                                                std::span<uint8_t> out,
+                                                CodecChoice choice) {
+    const CompressionCodec* impl = codec(choice.codec);
+    if (!impl || out.size() < kFrameHeaderSize) {
+        return std::nullopt;
+    }
+
+    std::optional<size_t> size;
+    if (choice.dictionary) {
+#ifdef DROPBOXLITE_HAVE_ZSTD
+        if (choice.codec == Codec::Zstd) {
+            size = static_cast<const ZstdCodec*>(impl)->compress(
+                input, out.subspan(kFrameHeaderSize), *choice.dictionary);
+        }
+#endif
+    } else {
+        size = impl->compress(input, out.subspan(kFrameHeaderSize), choice.level);
+    }
+    if (!size) {
+        return std::nullopt;
+    }
+
+    writeHeader(out.data(), choice.codec, input.size());
+    return kFrameHeaderSize + *size;
+}
+
+std::optional<size_t> Compression::compressInto(std::span<const uint8_t> input,
+                                                std::span<uint8_t> out,
+                                                int level) {
+    return compressInto(input, out, CodecChoice{Codec::Zlib, level});
+}
+
+std::vector<uint8_t> Compression::compressAdaptive(std::span<const uint8_t> data,
+                                                   const CompressionDictionary* dictionary) {
+    CodecChoice choice = chooseCodec(data, dictionary);
+
+    std::vector<uint8_t> frame(maxCompressedSize(data.size()));
+    auto size = compressInto(data, frame, choice);
+
+    // Not worth it (or failed): keep the bytes as they are
+    if (!size || *size >= kFrameHeaderSize + data.size()) {
+        size = compressInto(data, frame, CodecChoice{Codec::None, 0});
+    }
+
+    frame.resize(*size);
+    return frame;
+}
+
+std::optional<uint64_t> Compression::decompressedSize(std::span<const uint8_t> frame) {
+    if (frame.size() < kFrameHeaderSize) {
+        return std::nullopt;
+    }
+
+    auto header = readHeader(frame.data());
+    if (!header) {
+        return std::nullopt;
+    }
+
+    // A length the payload could not expand to means a corrupt header;
+    // rejecting it bounds what callers allocate
+    const CompressionCodec* impl = codec(header->codec);
+    if (!impl || header->size / impl->maxExpansion() > frame.size() - kFrameHeaderSize) {
+        return std::nullopt;
+    }
+    return header->size;
+}
+
+std::optional<Codec> Compression::frameCodec(std::span<const uint8_t> frame) {
+    if (frame.size() < kFrameHeaderSize) {
+        return std::nullopt;
+    }
+    auto header = readHeader(frame.data());
+    return header ? std::optional<Codec>(header->codec) : std::nullopt;
+}
+
+bool Compression::decompressInto(std::span<const uint8_t> frame, std::span<uint8_t> out) {
+    auto size = decompressedSize(frame);
+    if (!size || *size != out.size()) {
+        return false;
+    }
+    return codec(*frameCodec(frame))->decompress(frame.subspan(kFrameHeaderSize), out);
+}
+
+const CompressionCodec* Compression::codec(Codec codec) {
+    size_t index = static_cast<size_t>(codec);
+    return index < kCodecCount ? registry()[index] : nullptr;
+}
+
+const char* Compression::codecName(Codec codec) {
+    switch (codec) {
+        case Codec::None: return "none";
+        case Codec::Zlib: return "zlib";
+        case Codec::Zstd: return "zstd";
+        case Codec::LZ4: return "lz4";
+        default: return "unknown";
+    }
+}
+
+std::optional<Codec> Compression::codecFromId(uint32_t id) {
+    if (id >= kCodecCount) {
+        return std::nullopt;
+    }
+    return static_cast<Codec>(id);
+}
+
+CompressionEstimate Compression::estimate(std::span<const uint8_t> data) {
+    constexpr size_t kWindows = 8;
+    constexpr size_t kWindowSize = 512;
+
+    // Whole input when small, otherwise evenly spaced windows
+    std::array<uint32_t, 256> counts{};
+    size_t sampled = 0;
+    if (data.size() <= kWindows * kWindowSize) {
+        for (uint8_t byte : data) {
+            counts[byte]++;
+        }
+        sampled = data.size();
+    } else {
+        size_t stride = (data.size() - kWindowSize) / (kWindows - 1);
+        for (size_t w = 0; w < kWindows; w++) {
+            for (uint8_t byte : data.subspan(w * stride, kWindowSize)) {
+                counts[byte]++;
+            }
+        }
+        sampled = kWindows * kWindowSize;
+    }
+
+    double entropy = 0;
+    for (uint32_t count : counts) {
+        if (count > 0) {
+            double p = static_cast<double>(count) / sampled;
+            entropy -= p * std::log2(p);
+        }
+    }
+
+    return {entropy, looksPrecompressed(data)};
+}
+
+CodecChoice Compression::chooseCodec(std::span<const uint8_t> data,
+                                     const CompressionDictionary* dictionary) {
+    // A 4 KB sample of random bytes scores about 7.95 bits; compressed
+    // formats land close to that, while text sits near 4-5
+    constexpr double kIncompressibleEntropy = 7.5;
+    constexpr double kRedundantEntropy = 2.0;
+    constexpr double kTextEntropy = 6.0;
+
+    // Below this even a dictionary cannot beat the frame overhead
+    constexpr size_t kMinDictionarySize = 64;
+
+    bool use_dictionary = dictionary && codec(Codec::Zstd) &&
+                          data.size() >= kMinDictionarySize && data.size() <= kDictionaryMaxSize;
+    if (!use_dictionary && !shouldCompress(data.size())) {
+        return {Codec::None, 0};
+    }
+
+    auto sample = estimate(data);
+    if (sample.precompressed || sample.entropy > kIncompressibleEntropy) {
+        return {Codec::None, 0};
+    }
+
+    // Small chunks gain most from shared context
+    if (use_dictionary) {
+        return {Codec::Zstd, CompressionDictionary::kLevel, dictionary};
+    }
+
+    // Runs and sparse data compress well with anything: spend the least CPU
+    if (sample.entropy < kRedundantEntropy) {
+        return firstAvailable({{Codec::LZ4, 1}, {Codec::Zstd, 1}, {Codec::Zlib, 1}});
+    }
+
+    // Text and source code: ratio is worth a stronger level
+    if (sample.entropy < kTextEntropy) {
+        return firstAvailable({{Codec::Zstd, 6}, {Codec::Zlib, kDefaultLevel}});
+    }
+
+    return firstAvailable({{Codec::Zstd, 1}, {Codec::LZ4, 1}, {Codec::Zlib, 1}});
+}
+
 bool Compression::shouldCompress(size_t data_size) {
     return data_size >= kMinCompressionSize;
 }
 
+void Compression::registerDictionary(std::shared_ptr<const CompressionDictionary> dictionary) {
+    auto& registry = dictionaryRegistry();
+    std::unique_lock<std::shared_mutex> lock(registry.mutex);
+    registry.dictionaries[dictionary->id()] = std::move(dictionary);
+}
+
+std::shared_ptr<const CompressionDictionary> Compression::findDictionary(uint32_t id) {
+    auto& registry = dictionaryRegistry();
+    std::shared_lock<std::shared_mutex> lock(registry.mutex);
+    auto it = registry.dictionaries.find(id);
+    return it != registry.dictionaries.end() ? it->second : nullptr;
+}
+
+// Dictionaries
+CompressionDictionary::CompressionDictionary(uint32_t id, std::vector<uint8_t> data,
+                                             std::unique_ptr<Compiled> compiled)
+    : id_(id), data_(std::move(data)), compiled_(std::move(compiled)) {}
+
+CompressionDictionary::~CompressionDictionary() = default;
+
+std::shared_ptr<const CompressionDictionary> CompressionDictionary::train(
+    std::span<const std::span<const uint8_t>> samples, uint32_t id, size_t capacity) {
+#ifdef DROPBOXLITE_HAVE_ZSTD
+    if (id < kMinId) {
+        return nullptr;
+    }
+
+    // The trainer wants samples back to back with a table of sizes
+    std::vector<uint8_t> joined;
+    std::vector<size_t> sizes;
+    for (const auto& sample : samples) {
+        joined.insert(joined.end(), sample.begin(), sample.end());
+        sizes.push_back(sample.size());
+    }
+
+    std::vector<uint8_t> content(capacity);
+    size_t content_size = ZDICT_trainFromBuffer(content.data(), content.size(), joined.data(),
+                                                sizes.data(), static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(content_size)) {
+        return nullptr;
+    }
+
+    // Training picks a random id; finalizing again stamps ours and tunes the
+    // entropy tables for the level dictionaries are used at
+    size_t header_size = ZDICT_getDictHeaderSize(content.data(), content_size);
+    if (ZDICT_isError(header_size)) {
+        return nullptr;
+    }
+
+    ZDICT_params_t params{};
+    params.compressionLevel = kLevel;
+    params.dictID = id;
+
+    std::vector<uint8_t> data(capacity);
+    size_t size = ZDICT_finalizeDictionary(data.data(), data.size(),
+                                           content.data() + header_size, content_size - header_size,
+                                           joined.data(), sizes.data(),
+                                           static_cast<unsigned>(sizes.size()), params);
+    if (ZDICT_isError(size)) {
+        return nullptr;
+    }
+
+    data.resize(size);
+    return load(std::move(data));
+#else
+    (void)samples;
+    (void)id;
+    (void)capacity;
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const CompressionDictionary> CompressionDictionary::load(std::vector<uint8_t> data) {
+#ifdef DROPBOXLITE_HAVE_ZSTD
+    uint32_t id = ZDICT_getDictID(data.data(), data.size());
+    if (id == 0) {
+        return nullptr;
+    }
+
+    auto compiled = std::make_unique<Compiled>();
+    compiled->cdict = ZSTD_createCDict(data.data(), data.size(), kLevel);
+    compiled->ddict = ZSTD_createDDict(data.data(), data.size());
+    if (!compiled->cdict || !compiled->ddict) {
+        return nullptr;
+    }
+
+    return std::shared_ptr<const CompressionDictionary>(
+        new CompressionDictionary(id, std::move(data), std::move(compiled)));
+#else
+    (void)data;
+    return nullptr;
+#endif
+}
+
+// Streaming compression
+struct Compression::CompressStream::State {
+    ContextLease context;
+    uint64_t total_size;
+    uint64_t consumed = 0;
+    bool started = false;
+    bool failed = false;
+
+    // Run deflate over input with the given flush mode, growing out as needed
+    bool drive(std::span<const uint8_t> input, std::vector<uint8_t>& out, int flush) {
+        if (!started) {
+            size_t offset = out.size();
+            out.resize(offset + kFrameHeaderSize);
+            writeHeader(out.data() + offset, Codec::Zlib, total_size);
+            started = true;
+        }
+
+        z_stream& z = context->z;
+        z.next_in = const_cast<Bytef*>(input.data());
+        size_t in_left = input.size();
+
+        while (true) {
+            size_t offset = out.size();
+            size_t room = std::max<size_t>(deflateBound(&z, std::min(in_left, kMaxZlibPiece)),
+                                           kStreamBufferSize);
+            out.resize(offset + room);
+            z.next_out = out.data() + offset;
+            size_t out_left = room;
+
+            int rc = step(z, in_left, out_left, deflate, flush);
+            out.resize(offset + room - out_left);
+
+            if (rc == Z_STREAM_END) {
+                return true;
+            }
+            if (rc == Z_BUF_ERROR && in_left == 0 && flush == Z_NO_FLUSH) {
+                return true;
+            }
+            if (rc != Z_OK) {
+                return false;
+            }
+            // With no flush requested, spare output room means all input was taken
+            if (flush == Z_NO_FLUSH && in_left == 0 && out_left > 0) {
+                return true;
+            }
+        }
+    }
+};
+
+Compression::CompressStream::CompressStream(uint64_t total_size, int level)
+    : state_(std::make_unique<State>()) {
+    state_->context = acquireDeflater(level);
+    state_->total_size = total_size;
+    state_->failed = !state_->context;
+}
+
+Compression::CompressStream::~CompressStream() = default;
+
+bool Compression::CompressStream::update(std::span<const uint8_t> data, std::vector<uint8_t>& out) {
+    State& s = *state_;
+    if (s.failed || data.size() > s.total_size - s.consumed) {
+        s.failed = true;
+        return false;
+    }
+
+    s.consumed += data.size();
+    s.failed = !s.drive(data, out, Z_NO_FLUSH);
+    return !s.failed;
+}
+
+bool Compression::CompressStream::finish(std::vector<uint8_t>& out) {
+    State& s = *state_;
+    if (s.failed || s.consumed != s.total_size) {
+        s.failed = true;
+        return false;
+    }
+
+    s.failed = !s.drive({}, out, Z_FINISH);
+    return !s.failed;
+}
+
+// Streaming decompression
+struct Compression::DecompressStream::State {
+    ContextLease context;
+    uint8_t header[kFrameHeaderSize];
+    size_t header_length = 0;
+    std::optional<uint64_t> expected;
+    uint64_t produced = 0;
+    bool done = false;
+    bool failed = false;
+    std::vector<uint8_t> buffer;
+
+    bool fail() {
+        failed = true;
+        return false;
+    }
+};
+
+Compression::DecompressStream::DecompressStream() : state_(std::make_unique<State>()) {
+    state_->context = acquireInflater();
+    state_->failed = !state_->context;
+}
+
+Compression::DecompressStream::~DecompressStream() = default;
+
+bool Compression::DecompressStream::update(std::span<const uint8_t> data,
+                                           const DecompressSink& sink) {
+    State& s = *state_;
+    if (s.failed) {
+        return false;
+    }
+    if (s.done) {
+        return data.empty() || s.fail();
+    }
+
+    if (!s.expected) {
+        size_t take = std::min(kFrameHeaderSize - s.header_length, data.size());
+        std::memcpy(s.header + s.header_length, data.data(), take);
+        s.header_length += take;
+        data = data.subspan(take);
+        if (s.header_length < kFrameHeaderSize) {
+            return true;
+        }
+
+        auto header = readHeader(s.header);
+        if (!header || header->codec != Codec::Zlib) {
+            return s.fail();
+        }
+        s.expected = header->size;
+        s.buffer.resize(std::min<uint64_t>(kStreamBufferSize, std::max<uint64_t>(*s.expected, 1)));
+    }
+
+    z_stream& z = s.context->z;
+    z.next_in = const_cast<Bytef*>(data.data());
+    size_t in_left = data.size();
+
+    while (true) {
+        z.next_out = s.buffer.data();
+        size_t out_left = s.buffer.size();
+        int rc = step(z, in_left, out_left, inflate, Z_NO_FLUSH);
+
+        size_t produced = s.buffer.size() - out_left;
+        s.produced += produced;
+        if (s.produced > *s.expected) {
+            return s.fail();
+        }
+        if (produced > 0) {
+            sink(std::span<const uint8_t>(s.buffer.data(), produced));
+        }
+
+        if (rc == Z_STREAM_END) {
+            s.done = true;
+            return (in_left == 0 && s.produced == *s.expected) || s.fail();
+        }
+        if (rc == Z_BUF_ERROR && in_left == 0) {
+            return true;
+        }
+        if (rc != Z_OK) {
+            return s.fail();
+        }
+        if (in_left == 0 && out_left > 0) {
+            return true;
+        }
+    }
+}
+
+bool Compression::DecompressStream::finished() const {
+    return state_->done && !state_->failed;
+}
+
+std::optional<uint64_t> Compression::DecompressStream::expectedSize() const {
+    return state_->expected;
+}
+
 } // namespace dropboxlite
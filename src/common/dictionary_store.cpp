@@ -0,0 +1,113 @@
+#include "common/dictionary_store.h"
+#include "common/logger.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cctype>
+
+namespace dropboxlite {
+
+DictionaryStore::DictionaryStore(const std::string& root) : root_(root) {}
+
+bool DictionaryStore::initialize() {
+    std::error_code error;
+    std::filesystem::create_directories(root_, error);
+    if (error) {
+        LOG_ERROR("Failed to create dictionary store: " + root_);
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(root_)) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".zdict") {
+            continue;
+        }
+        
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+        auto dictionary = CompressionDictionary::load(std::move(data));
+        if (!dictionary) {
+            LOG_WARNING("Skipping unreadable dictionary: " + entry.path().string());
+            continue;
+        }
+        add(entry.path().parent_path().filename().string(), std::move(dictionary));
+    }
+    
+    return true;
+}
+
+std::optional<uint32_t> DictionaryStore::train(const std::string& scope,
+                                               std::span<const std::span<const uint8_t>> samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto dictionary = CompressionDictionary::train(samples, next_id_);
+    if (!dictionary) {
+        return std::nullopt;
+    }
+    
+    // Write then rename, so a crash never leaves a truncated version behind
+    std::string directory = scopeDirectory(scope);
+    std::filesystem::path dir = std::filesystem::path(root_) / directory;
+    std::filesystem::path path = dir / (std::to_string(dictionary->id()) + ".zdict");
+    std::filesystem::path temp = dir / (std::to_string(dictionary->id()) + ".tmp");
+    
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    {
+        std::ofstream file(temp, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(dictionary->data().data()),
+                   dictionary->data().size());
+        if (!file) {
+            LOG_ERROR("Failed to write dictionary: " + temp.string());
+            return std::nullopt;
+        }
+    }
+    std::filesystem::rename(temp, path, error);
+    if (error) {
+        LOG_ERROR("Failed to store dictionary: " + path.string());
+        return std::nullopt;
+    }
+    
+    uint32_t id = dictionary->id();
+    add(directory, std::move(dictionary));
+    LOG_INFO("Trained dictionary " + std::to_string(id) + " for " + scope +
+             " from " + std::to_string(samples.size()) + " samples");
+    return id;
+}
+
+std::shared_ptr<const CompressionDictionary> DictionaryStore::latest(const std::string& scope) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = latest_.find(scopeDirectory(scope));
+    return it != latest_.end() ? it->second : nullptr;
+}
+
+std::string DictionaryStore::scopeDirectory(const std::string& scope) {
+    static const char* kHex = "0123456789abcdef";
+    
+    std::string directory;
+    for (unsigned char c : scope) {
+        if (std::isalnum(c) || c == '_' || c == '-') {
+            directory += static_cast<char>(c);
+        } else {
+            directory += '%';
+            directory += kHex[c >> 4];
+            directory += kHex[c & 0xf];
+        }
+    }
+    return directory.empty() ? "%" : directory;
+}
+
+void DictionaryStore::add(const std::string& directory,
+                          std::shared_ptr<const CompressionDictionary> dictionary) {
+    next_id_ = std::max(next_id_, dictionary->id() + 1);
+    
+    auto& latest = latest_[directory];
+    if (!latest || latest->id() < dictionary->id()) {
+        latest = dictionary;
+    }
+    Compression::registerDictionary(std::move(dictionary));
+}
+
+} // namespace dropboxlite
@@ -0,0 +1,61 @@
+#include "common/digest.h"
+
+namespace dropboxlite {
+
+namespace {
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+std::string Digest::toHex() const {
+    std::string hex(kSize * 2, '\0');
+    for (size_t i = 0; i < kSize; i++) {
+        hex[2 * i] = kHexDigits[bytes[i] >> 4];
+        hex[2 * i + 1] = kHexDigits[bytes[i] & 0x0f];
+    }
+    return hex;
+}
+
+std::optional<Digest> Digest::fromHex(std::string_view hex) {
+    if (hex.size() != kSize * 2) {
+        return std::nullopt;
+    }
+    
+    Digest digest;
+    for (size_t i = 0; i < kSize; i++) {
+        int high = hexValue(hex[2 * i]);
+        int low = hexValue(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return std::nullopt;
+        }
+        digest.bytes[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return digest;
+}
+
+std::optional<Digest> Digest::fromBytes(const void* data, size_t size) {
+    if (size != kSize) {
+        return std::nullopt;
+    }
+    
+    Digest digest;
+    std::memcpy(digest.bytes.data(), data, kSize);
+    return digest;
+}
+
+std::optional<Digest> Digest::parse(std::string_view value) {
+    if (value.size() == kSize) {
+        return fromBytes(value.data(), value.size());
+    }
+    return fromHex(value);
+}
+
+} // namespace dropboxlite
@@ -0,0 +1,123 @@
+#include "common/executor.h"
+#include "common/logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dropboxlite {
+
+Executor::Executor(ThreadPool& pool, size_t io_threads)
+    : pool_(pool), io_(std::max<size_t>(1, io_threads)) {}
+
+Executor::~Executor() {
+    {
+        std::unique_lock<std::mutex> lock(spawn_mutex_);
+        spawn_done_.wait(lock, [this] { return spawned_ == 0; });
+    }
+}
+
+void Executor::spawn(Task<void> task) {
+    {
+        std::lock_guard<std::mutex> lock(spawn_mutex_);
+        spawned_++;
+    }
+    runSpawned(std::move(task));
+}
+
+size_t Executor::inFlight() const {
+    std::lock_guard<std::mutex> lock(spawn_mutex_);
+    return spawned_;
+}
+
+detail::DetachedTask Executor::runSpawned(Task<void> task) {
+    co_await schedule();
+    try {
+        co_await std::move(task);
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("Spawned task failed: ") + e.what());
+    } catch (...) {
+        LOG_ERROR("Spawned task failed");
+    }
+    // Notify under the lock: the destructor may return as soon as it can
+    // take it, and only this frame's own teardown runs after the unlock
+    std::lock_guard<std::mutex> lock(spawn_mutex_);
+    if (--spawned_ == 0) {
+        spawn_done_.notify_all();
+    }
+}
+
+void Executor::resume(std::coroutine_handle<> handle, Priority priority) {
+    pool_.post(priority, [handle] { handle.resume(); });
+}
+
+void Executor::addTimer(Clock::time_point deadline, std::coroutine_handle<> handle,
+                        Priority priority) {
+    timers_.schedule(deadline, [this, handle, priority] { resume(handle, priority); });
+}
+
+std::optional<size_t> Executor::readAtBlocking(int fd, uint64_t offset, std::span<uint8_t> out) {
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = ::pread(fd, out.data() + done, out.size() - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return std::nullopt;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+bool Executor::writeAtBlocking(int fd, uint64_t offset, std::span<const uint8_t> data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = ::pwrite(fd, data.data() + done, data.size() - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+std::optional<std::vector<uint8_t>> Executor::readFileBlocking(const std::string& filepath) {
+    int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> data(st.st_size);
+    std::optional<size_t> n = readAtBlocking(fd, 0, data);
+    ::close(fd);
+    if (!n) {
+        return std::nullopt;
+    }
+    data.resize(*n);
+    return data;
+}
+
+bool Executor::writeFileBlocking(const std::string& filepath, std::span<const uint8_t> data) {
+    int fd = ::open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = writeAtBlocking(fd, 0, data);
+    return ::close(fd) == 0 && ok;
+}
+
+} // namespace dropboxlite
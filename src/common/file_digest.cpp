@@ -0,0 +1,227 @@
+#include "common/hash.h"
+#include "common/mapped_file.h"
+#include "common/thread_pool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dropboxlite {
+
+namespace {
+
+constexpr size_t kPageSize = 4096;
+
+struct FreeDeleter {
+    void operator()(uint8_t* p) const { std::free(p); }
+};
+using AlignedBuffer = std::unique_ptr<uint8_t, FreeDeleter>;
+
+AlignedBuffer allocateAligned(size_t size) {
+    return AlignedBuffer(static_cast<uint8_t*>(std::aligned_alloc(kPageSize, size)));
+}
+
+// Fill buffer from offset, retrying short reads; returns bytes read (less
+// than size only at end of file) or -1 on error. Non-seekable inputs
+// (pipes, FIFOs) are read sequentially and offset is ignored.
+ssize_t readFull(int fd, uint8_t* buffer, size_t size, off_t offset, bool seekable) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = seekable ? pread(fd, buffer + total, size - total, offset + total) :
+                               ::read(fd, buffer + total, size - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return static_cast<ssize_t>(total);
+}
+
+// Read-ahead for every file being hashed, so a tree of files does not pay
+// for a thread per file. Never destroyed, like TimerWheel::shared().
+ThreadPool& readAheadPool() {
+    static ThreadPool* pool = new ThreadPool(std::max(2u, std::thread::hardware_concurrency()));
+    return *pool;
+}
+
+// Two page-aligned buffers: a read-ahead task fills one while the caller
+// hashes the other. A block shorter than block_size marks the end.
+class DoubleBufferedReader {
+public:
+    DoubleBufferedReader(int fd, size_t block_size, bool seekable)
+        : fd_(fd), block_size_(block_size), seekable_(seekable) {
+        for (auto& slot : slots_) {
+            slot.data = allocateAligned(block_size);
+        }
+    }
+    
+    // Feed every block to consume in file order; false on read error
+    template<typename Consume>
+    bool run(Consume&& consume) {
+        if (!slots_[0].data || !slots_[1].data) {
+            return false;
+        }
+        
+        // Runs on its own pool, never the caller's, so a caller that is
+        // itself a pool worker cannot end up waiting on its own queue
+        readAheadPool().post([this] { produce(); });
+        
+        bool ok = true;
+        for (size_t i = 0;; i++) {
+            Slot& slot = slots_[i % 2];
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [&] { return slot.full; });
+            }
+            
+            bool last = slot.length < block_size_;
+            ok = !slot.failed;
+            if (ok) {
+                consume(std::span<const uint8_t>(slot.data.get(), slot.length));
+            }
+            
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                slot.full = false;
+            }
+            ready_.notify_all();
+            
+            if (last || !ok) {
+                break;
+            }
+        }
+        
+        // The task still touches slots_ until it has finished
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [&] { return produced_; });
+        return ok;
+    }
+    
+private:
+    struct Slot {
+        AlignedBuffer data;
+        size_t length = 0;
+        bool full = false;
+        bool failed = false;
+    };
+    
+    void produce() {
+        off_t offset = 0;
+        for (size_t i = 0;; i++) {
+            Slot& slot = slots_[i % 2];
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [&] { return !slot.full; });
+            }
+            
+            ssize_t n = readFull(fd_, slot.data.get(), block_size_, offset, seekable_);
+            offset += n > 0 ? n : 0;
+            
+            // Start the kernel on the block after the one being read next
+            posix_fadvise(fd_, offset + block_size_, block_size_, POSIX_FADV_WILLNEED);
+            
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                slot.length = n > 0 ? static_cast<size_t>(n) : 0;
+                slot.failed = n < 0;
+                slot.full = true;
+            }
+            ready_.notify_all();
+            
+            if (n < static_cast<ssize_t>(block_size_)) {
+                break;
+            }
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            produced_ = true;
+        }
+        ready_.notify_all();
+    }
+    
+    int fd_;
+    size_t block_size_;
+    bool seekable_;
+    bool produced_ = false;
+    Slot slots_[2];
+    std::mutex mutex_;
+    std::condition_variable ready_;
+};
+
+} // namespace
+
+std::optional<Digest> Hash::fileDigest(HashAlgorithm algorithm, const std::string& filepath,
+                                       const FileHashOptions& options) {
+    int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    uint64_t file_size = S_ISREG(st.st_mode) ? static_cast<uint64_t>(st.st_size) : 0;
+    
+    if (algorithm == HashAlgorithm::BLAKE3 && options.pool &&
+        file_size >= options.parallel_threshold) {
+        MappedFile mapped;
+        if (mapped.open(filepath)) {
+            ::close(fd);
+            return blake3(mapped.span(), options.pool);
+        }
+    }
+    
+    // Hints only; failures are harmless
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    bool seekable = lseek(fd, 0, SEEK_CUR) >= 0;
+    
+    size_t block_size = std::max(options.block_size, kPageSize);
+    block_size = (block_size + kPageSize - 1) / kPageSize * kPageSize;
+    
+    Stream stream(algorithm);
+    bool ok;
+    
+    if (S_ISREG(st.st_mode) && file_size < block_size) {
+        // Fits in one read; a second buffer and thread would only add latency
+        // (it loops anyway in case the file grew since fstat)
+        auto buffer = allocateAligned(block_size);
+        ok = buffer != nullptr;
+        for (off_t offset = 0; ok;) {
+            ssize_t n = readFull(fd, buffer.get(), block_size, offset, seekable);
+            ok = n >= 0;
+            if (ok) {
+                stream.update(std::span<const uint8_t>(buffer.get(), n));
+                offset += n;
+            }
+            if (n < static_cast<ssize_t>(block_size)) {
+                break;
+            }
+        }
+    } else {
+        DoubleBufferedReader reader(fd, block_size, seekable);
+        ok = reader.run([&](std::span<const uint8_t> block) { stream.update(block); });
+    }
+    
+    ::close(fd);
+    if (!ok) {
+        return std::nullopt;
+    }
+    return stream.finish();
+}
+
+} // namespace dropboxlite
@@ -1,51 +1,135 @@
 #include "common/hash.h"
 #include <openssl/sha.h>
-#include <fstream>
-#include <sstream>
-#include <iomanip>
+#include <openssl/evp.h>
 
 namespace dropboxlite {
 
-std::string Hash::sha256(const std::vector<uint8_t>& data) {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256(data.data(), data.size(), hash);
+namespace {
+
+// SplitMix64 expansion of a fixed seed; changing it changes every boundary
+constexpr std::array<uint64_t, 256> makeGearTable() {
+    std::array<uint64_t, 256> table{};
+    uint64_t state = 0x6a09e667f3bcc908ULL;
+    for (auto& entry : table) {
+        state += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        entry = z ^ (z >> 31);
+    }
+    return table;
+}
+
+constexpr std::array<uint64_t, 256> kGearTable = makeGearTable();
+
+} // namespace
+
+Digest Hash::digest(HashAlgorithm algorithm, std::span<const uint8_t> data) {
+    return algorithm == HashAlgorithm::BLAKE3 ? blake3(data) : sha256Digest(data);
+}
+
+std::optional<Digest> Hash::fileDigest(HashAlgorithm algorithm, const std::string& filepath) {
+    return fileDigest(algorithm, filepath, FileHashOptions{});
+}
+
+void Hash::digestBatch(HashAlgorithm algorithm,
+                       std::span<const std::span<const uint8_t>> inputs,
+                       std::span<Digest> digests) {
+    if (algorithm == HashAlgorithm::SHA256) {
+        sha256Batch(inputs, digests);
+        return;
+    }
     
-    std::stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
+    for (size_t i = 0; i < inputs.size(); i++) {
+        digests[i] = blake3(inputs[i]);
     }
-    return ss.str();
+}
+
+const char* Hash::algorithmName(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::SHA256: return "sha256";
+        case HashAlgorithm::BLAKE3: return "blake3";
+        default: return "unknown";
+    }
+}
+
+std::optional<HashAlgorithm> Hash::algorithmFromId(uint32_t id) {
+    switch (id) {
+        case static_cast<uint32_t>(HashAlgorithm::SHA256): return HashAlgorithm::SHA256;
+        case static_cast<uint32_t>(HashAlgorithm::BLAKE3): return HashAlgorithm::BLAKE3;
+        default: return std::nullopt;
+    }
+}
+
+Digest Hash::sha256Digest(std::span<const uint8_t> data) {
+    Digest digest;
+    SHA256(data.data(), data.size(), digest.data());
+    return digest;
+}
+
+std::optional<Digest> Hash::sha256FileDigest(const std::string& filepath) {
+    return fileDigest(HashAlgorithm::SHA256, filepath);
+}
+
+std::string Hash::sha256(std::span<const uint8_t> data) {
+    return sha256Digest(data).toHex();
+}
+
+std::string Hash::sha256(const std::vector<uint8_t>& data) {
+    return sha256(std::span<const uint8_t>(data));
 }
 
 std::string Hash::sha256(const std::string& data) {
-    std::vector<uint8_t> vec(data.begin(), data.end());
-    return sha256(vec);
+    return sha256(std::span<const uint8_t>(
+        reinterpret_cast<const uint8_t*>(data.data()), data.size()));
 }
 
 std::string Hash::sha256File(const std::string& filepath) {
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file) {
-        return "";
-    }
-    
-    SHA256_CTX ctx;
-    SHA256_Init(&ctx);
-    
-    constexpr size_t buffer_size = 8192;
-    char buffer[buffer_size];
-    
-    while (file.read(buffer, buffer_size) || file.gcount() > 0) {
-        SHA256_Update(&ctx, buffer, file.gcount());
+    auto digest = sha256FileDigest(filepath);
+    return digest ? digest->toHex() : "";
+}
+
+// Incremental SHA256 implementation
+Hash::Sha256Stream::Sha256Stream() : ctx_(EVP_MD_CTX_new()) {
+    EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr);
+}
+
+Hash::Sha256Stream::~Sha256Stream() {
+    EVP_MD_CTX_free(ctx_);
+}
+
+void Hash::Sha256Stream::update(std::span<const uint8_t> data) {
+    EVP_DigestUpdate(ctx_, data.data(), data.size());
+}
+
+Digest Hash::Sha256Stream::finish() {
+    Digest digest;
+    EVP_DigestFinal_ex(ctx_, digest.data(), nullptr);
+    EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr);
+    return digest;
+}
+
+// Runtime-selected stream
+Hash::Stream::Stream(HashAlgorithm algorithm) : algorithm_(algorithm) {
+    if (algorithm_ == HashAlgorithm::BLAKE3) {
+        blake3_ = std::make_unique<Blake3Stream>();
+    } else {
+        sha256_ = std::make_unique<Sha256Stream>();
     }
-    
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_Final(hash, &ctx);
-    
-    std::stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
+}
+
+Hash::Stream::~Stream() = default;
+
+void Hash::Stream::update(std::span<const uint8_t> data) {
+    if (blake3_) {
+        blake3_->update(data);
+    } else {
+        sha256_->update(data);
     }
-    return ss.str();
+}
+
+Digest Hash::Stream::finish() {
+    return blake3_ ? blake3_->finish() : sha256_->finish();
 }
 
 // Rolling Hash implementation
@@ -69,4 +153,9 @@ void Hash::RollingHash::append(uint8_t byte) {
     hash_ = (hash_ * kPrime + byte) % kMod;
 }
 
+// Gear hash implementation
+const std::array<uint64_t, 256>& Hash::GearHash::table() {
+    return kGearTable;
+}
+
 } // namespace dropboxlite
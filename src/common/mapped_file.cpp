@@ -0,0 +1,60 @@
+#include "common/mapped_file.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dropboxlite {
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& filepath) {
+    close();
+    
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    
+    // mmap rejects zero-length mappings
+    if (st.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+    
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps its own reference
+    
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    
+    data_ = static_cast<uint8_t*>(addr);
+    size_ = static_cast<size_t>(st.st_size);
+    
+    // Hints only; failures are harmless
+    madvise(addr, size_, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(addr, size_, MADV_HUGEPAGE);
+#endif
+    
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    size_ = 0;
+}
+
+} // namespace dropboxlite
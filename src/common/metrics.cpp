@@ -1,122 +1,480 @@
 #include "common/metrics.h"
+#include "common/logger.h"
+#include <algorithm>
+#include <charconv>
 #include <sstream>
 #include <iomanip>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
 
 namespace dropboxlite {
 
-Metrics& Metrics::instance() {
-    static Metrics metrics;
-    return metrics;
+namespace detail {
+
+size_t nextMetricShard() {
+    static std::atomic<size_t> next{0};
+    return next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
 }
 
-void Metrics::incrementCounter(const std::string& name, int64_t value) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    counters_[name] += value;
+} // namespace detail
+
+namespace {
+
+int64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-int64_t Metrics::getCounter(const std::string& name) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = counters_.find(name);
-    return it != counters_.end() ? it->second.load() : 0;
+} // namespace
+
+int64_t Counter::value() const {
+    int64_t total = 0;
+    for (const auto& shard : shards_) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
 }
 
-void Metrics::setGauge(const std::string& name, int64_t value) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    gauges_[name] = value;
+void Counter::reset() {
+    for (auto& shard : shards_) {
+        shard.value.store(0, std::memory_order_relaxed);
+    }
 }
 
-int64_t Metrics::getGauge(const std::string& name) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = gauges_.find(name);
-    return it != gauges_.end() ? it->second.load() : 0;
+size_t HistogramSnapshot::bucketCount(int precision_bits) {
+    return static_cast<size_t>(kMaxExponent - precision_bits + 1) << precision_bits;
 }
 
-void Metrics::recordLatency(const std::string& name, std::chrono::microseconds duration) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto& stats = latencies_[name];
+size_t HistogramSnapshot::bucketOf(int64_t value, int precision_bits) {
+    const int64_t sub_buckets = int64_t{1} << precision_bits;
+    if (value < sub_buckets) {
+        return value < 0 ? 0 : static_cast<size_t>(value);
+    }
+    value = std::min(value, (int64_t{1} << kMaxExponent) - 1);
+    int exponent = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+    int shift = exponent - precision_bits;
+    return static_cast<size_t>(shift + 1) * sub_buckets + ((value >> shift) - sub_buckets);
+}
+
+int64_t HistogramSnapshot::bucketTop(size_t bucket, int precision_bits) {
+    const size_t sub_buckets = size_t{1} << precision_bits;
+    if (bucket < sub_buckets) {
+        return static_cast<int64_t>(bucket);
+    }
+    int shift = static_cast<int>(bucket / sub_buckets) - 1;
+    int64_t mantissa = static_cast<int64_t>(bucket % sub_buckets + sub_buckets);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+HistogramSnapshot::HistogramSnapshot(int precision_bits)
+    : precision_bits_(std::clamp(precision_bits, 1, 10)),
+      buckets_(bucketCount(precision_bits_), 0) {}
+
+void HistogramSnapshot::addBuckets(const std::atomic<uint64_t>* buckets, int64_t bucket_sum,
+                                   int64_t bucket_min, int64_t bucket_max) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < buckets_.size(); i++) {
+        uint64_t samples = buckets[i].load(std::memory_order_relaxed);
+        buckets_[i] += samples;
+        total += samples;
+    }
+    // A sample still being recorded may be in a bucket but not yet in
+    // the extremes
+    if (total == 0 || bucket_min > bucket_max) {
+        count += total;
+        return;
+    }
+    min = count ? std::min(min, bucket_min) : bucket_min;
+    max = count ? std::max(max, bucket_max) : bucket_max;
+    count += total;
+    sum += bucket_sum;
+}
+
+int64_t HistogramSnapshot::percentile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * count));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < buckets_.size(); bucket++) {
+        seen += buckets_[bucket];
+        if (seen >= rank) {
+            return std::max(min, std::min(bucketTop(bucket, precision_bits_), max));
+        }
+    }
+    return max;
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other) {
+    if (other.count == 0) {
+        return;
+    }
+    min = count ? std::min(min, other.min) : other.min;
+    max = count ? std::max(max, other.max) : other.max;
+    count += other.count;
+    sum += other.sum;
+    for (size_t bucket = 0; bucket < other.buckets_.size(); bucket++) {
+        if (other.buckets_[bucket] == 0) {
+            continue;
+        }
+        size_t target = other.precision_bits_ == precision_bits_ ? bucket :
+            bucketOf(bucketTop(bucket, other.precision_bits_), precision_bits_);
+        buckets_[target] += other.buckets_[bucket];
+    }
+}
+
+void HistogramSnapshot::clear(int precision_bits) {
+    count = sum = min = max = 0;
+    precision_bits_ = std::clamp(precision_bits, 1, 10);
+    buckets_.assign(bucketCount(precision_bits_), 0);
+}
+
+namespace {
+
+// Sum and extremes of one shard or slice; the count is the buckets' total
+struct HistogramTotals {
+    std::atomic<int64_t> sum{0};
+    std::atomic<int64_t> min{INT64_MAX};
+    std::atomic<int64_t> max{INT64_MIN};
     
-    int64_t us = duration.count();
-    stats.count++;
-    stats.sum_us += us;
+    void record(int64_t value) {
+        sum.fetch_add(value, std::memory_order_relaxed);
+        int64_t current_min = min.load(std::memory_order_relaxed);
+        while (value < current_min &&
+               !min.compare_exchange_weak(current_min, value, std::memory_order_relaxed));
+        int64_t current_max = max.load(std::memory_order_relaxed);
+        while (value > current_max &&
+               !max.compare_exchange_weak(current_max, value, std::memory_order_relaxed));
+    }
     
-    // Update min
-    int64_t current_min = stats.min_us.load();
-    while (us < current_min && !stats.min_us.compare_exchange_weak(current_min, us));
+    void clear() {
+        sum.store(0, std::memory_order_relaxed);
+        min.store(INT64_MAX, std::memory_order_relaxed);
+        max.store(INT64_MIN, std::memory_order_relaxed);
+    }
+};
+
+} // namespace
+
+struct Histogram::Shard {
+    explicit Shard(size_t buckets) : counts(new std::atomic<uint64_t>[buckets]()) {}
     
-    // Update max
-    int64_t current_max = stats.max_us.load();
-    while (us > current_max && !stats.max_us.compare_exchange_weak(current_max, us));
+    HistogramTotals totals;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+};
+
+Histogram::Histogram(const HistogramOptions& options)
+    : precision_bits_(std::clamp(options.precision_bits, 1, 10)) {
+    for (std::chrono::seconds window : options.windows) {
+        windows_.push_back(std::make_unique<WindowedHistogram>(window, precision_bits_));
+    }
 }
 
-void Metrics::recordBytes(const std::string& name, size_t bytes) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto& stats = throughput_[name];
-    
-    if (stats.total_bytes == 0) {
-        stats.start_time = std::chrono::steady_clock::now();
+Histogram::~Histogram() {
+    for (auto& shard : shards_) {
+        delete shard.load(std::memory_order_relaxed);
     }
-    
-    stats.total_bytes += bytes;
 }
 
-double Metrics::getBytesPerSecond(const std::string& name) const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = throughput_.find(name);
+Histogram::Shard& Histogram::shard() {
+    std::atomic<Shard*>& slot = shards_[detail::metricShard()];
+    Shard* shard = slot.load(std::memory_order_acquire);
+    if (!shard) {
+        // First record from this shard's threads; a racing shard-mate may
+        // install its own first
+        auto created = std::make_unique<Shard>(HistogramSnapshot::bucketCount(precision_bits_));
+        if (slot.compare_exchange_strong(shard, created.get(), std::memory_order_acq_rel)) {
+            shard = created.release();
+        }
+    }
+    return *shard;
+}
+
+void Histogram::record(int64_t value) {
+    Shard& local = shard();
+    local.counts[HistogramSnapshot::bucketOf(value, precision_bits_)].fetch_add(
+        1, std::memory_order_relaxed);
+    local.totals.record(value);
+    for (auto& window : windows_) {
+        window->record(value);
+    }
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snapshot(precision_bits_);
+    this->snapshot(snapshot);
+    return snapshot;
+}
+
+void Histogram::snapshot(Snapshot& into) const {
+    into.clear(precision_bits_);
+    for (const auto& slot : shards_) {
+        if (const Shard* shard = slot.load(std::memory_order_acquire)) {
+            into.addBuckets(shard->counts.get(), shard->totals.sum.load(std::memory_order_relaxed),
+                            shard->totals.min.load(std::memory_order_relaxed),
+                            shard->totals.max.load(std::memory_order_relaxed));
+        }
+    }
+}
+
+void Histogram::reset() {
+    size_t buckets = HistogramSnapshot::bucketCount(precision_bits_);
+    for (auto& slot : shards_) {
+        if (Shard* shard = slot.load(std::memory_order_acquire)) {
+            for (size_t i = 0; i < buckets; i++) {
+                shard->counts[i].store(0, std::memory_order_relaxed);
+            }
+            shard->totals.clear();
+        }
+    }
+    for (auto& window : windows_) {
+        window->reset();
+    }
+}
+
+struct WindowedHistogram::Slice {
+    // Sentinel epoch while a writer clears the slice for reuse
+    static constexpr int64_t kClearing = -1;
     
-    if (it == throughput_.end() || it->second.total_bytes == 0) {
-        return 0.0;
+    explicit Slice(size_t buckets) : counts(new std::atomic<uint64_t>[buckets]()) {}
+    
+    std::atomic<int64_t> epoch{INT64_MIN};
+    HistogramTotals totals;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+};
+
+WindowedHistogram::WindowedHistogram(std::chrono::seconds window, int precision_bits, size_t slices)
+    : window_(window),
+      precision_bits_(std::clamp(precision_bits, 1, 10)) {
+    slices = std::max<size_t>(1, slices);
+    slice_ns_ = std::max<int64_t>(1, std::chrono::nanoseconds(window).count() / slices);
+    for (size_t i = 0; i < slices; i++) {
+        slices_.push_back(std::make_unique<Slice>(HistogramSnapshot::bucketCount(precision_bits_)));
     }
+}
+
+WindowedHistogram::~WindowedHistogram() = default;
+
+void WindowedHistogram::record(int64_t value) {
+    int64_t epoch = nowNanos() / slice_ns_;
+    Slice& slice = *slices_[epoch % slices_.size()];
     
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::steady_clock::now() - it->second.start_time
-    ).count();
+    // The first writer of a new epoch clears the slice left from a full
+    // ring ago. A writer that read the old epoch just before may still
+    // land its sample after the clear, where it counts toward the new
+    // slice.
+    int64_t seen = slice.epoch.load(std::memory_order_acquire);
+    while (seen < epoch) {
+        if (seen == Slice::kClearing) {
+            std::this_thread::yield();
+            seen = slice.epoch.load(std::memory_order_acquire);
+            continue;
+        }
+        if (slice.epoch.compare_exchange_weak(seen, Slice::kClearing, std::memory_order_acquire)) {
+            size_t buckets = HistogramSnapshot::bucketCount(precision_bits_);
+            for (size_t i = 0; i < buckets; i++) {
+                slice.counts[i].store(0, std::memory_order_relaxed);
+            }
+            slice.totals.clear();
+            slice.epoch.store(epoch, std::memory_order_release);
+            break;
+        }
+    }
     
-    if (elapsed == 0) {
+    slice.counts[HistogramSnapshot::bucketOf(value, precision_bits_)].fetch_add(
+        1, std::memory_order_relaxed);
+    slice.totals.record(value);
+}
+
+HistogramSnapshot WindowedHistogram::snapshot() const {
+    HistogramSnapshot snapshot(precision_bits_);
+    this->snapshot(snapshot);
+    return snapshot;
+}
+
+void WindowedHistogram::snapshot(HistogramSnapshot& into) const {
+    into.clear(precision_bits_);
+    int64_t now = nowNanos() / slice_ns_;
+    int64_t oldest = now - static_cast<int64_t>(slices_.size()) + 1;
+    for (const auto& slice : slices_) {
+        int64_t epoch = slice->epoch.load(std::memory_order_acquire);
+        if (epoch >= oldest && epoch <= now) {
+            into.addBuckets(slice->counts.get(), slice->totals.sum.load(std::memory_order_relaxed),
+                            slice->totals.min.load(std::memory_order_relaxed),
+                            slice->totals.max.load(std::memory_order_relaxed));
+        }
+    }
+}
+
+void WindowedHistogram::reset() {
+    for (auto& slice : slices_) {
+        slice->epoch.store(INT64_MIN, std::memory_order_release);
+    }
+}
+
+void Throughput::add(size_t bytes) {
+    if (start_ns_.load(std::memory_order_relaxed) == 0) {
+        int64_t unset = 0;
+        start_ns_.compare_exchange_strong(unset, nowNanos(), std::memory_order_relaxed);
+    }
+    bytes_.add(static_cast<int64_t>(bytes));
+}
+
+double Throughput::bytesPerSecond() const {
+    int64_t start = start_ns_.load(std::memory_order_relaxed);
+    if (start == 0) {
         return 0.0;
     }
-    
-    return static_cast<double>(it->second.total_bytes) / elapsed;
+    double seconds = (nowNanos() - start) / 1e9;
+    if (seconds <= 0) {
+        return 0.0;
+    }
+    return static_cast<double>(totalBytes()) / seconds;
+}
+
+void Throughput::reset() {
+    bytes_.reset();
+    start_ns_.store(0, std::memory_order_relaxed);
+}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+template<typename T, typename... Args>
+T& Metrics::lookup(Registry<T>& registry, std::string_view suffix, const std::string& name,
+                   const Args&... args) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = registry.find(name);
+        if (it != registry.end()) {
+            return *it->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto& entry = registry[name];
+    if (!entry) {
+        entry = std::make_unique<T>(args...);
+        std::string family;
+        openmetrics::appendName(family, name, suffix);
+        if (!families_.insert(family).second) {
+            unexported_.insert(entry.get());
+            LOG_WARNING("Metric " + name + " not exported: family " + family + " is taken");
+        }
+    }
+    return *entry;
+}
+
+template<typename T>
+const T* Metrics::find(const Registry<T>& registry, const std::string& name) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = registry.find(name);
+    return it != registry.end() ? it->second.get() : nullptr;
+}
+
+Counter& Metrics::counter(const std::string& name) {
+    return lookup(counters_, "", name);
+}
+
+Gauge& Metrics::gauge(const std::string& name) {
+    return lookup(gauges_, "", name);
+}
+
+Histogram& Metrics::histogram(const std::string& name, const HistogramOptions& options) {
+    return lookup(latencies_, "", name, options);
+}
+
+Throughput& Metrics::throughput(const std::string& name) {
+    return lookup(throughput_, "_bytes", name);
+}
+
+void Metrics::incrementCounter(const std::string& name, int64_t value) {
+    counter(name).add(value);
+}
+
+int64_t Metrics::getCounter(const std::string& name) const {
+    const Counter* counter = find(counters_, name);
+    return counter ? counter->value() : 0;
+}
+
+void Metrics::setGauge(const std::string& name, int64_t value) {
+    gauge(name).set(value);
+}
+
+int64_t Metrics::getGauge(const std::string& name) const {
+    const Gauge* gauge = find(gauges_, name);
+    return gauge ? gauge->value() : 0;
+}
+
+void Metrics::recordLatency(const std::string& name, std::chrono::microseconds duration) {
+    histogram(name).record(duration);
+}
+
+void Metrics::recordBytes(const std::string& name, size_t bytes) {
+    throughput(name).add(bytes);
+}
+
+double Metrics::getBytesPerSecond(const std::string& name) const {
+    const Throughput* throughput = find(throughput_, name);
+    return throughput ? throughput->bytesPerSecond() : 0.0;
 }
 
 std::string Metrics::toString() const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_lock<std::shared_mutex> lock(mutex_);
     std::stringstream ss;
     
     ss << "=== Metrics ===\n";
     
     if (!counters_.empty()) {
         ss << "\nCounters:\n";
-        for (const auto& [name, value] : counters_) {
-            ss << "  " << name << ": " << value.load() << "\n";
+        for (const auto& [name, counter] : counters_) {
+            ss << "  " << name << ": " << counter->value() << "\n";
         }
     }
     
     if (!gauges_.empty()) {
         ss << "\nGauges:\n";
-        for (const auto& [name, value] : gauges_) {
-            ss << "  " << name << ": " << value.load() << "\n";
+        for (const auto& [name, gauge] : gauges_) {
+            ss << "  " << name << ": " << gauge->value() << "\n";
         }
     }
     
     if (!latencies_.empty()) {
         ss << "\nLatencies:\n";
-        for (const auto& [name, stats] : latencies_) {
-            int64_t count = stats.count.load();
-            if (count > 0) {
-                double avg = static_cast<double>(stats.sum_us.load()) / count;
+        auto percentiles = [&ss](const Histogram::Snapshot& stats) {
+            ss << "p50=" << stats.percentile(0.50) << " p90=" << stats.percentile(0.90)
+               << " p99=" << stats.percentile(0.99) << " p999=" << stats.percentile(0.999);
+        };
+        for (const auto& [name, histogram] : latencies_) {
+            Histogram::Snapshot stats = histogram->snapshot();
+            if (stats.count > 0) {
                 ss << "  " << name << ":\n";
-                ss << "    count: " << count << "\n";
-                ss << "    avg: " << std::fixed << std::setprecision(2) << avg << " μs\n";
-                ss << "    min: " << stats.min_us.load() << " μs\n";
-                ss << "    max: " << stats.max_us.load() << " μs\n";
+                ss << "    count: " << stats.count << "\n";
+                ss << "    avg: " << std::fixed << std::setprecision(2) << stats.mean() << " μs\n";
+                ss << "    min: " << stats.min << " μs\n";
+                ss << "    max: " << stats.max << " μs\n";
+                ss << "    ";
+                percentiles(stats);
+                ss << " μs\n";
+                for (const auto& window : histogram->windows()) {
+                    Histogram::Snapshot recent = window->snapshot();
+                    ss << "    last " << window->window().count() << "s: count=" << recent.count << " ";
+                    percentiles(recent);
+                    ss << " μs\n";
+                }
             }
         }
     }
     
     if (!throughput_.empty()) {
         ss << "\nThroughput:\n";
-        for (const auto& [name, stats] : throughput_) {
-            double bps = getBytesPerSecond(name);
+        for (const auto& [name, throughput] : throughput_) {
+            double bps = throughput->bytesPerSecond();
             ss << "  " << name << ": " << std::fixed << std::setprecision(2) 
                << (bps / 1024.0 / 1024.0) << " MB/s\n";
         }
@@ -125,12 +483,197 @@ std::string Metrics::toString() const {
     return ss.str();
 }
 
+namespace openmetrics {
+
+// Appended in place, so a scrape allocates only when out has to grow
+
+void appendName(std::string& out, std::string_view name, std::string_view suffix) {
+    if (name.empty() || (name[0] >= '0' && name[0] <= '9')) {
+        out += '_';
+    }
+    for (char c : name) {
+        bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                     (c >= '0' && c <= '9') || c == '_' || c == ':';
+        out += valid ? c : '_';
+    }
+    out += suffix;
+}
+
+void appendFamily(std::string& out, std::string_view name, std::string_view suffix,
+                  std::string_view type) {
+    out += "# TYPE ";
+    appendName(out, name, suffix);
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void appendLabel(std::string& labels, std::string_view key, std::string_view value) {
+    if (!labels.empty()) {
+        labels += ',';
+    }
+    labels += key;
+    labels += "=\"";
+    for (char c : value) {
+        switch (c) {
+            case '\\': labels += "\\\\"; break;
+            case '"': labels += "\\\""; break;
+            case '\n': labels += "\\n"; break;
+            default: labels += c;
+        }
+    }
+    labels += '"';
+}
+
+void appendSample(std::string& out, std::string_view name, std::string_view suffix,
+                  std::string_view labels, int64_t value) {
+    appendName(out, name, suffix);
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+    out += '\n';
+}
+
+void appendFloatSample(std::string& out, std::string_view name, std::string_view suffix,
+                       std::string_view labels, double value) {
+    appendName(out, name, suffix);
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+    out += '\n';
+}
+
+std::vector<std::string> dropDuplicateFamilies(std::string& text, size_t from) {
+    constexpr std::string_view kType = "# TYPE ";
+    std::unordered_set<std::string_view> seen;
+    std::vector<std::pair<size_t, size_t>> duplicates;  // [begin, end) in text
+    std::vector<std::string> dropped;
+    
+    size_t line = text.compare(0, kType.size(), kType) == 0 ? 0 : text.find("\n# TYPE ");
+    while (line != std::string::npos) {
+        size_t begin = text[line] == '\n' ? line + 1 : line;
+        size_t name = begin + kType.size();
+        size_t name_end = text.find(' ', name);
+        size_t next = text.find("\n# TYPE ", begin);
+        size_t end = next == std::string::npos ? text.size() : next + 1;
+        if (name_end == std::string::npos || name_end > end) {
+            break;
+        }
+        std::string_view family(text.data() + name, name_end - name);
+        if (!seen.insert(family).second && begin >= from) {
+            duplicates.emplace_back(begin, end);
+            dropped.emplace_back(family);
+        }
+        line = next;
+    }
+    
+    // Back to front, so earlier offsets stay valid
+    for (auto it = duplicates.rbegin(); it != duplicates.rend(); ++it) {
+        text.erase(it->first, it->second - it->first);
+    }
+    return dropped;
+}
+
+} // namespace openmetrics
+
+namespace {
+
+// window is a pre-rendered `window="<n>s"` label or empty
+void appendSummary(std::string& out, const std::string& name, std::string_view window,
+                   const HistogramSnapshot& stats) {
+    static constexpr std::pair<const char*, double> kQuantiles[] = {
+        {"0.5", 0.50}, {"0.9", 0.90}, {"0.99", 0.99}, {"0.999", 0.999}};
+    char labels[64];
+    for (const auto& [quantile, q] : kQuantiles) {
+        int length = std::snprintf(labels, sizeof(labels), "%.*s%squantile=\"%s\"",
+                                   static_cast<int>(window.size()), window.data(),
+                                   window.empty() ? "" : ",", quantile);
+        openmetrics::appendSample(out, name, "", std::string_view(labels, length), stats.percentile(q));
+    }
+    openmetrics::appendSample(out, name, "_sum", window, stats.sum);
+    openmetrics::appendSample(out, name, "_count", window, stats.count);
+}
+
+} // namespace
+
+void Metrics::appendOpenMetrics(std::string& out) const {
+    using namespace openmetrics;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    
+    for (const auto& [name, counter] : counters_) {
+        if (!exported(counter.get())) {
+            continue;
+        }
+        appendFamily(out, name, "", "counter");
+        appendSample(out, name, "_total", "", counter->value());
+    }
+    
+    for (const auto& [name, gauge] : gauges_) {
+        if (!exported(gauge.get())) {
+            continue;
+        }
+        appendFamily(out, name, "", "gauge");
+        appendSample(out, name, "", "", gauge->value());
+    }
+    
+    // One snapshot's buckets serve every histogram and window in turn
+    HistogramSnapshot stats;
+    char window_label[32];
+    for (const auto& [name, histogram] : latencies_) {
+        if (!exported(histogram.get())) {
+            continue;
+        }
+        appendFamily(out, name, "", "summary");
+        histogram->snapshot(stats);
+        appendSummary(out, name, "", stats);
+        for (const auto& window : histogram->windows()) {
+            window->snapshot(stats);
+            int length = std::snprintf(window_label, sizeof(window_label), "window=\"%llds\"",
+                                       static_cast<long long>(window->window().count()));
+            appendSummary(out, name, std::string_view(window_label, length), stats);
+        }
+    }
+    
+    for (const auto& [name, throughput] : throughput_) {
+        if (!exported(throughput.get())) {
+            continue;
+        }
+        appendFamily(out, name, "_bytes", "counter");
+        appendSample(out, name, "_bytes_total", "", static_cast<int64_t>(throughput->totalBytes()));
+    }
+}
+
+void Metrics::writeOpenMetrics(std::string& out) const {
+    appendOpenMetrics(out);
+    out += "# EOF\n";
+}
+
 void Metrics::reset() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    counters_.clear();
-    gauges_.clear();
-    latencies_.clear();
-    throughput_.clear();
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    for (auto& [name, counter] : counters_) {
+        counter->reset();
+    }
+    for (auto& [name, gauge] : gauges_) {
+        gauge->set(0);
+    }
+    for (auto& [name, histogram] : latencies_) {
+        histogram->reset();
+    }
+    for (auto& [name, throughput] : throughput_) {
+        throughput->reset();
+    }
 }
 
 } // namespace dropboxlite
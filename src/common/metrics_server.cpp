@@ -0,0 +1,270 @@
+#include "common/metrics_server.h"
+#include "common/logger.h"
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace dropboxlite {
+
+namespace {
+
+constexpr const char* kContentType = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+bool sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+int64_t countOpenFds() {
+    DIR* dir = ::opendir("/proc/self/fd");
+    if (!dir) {
+        return -1;
+    }
+    int64_t count = 0;
+    while (dirent* entry = ::readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    ::closedir(dir);
+    // Not counting the one opendir used
+    return count - 1;
+}
+
+} // namespace
+
+std::optional<ProcessStats> ProcessStats::read() {
+    char line[1024];
+    std::FILE* file = std::fopen("/proc/self/stat", "r");
+    if (!file) {
+        return std::nullopt;
+    }
+    size_t size = std::fread(line, 1, sizeof(line) - 1, file);
+    std::fclose(file);
+    line[size] = '\0';
+    // Fields after the command name, which may itself hold spaces or ')'
+    const char* fields = std::strrchr(line, ')');
+    if (!fields) {
+        return std::nullopt;
+    }
+
+    unsigned long long utime, stime, vsize;
+    long long threads, rss;
+    int parsed = std::sscanf(fields + 2,
+                             "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %lld %*d %*u %llu %lld",
+                             &utime, &stime, &threads, &vsize, &rss);
+    if (parsed != 5) {
+        return std::nullopt;
+    }
+
+    ProcessStats stats;
+    long ticks = ::sysconf(_SC_CLK_TCK);
+    stats.cpu_seconds = ticks > 0 ? static_cast<double>(utime + stime) / ticks : 0;
+    stats.threads = threads;
+    stats.virtual_bytes = static_cast<int64_t>(vsize);
+    stats.resident_bytes = rss * ::sysconf(_SC_PAGESIZE);
+    stats.open_fds = countOpenFds();
+    rlimit limit;
+    stats.max_fds = ::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY ?
+        static_cast<int64_t>(limit.rlim_cur) : -1;
+    return stats;
+}
+
+MetricsServer::MetricsServer()
+    : resident_bytes_(Metrics::instance().gauge("process.resident_bytes")),
+      virtual_bytes_(Metrics::instance().gauge("process.virtual_bytes")),
+      open_fds_(Metrics::instance().gauge("process.open_fds")),
+      max_fds_(Metrics::instance().gauge("process.max_fds")),
+      threads_(Metrics::instance().gauge("process.threads")) {}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(uint16_t port, const std::string& address) {
+    if (thread_.joinable()) {
+        return false;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        LOG_ERROR("Invalid metrics address: " + address);
+        return false;
+    }
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create metrics socket: " + std::string(std::strerror(errno)));
+        return false;
+    }
+    int reuse = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    socklen_t length = sizeof(addr);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(fd, 16) != 0 ||
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+        LOG_ERROR("Failed to listen for metrics on " + address + ":" + std::to_string(port) +
+                  ": " + std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    listen_fd_ = fd;
+    port_.store(ntohs(addr.sin_port), std::memory_order_relaxed);
+    stop_.store(false, std::memory_order_relaxed);
+    thread_ = std::thread([this] { run(); });
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    stop_.store(true, std::memory_order_relaxed);
+    // Wakes the blocked accept()
+    ::shutdown(listen_fd_, SHUT_RDWR);
+    thread_.join();
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    port_.store(0, std::memory_order_relaxed);
+}
+
+void MetricsServer::addCollector(std::function<void()> collector) {
+    std::lock_guard<std::mutex> lock(collectors_mutex_);
+    collectors_.push_back(std::move(collector));
+}
+
+void MetricsServer::addExporter(std::function<void(std::string&)> exporter) {
+    std::lock_guard<std::mutex> lock(collectors_mutex_);
+    exporters_.push_back(std::move(exporter));
+}
+
+std::string MetricsServer::scrape() {
+    std::lock_guard<std::mutex> lock(render_mutex_);
+    render();
+    return body_;
+}
+
+void MetricsServer::render() {
+    auto stats = ProcessStats::read();
+    if (stats) {
+        resident_bytes_.set(stats->resident_bytes);
+        virtual_bytes_.set(stats->virtual_bytes);
+        open_fds_.set(stats->open_fds);
+        max_fds_.set(stats->max_fds);
+        threads_.set(stats->threads);
+    }
+    std::lock_guard<std::mutex> lock(collectors_mutex_);
+    for (auto& collector : collectors_) {
+        collector();
+    }
+    body_.clear();
+    Metrics::instance().appendOpenMetrics(body_);
+    size_t registered_end = body_.size();
+    if (stats) {
+        // Registry counters are integers added to; this total is read whole
+        openmetrics::appendFamily(body_, "process_cpu_seconds", "", "counter");
+        openmetrics::appendFloatSample(body_, "process_cpu_seconds", "_total", "",
+                                       stats->cpu_seconds);
+    }
+    for (auto& exporter : exporters_) {
+        exporter(body_);
+    }
+    // The registry keeps its own names unique; families added here must
+    // not repeat them or each other
+    for (auto& family : openmetrics::dropDuplicateFamilies(body_, registered_end)) {
+        if (reported_duplicates_.insert(family).second) {
+            LOG_WARNING("Duplicate metric family left out of scrapes: " + family);
+        }
+    }
+    body_ += "# EOF\n";
+}
+
+void MetricsServer::run() {
+    while (!stop_.load(std::memory_order_relaxed)) {
+        int client = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno != EINTR && !stop_.load(std::memory_order_relaxed)) {
+                // e.g. out of fds; back off rather than spin
+                LOG_WARNING("Metrics accept failed: " + std::string(std::strerror(errno)));
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            continue;
+        }
+        serve(client);
+        ::close(client);
+    }
+}
+
+void MetricsServer::serve(int client) {
+    // A stalled scraper must not hold up the next one for long
+    timeval timeout{2, 0};
+    ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters; headers are read and ignored
+    char request[2048];
+    size_t size = 0;
+    while (size < sizeof(request) - 1) {
+        ssize_t received = ::recv(client, request + size, sizeof(request) - 1 - size, 0);
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        size += static_cast<size_t>(received);
+        request[size] = '\0';
+        if (std::strstr(request, "\r\n\r\n")) {
+            break;
+        }
+    }
+    request[size] = '\0';
+
+    bool head = std::strncmp(request, "HEAD ", 5) == 0;
+    const char* path = head ? request + 5 : std::strncmp(request, "GET ", 4) == 0 ? request + 4 : nullptr;
+    size_t path_length = path ? std::strcspn(path, " ?\r\n") : 0;
+    bool found = path && ((path_length == 8 && std::strncmp(path, "/metrics", 8) == 0) ||
+                          (path_length == 1 && path[0] == '/'));
+
+    char header[256];
+    int header_length;
+    std::lock_guard<std::mutex> lock(render_mutex_);
+    if (found) {
+        render();
+        header_length = std::snprintf(header, sizeof(header),
+                                      "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+                                      "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                                      kContentType, body_.size());
+    } else {
+        header_length = std::snprintf(header, sizeof(header),
+                                      "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                                      path ? "404 Not Found" :
+                                             "405 Method Not Allowed\r\nAllow: GET, HEAD");
+    }
+    if (sendAll(client, header, static_cast<size_t>(header_length)) && found && !head) {
+        sendAll(client, body_.data(), body_.size());
+    }
+}
+
+} // namespace dropboxlite
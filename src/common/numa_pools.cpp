@@ -0,0 +1,51 @@
+#include "common/numa_pools.h"
+#include "common/logger.h"
+#include <algorithm>
+#include <string>
+
+namespace dropboxlite {
+
+NumaPools::NumaPools(const NumaTopology& topology, size_t threads_per_node)
+    : topology_(topology) {
+    for (const NumaNode& node : topology_.nodes()) {
+        size_t threads = threads_per_node ? threads_per_node : node.cpus.size();
+        pools_.push_back(std::make_unique<ThreadPool>(threads));
+        if (!pools_.back()->pinWorkers(node.cpus)) {
+            LOG_WARNING("Could not pin workers to NUMA node " + std::to_string(node.id));
+        }
+
+        if (static_cast<size_t>(node.id) >= pool_of_node_.size()) {
+            pool_of_node_.resize(node.id + 1, -1);
+        }
+        pool_of_node_[node.id] = static_cast<int>(pools_.size() - 1);
+    }
+}
+
+ThreadPool& NumaPools::pool(int node) {
+    if (node < 0 || static_cast<size_t>(node) >= pool_of_node_.size() || pool_of_node_[node] < 0) {
+        node = topology_.currentNode();
+        if (node < 0 || static_cast<size_t>(node) >= pool_of_node_.size() ||
+            pool_of_node_[node] < 0) {
+            return *pools_.front();
+        }
+    }
+    return *pools_[pool_of_node_[node]];
+}
+
+NodeBuffer NumaPools::allocate(size_t size, int node) {
+    return NodeBuffer(size, node < 0 ? topology_.currentNode() : node);
+}
+
+void NumaPools::publishMetrics() const {
+    for (size_t i = 0; i < pools_.size(); i++) {
+        pools_[i]->publishMetrics("thread_pool.node" + std::to_string(topology_.nodes()[i].id));
+    }
+}
+
+void NumaPools::wait() {
+    for (auto& pool : pools_) {
+        pool->wait();
+    }
+}
+
+} // namespace dropboxlite
@@ -0,0 +1,220 @@
+#include "common/numa_topology.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <thread>
+#include <utility>
+#include <cstdint>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace dropboxlite {
+
+namespace {
+
+// Bits in the node masks passed to mbind
+constexpr unsigned long kMaxNodes = 1024;
+constexpr size_t kMaskWords = kMaxNodes / (8 * sizeof(unsigned long));
+
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return cpus;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+} // namespace
+
+NumaTopology NumaTopology::detect(const std::string& root) {
+    NumaTopology topology;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(root, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+            !std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+            continue;
+        }
+        std::ifstream file(entry.path() / "cpulist");
+        std::string list;
+        if (!std::getline(file, list)) {
+            continue;
+        }
+        std::vector<int> cpus = parseCpuList(list);
+        if (!cpus.empty()) {
+            topology.nodes_.push_back({std::stoi(name.substr(4)), std::move(cpus)});
+        }
+    }
+
+    if (topology.nodes_.empty()) {
+        NumaNode node{0, {}};
+        size_t count = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t cpu = 0; cpu < count; cpu++) {
+            node.cpus.push_back(static_cast<int>(cpu));
+        }
+        topology.nodes_.push_back(std::move(node));
+    }
+    std::sort(topology.nodes_.begin(), topology.nodes_.end(),
+              [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+    topology.index();
+    return topology;
+}
+
+const NumaTopology& NumaTopology::system() {
+    static const NumaTopology topology = [] {
+        NumaTopology detected = detect();
+        std::vector<int> allowed = allowedCpus();
+        if (allowed.empty()) {
+            return detected;
+        }
+        NumaTopology restricted = detected.restrictTo(allowed);
+        return restricted.nodes_.empty() ? detected : restricted;
+    }();
+    return topology;
+}
+
+std::vector<int> NumaTopology::parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string range = list.substr(pos, end - pos);
+        pos = end + 1;
+
+        range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+        if (range.empty()) {
+            continue;
+        }
+        try {
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::exception&) {
+            return {};
+        }
+    }
+    return cpus;
+}
+
+NumaTopology NumaTopology::restrictTo(const std::vector<int>& allowed) const {
+    NumaTopology restricted;
+    for (const NumaNode& node : nodes_) {
+        NumaNode kept{node.id, {}};
+        for (int cpu : node.cpus) {
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                kept.cpus.push_back(cpu);
+            }
+        }
+        if (!kept.cpus.empty()) {
+            restricted.nodes_.push_back(std::move(kept));
+        }
+    }
+    restricted.index();
+    return restricted;
+}
+
+int NumaTopology::nodeOfCpu(int cpu) const {
+    if (cpu < 0 || static_cast<size_t>(cpu) >= cpu_to_node_.size()) {
+        return -1;
+    }
+    return cpu_to_node_[cpu];
+}
+
+int NumaTopology::currentNode() const {
+    int node = nodeOfCpu(sched_getcpu());
+    if (node < 0 && !nodes_.empty()) {
+        node = nodes_.front().id;
+    }
+    return node;
+}
+
+int NumaTopology::nodeOfAddress(const void* address) {
+    // get_mempolicy would fault an untouched page in (as the shared zero
+    // page, for anonymous memory) and report where that lives instead
+    static const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    void* page = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(address) & ~(page_size - 1));
+    unsigned char resident = 0;
+    if (mincore(page, page_size, &resident) != 0 || !(resident & 1)) {
+        return -1;
+    }
+    
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0, address, MPOL_F_NODE | MPOL_F_ADDR) != 0) {
+        return -1;
+    }
+    return node;
+}
+
+void NumaTopology::index() {
+    cpu_to_node_.clear();
+    for (const NumaNode& node : nodes_) {
+        for (int cpu : node.cpus) {
+            if (static_cast<size_t>(cpu) >= cpu_to_node_.size()) {
+                cpu_to_node_.resize(cpu + 1, -1);
+            }
+            cpu_to_node_[cpu] = node.id;
+        }
+    }
+}
+
+NodeBuffer::NodeBuffer(size_t size, int node) : size_(size), node_(node) {
+    if (size == 0) {
+        return;
+    }
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    data_ = static_cast<uint8_t*>(addr);
+
+    // Preferred rather than bound, so a full node spills over instead of
+    // failing the allocation. Nothing to undo if the kernel says no.
+    if (node >= 0 && static_cast<unsigned long>(node) < kMaxNodes) {
+        unsigned long mask[kMaskWords] = {};
+        mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+        syscall(SYS_mbind, addr, size, MPOL_PREFERRED, mask, kMaxNodes, 0);
+    }
+}
+
+NodeBuffer::~NodeBuffer() {
+    release();
+}
+
+NodeBuffer::NodeBuffer(NodeBuffer&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+      node_(std::exchange(other.node_, -1)) {}
+
+NodeBuffer& NodeBuffer::operator=(NodeBuffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        node_ = std::exchange(other.node_, -1);
+    }
+    return *this;
+}
+
+void NodeBuffer::release() {
+    if (data_) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+}
+
+} // namespace dropboxlite
@@ -1,64 +1,132 @@
 #include "common/rate_limiter.h"
+#include "common/executor.h"
 #include <thread>
 #include <algorithm>
 
 namespace dropboxlite {
 
+namespace {
+
+constexpr int64_t kNanosPerSecond = 1'000'000'000;
+
+// Nanoseconds to earn bytes at rate, rounded up so credit is never
+// created out of rounding
+int64_t nanosToEarn(size_t bytes, size_t rate) {
+    unsigned __int128 ns = (static_cast<unsigned __int128>(bytes) * kNanosPerSecond + rate - 1) / rate;
+    return static_cast<int64_t>(std::min<unsigned __int128>(ns, INT64_MAX / 4));
+}
+
+} // namespace
+
 RateLimiter::RateLimiter(size_t bytes_per_second, size_t burst_size)
     : bytes_per_second_(bytes_per_second),
       burst_size_(burst_size > 0 ? burst_size : bytes_per_second),
-      tokens_(burst_size_),
-      last_refill_(std::chrono::steady_clock::now()) {}
+      burst_ns_(0),
+      tat_ns_(0) {
+    if (bytes_per_second > 0) {
+        burst_ns_ = nanosToEarn(burst_size_, bytes_per_second);
+    }
+    // Start with a full bucket
+    tat_ns_ = nowNanos() - burst_ns_;
+}
+
+int64_t RateLimiter::nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count();
+}
+
+int64_t RateLimiter::nanosFor(size_t bytes) const {
+    return nanosToEarn(bytes, bytes_per_second_.load(std::memory_order_relaxed));
+}
 
 void RateLimiter::acquire(size_t bytes) {
-    while (!tryAcquire(bytes)) {
-        // Sleep for the time needed to accumulate required tokens
-        double tokens_needed = bytes - available();
-        double seconds_to_wait = tokens_needed / bytes_per_second_;
-        
-        auto wait_time = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::duration<double>(seconds_to_wait)
-        );
-        
-        std::this_thread::sleep_for(std::max(wait_time, std::chrono::milliseconds(1)));
-    }
+    std::this_thread::sleep_until(reserve(bytes));
 }
 
 bool RateLimiter::tryAcquire(size_t bytes) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    refill();
-    
-    double current_tokens = tokens_.load();
-    if (current_tokens >= bytes) {
-        tokens_ = current_tokens - bytes;
+    if (bytes_per_second_.load(std::memory_order_relaxed) == 0) {
         return true;
     }
+    int64_t cost = nanosFor(bytes);
+    int64_t burst = burst_ns_.load(std::memory_order_relaxed);
+    int64_t now = nowNanos();
+    int64_t tat = tat_ns_.load(std::memory_order_relaxed);
+    while (true) {
+        int64_t next = std::max(tat, now - burst) + cost;
+        if (next > now) {
+            return false;
+        }
+        if (tat_ns_.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+RateLimiter::Clock::time_point RateLimiter::reserve(size_t bytes) {
+    if (bytes_per_second_.load(std::memory_order_relaxed) == 0) {
+        return Clock::now();
+    }
+    int64_t cost = nanosFor(bytes);
+    int64_t burst = burst_ns_.load(std::memory_order_relaxed);
+    int64_t now = nowNanos();
+    int64_t tat = tat_ns_.load(std::memory_order_relaxed);
+    int64_t next;
+    do {
+        next = std::max(tat, now - burst) + cost;
+    } while (!tat_ns_.compare_exchange_weak(tat, next, std::memory_order_relaxed));
     
-    return false;
+    return Clock::time_point(std::chrono::nanoseconds(std::max(now, next)));
+}
+
+void RateLimiter::acquireAsync(size_t bytes, InlineTask done) {
+    Clock::time_point ready = reserve(bytes);
+    if (ready <= Clock::now()) {
+        done();
+        return;
+    }
+    TimerWheel* wheel = wheel_.load(std::memory_order_relaxed);
+    (wheel ? *wheel : TimerWheel::shared()).schedule(ready, std::move(done));
+}
+
+void RateLimiter::Awaiter::await_suspend(std::coroutine_handle<> handle) {
+    // As co_await executor.sleepUntil(deadline), past the ready check
+    executor.sleepUntil(deadline).await_suspend(handle);
 }
 
 void RateLimiter::setRate(size_t bytes_per_second) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // An uncapped bucket counts as full
+    size_t credit = getRate() == 0 ? bytes_per_second : available();
     bytes_per_second_ = bytes_per_second;
     burst_size_ = bytes_per_second; // Update burst size proportionally
+    if (bytes_per_second == 0) {
+        return;
+    }
+    int64_t burst = nanosToEarn(bytes_per_second, bytes_per_second);
+    burst_ns_ = burst;
+    tat_ns_ = nowNanos() - std::min(burst, nanosToEarn(credit, bytes_per_second));
 }
 
 size_t RateLimiter::available() const {
-    return static_cast<size_t>(std::max(0.0, tokens_.load()));
+    size_t rate = bytes_per_second_.load(std::memory_order_relaxed);
+    if (rate == 0) {
+        return burst_size_.load(std::memory_order_relaxed);
+    }
+    // Credit is how far the bucket's full time lies in the past, up to
+    // the burst
+    int64_t now = nowNanos();
+    int64_t idle = std::min(now - tat_ns_.load(std::memory_order_relaxed),
+                            burst_ns_.load(std::memory_order_relaxed));
+    if (idle <= 0) {
+        return 0;
+    }
+    return static_cast<size_t>(static_cast<unsigned __int128>(idle) * rate / kNanosPerSecond);
 }
 
-void RateLimiter::refill() {
-    auto now = std::chrono::steady_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(
-        now - last_refill_
-    ).count();
-    
-    double tokens_to_add = elapsed * bytes_per_second_;
-    double current_tokens = tokens_.load();
-    
-    tokens_ = std::min(current_tokens + tokens_to_add, static_cast<double>(burst_size_));
-    last_refill_ = now;
+RateLimiter::Clock::time_point RateLimiter::nextAvailable() const {
+    if (bytes_per_second_.load(std::memory_order_relaxed) == 0) {
+        return Clock::time_point::min();
+    }
+    return Clock::time_point(std::chrono::nanoseconds(tat_ns_.load(std::memory_order_relaxed)));
 }
 
 } // namespace dropboxlite
@@ -0,0 +1,441 @@
+#include "common/hash.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DROPBOXLITE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace dropboxlite {
+
+namespace {
+
+alignas(64) constexpr uint32_t kK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+constexpr uint32_t kInitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+constexpr size_t kBlockSize = 64;
+
+uint32_t loadBigEndian(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+// One message as a sequence of 64-byte blocks: full blocks straight from the
+// input, then one or two padding blocks built in tail
+struct Job {
+    const uint8_t* data;
+    size_t full_blocks;
+    size_t total_blocks;
+    size_t next_block;
+    size_t index; // Position in the batch
+    uint8_t tail[2 * kBlockSize];
+
+    void init(std::span<const uint8_t> input, size_t batch_index) {
+        data = input.data();
+        full_blocks = input.size() / kBlockSize;
+        next_block = 0;
+        index = batch_index;
+
+        size_t remainder = input.size() % kBlockSize;
+        size_t tail_blocks = remainder + 9 <= kBlockSize ? 1 : 2;
+        total_blocks = full_blocks + tail_blocks;
+
+        std::memset(tail, 0, sizeof(tail));
+        if (remainder > 0) {
+            std::memcpy(tail, data + full_blocks * kBlockSize, remainder);
+        }
+        tail[remainder] = 0x80;
+
+        uint64_t bits = static_cast<uint64_t>(input.size()) * 8;
+        uint8_t* end = tail + tail_blocks * kBlockSize;
+        for (int i = 1; i <= 8; i++) {
+            end[-i] = static_cast<uint8_t>(bits >> (8 * (i - 1)));
+        }
+    }
+
+    const uint8_t* block() const {
+        return next_block < full_blocks
+            ? data + next_block * kBlockSize
+            : tail + (next_block - full_blocks) * kBlockSize;
+    }
+
+    // Blocks left that are adjacent in memory to the current one
+    size_t contiguous() const {
+        return next_block < full_blocks ? full_blocks - next_block : total_blocks - next_block;
+    }
+
+    bool done() const { return next_block == total_blocks; }
+};
+
+Digest digestFromState(const uint32_t state[8]) {
+    Digest digest;
+    for (int i = 0; i < 8; i++) {
+        digest.bytes[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+        digest.bytes[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+        digest.bytes[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+        digest.bytes[4 * i + 3] = static_cast<uint8_t>(state[i]);
+    }
+    return digest;
+}
+
+// Portable compression, used to finish lanes once too few remain to fill
+// the vector kernel
+void compressScalar(uint32_t state[8], const uint8_t* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = loadBigEndian(block + 4 * i);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + kK[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// Keeps kLanes messages in flight; when one finishes, its lane is refilled
+// with the next message. Each kernel call runs as many blocks as every busy
+// lane has contiguous, so state stays in registers across them. Once no
+// messages are waiting and fewer than min_active lanes are busy, the rest
+// finish on the scalar compressor.
+template<size_t kLanes, typename Compress>
+void runLanes(std::vector<Job>& jobs, std::span<Digest> digests,
+              size_t min_active, Compress compress) {
+    // Longest first so lanes drain together instead of leaving a long tail
+    std::sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) {
+        return a.total_blocks > b.total_blocks;
+    });
+
+    uint32_t idle_state[8];
+
+    Job* lanes[kLanes] = {};
+    uint32_t states[kLanes][8];
+    size_t next_job = 0;
+    size_t active = 0;
+
+    auto refill = [&](size_t lane) {
+        if (next_job < jobs.size()) {
+            lanes[lane] = &jobs[next_job++];
+            std::memcpy(states[lane], kInitialState, sizeof(kInitialState));
+            active++;
+        }
+    };
+
+    for (size_t lane = 0; lane < kLanes; lane++) {
+        refill(lane);
+    }
+
+    while (active > 0) {
+        if (next_job == jobs.size() && active < min_active) {
+            for (size_t lane = 0; lane < kLanes; lane++) {
+                for (Job* job = lanes[lane]; job && !job->done(); job->next_block++) {
+                    compressScalar(states[lane], job->block());
+                }
+                if (lanes[lane]) {
+                    digests[lanes[lane]->index] = digestFromState(states[lane]);
+                }
+            }
+            return;
+        }
+
+        // Idle lanes hash a busy lane's blocks into a scratch state
+        size_t count = SIZE_MAX;
+        const uint8_t* idle_blocks = nullptr;
+        for (size_t lane = 0; lane < kLanes; lane++) {
+            if (lanes[lane]) {
+                count = std::min(count, lanes[lane]->contiguous());
+                idle_blocks = lanes[lane]->block();
+            }
+        }
+
+        uint32_t* state_ptrs[kLanes];
+        const uint8_t* block_ptrs[kLanes];
+        for (size_t lane = 0; lane < kLanes; lane++) {
+            state_ptrs[lane] = lanes[lane] ? states[lane] : idle_state;
+            block_ptrs[lane] = lanes[lane] ? lanes[lane]->block() : idle_blocks;
+        }
+
+        compress(state_ptrs, block_ptrs, count);
+
+        for (size_t lane = 0; lane < kLanes; lane++) {
+            Job* job = lanes[lane];
+            if (!job) {
+                continue;
+            }
+            job->next_block += count;
+            if (job->done()) {
+                digests[job->index] = digestFromState(states[lane]);
+                lanes[lane] = nullptr;
+                active--;
+                refill(lane);
+            }
+        }
+    }
+}
+
+#ifdef DROPBOXLITE_X86
+
+// SHA-NI, two messages interleaved: sha256rnds2 is latency bound, so a
+// second independent message fills the pipeline for free
+__attribute__((target("sha,sse4.1,ssse3")))
+void compressShaNi2(uint32_t* const* states, const uint8_t* const* blocks, size_t count) {
+    constexpr size_t kLanes = 2;
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i state0[kLanes], state1[kLanes];
+    for (size_t l = 0; l < kLanes; l++) {
+        __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(states[l]));
+        __m128i efgh = _mm_loadu_si128(reinterpret_cast<const __m128i*>(states[l] + 4));
+        tmp = _mm_shuffle_epi32(tmp, 0xB1);                 // CDAB
+        efgh = _mm_shuffle_epi32(efgh, 0x1B);               // EFGH
+        state0[l] = _mm_alignr_epi8(tmp, efgh, 8);          // ABEF
+        state1[l] = _mm_blend_epi16(efgh, tmp, 0xF0);       // CDGH
+    }
+
+    for (size_t n = 0; n < count; n++) {
+        __m128i save0[kLanes], save1[kLanes];
+        __m128i msg[kLanes][4];
+        for (size_t l = 0; l < kLanes; l++) {
+            save0[l] = state0[l];
+            save1[l] = state1[l];
+        }
+
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; g++) {
+            __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(kK + 4 * g));
+            for (size_t l = 0; l < kLanes; l++) {
+                __m128i w;
+                if (g < 4) {
+                    const uint8_t* block = blocks[l] + n * kBlockSize;
+                    w = _mm_shuffle_epi8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * g)),
+                        byte_swap);
+                } else {
+                    w = _mm_sha256msg2_epu32(
+                        _mm_add_epi32(_mm_sha256msg1_epu32(msg[l][g & 3], msg[l][(g + 1) & 3]),
+                                      _mm_alignr_epi8(msg[l][(g + 3) & 3], msg[l][(g + 2) & 3], 4)),
+                        msg[l][(g + 3) & 3]);
+                }
+                msg[l][g & 3] = w;
+
+                __m128i wk = _mm_add_epi32(w, k);
+                state1[l] = _mm_sha256rnds2_epu32(state1[l], state0[l], wk);
+                state0[l] = _mm_sha256rnds2_epu32(state0[l], state1[l], _mm_shuffle_epi32(wk, 0x0E));
+            }
+        }
+
+        for (size_t l = 0; l < kLanes; l++) {
+            state0[l] = _mm_add_epi32(state0[l], save0[l]);
+            state1[l] = _mm_add_epi32(state1[l], save1[l]);
+        }
+    }
+
+    for (size_t l = 0; l < kLanes; l++) {
+        __m128i tmp = _mm_shuffle_epi32(state0[l], 0x1B);   // FEBA
+        __m128i dchg = _mm_shuffle_epi32(state1[l], 0xB1);  // DCHG
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(states[l]),
+                         _mm_blend_epi16(tmp, dchg, 0xF0));           // DCBA
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(states[l] + 4),
+                         _mm_alignr_epi8(dchg, tmp, 8));              // HGFE
+    }
+}
+
+template<int N>
+__attribute__((target("avx2"), always_inline))
+inline __m256i rotr8(__m256i x) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N));
+}
+
+// AVX2 multi-buffer: eight messages, one per 32-bit lane
+__attribute__((target("avx2")))
+void compressAvx2x8(uint32_t* const* states, const uint8_t* const* blocks, size_t count) {
+    constexpr size_t kLanes = 8;
+
+    // Transposed: vector word i holds word i of every lane
+    alignas(32) uint32_t words[kLanes];
+
+    __m256i s[8];
+    for (int i = 0; i < 8; i++) {
+        for (size_t l = 0; l < kLanes; l++) {
+            words[l] = states[l][i];
+        }
+        s[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words));
+    }
+
+    for (size_t n = 0; n < count; n++) {
+        __m256i w[16];
+        for (int i = 0; i < 16; i++) {
+            for (size_t l = 0; l < kLanes; l++) {
+                words[l] = loadBigEndian(blocks[l] + n * kBlockSize + 4 * i);
+            }
+            w[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words));
+        }
+
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3];
+        __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+
+        for (int i = 0; i < 64; i++) {
+            __m256i wi;
+            if (i < 16) {
+                wi = w[i];
+            } else {
+                __m256i w15 = w[(i - 15) & 15];
+                __m256i w2 = w[(i - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8<7>(w15), rotr8<18>(w15)),
+                                              _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8<17>(w2), rotr8<19>(w2)),
+                                              _mm256_srli_epi32(w2, 10));
+                wi = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], s0),
+                                      _mm256_add_epi32(w[(i - 7) & 15], s1));
+                w[i & 15] = wi;
+            }
+
+            __m256i big_s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8<6>(e), rotr8<11>(e)),
+                                              rotr8<25>(e));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(
+                _mm256_add_epi32(h, big_s1),
+                _mm256_add_epi32(_mm256_add_epi32(ch, wi),
+                                 _mm256_set1_epi32(static_cast<int>(kK[i]))));
+            __m256i big_s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8<2>(a), rotr8<13>(a)),
+                                              rotr8<22>(a));
+            __m256i maj = _mm256_xor_si256(_mm256_and_si256(a, b),
+                                           _mm256_and_si256(c, _mm256_xor_si256(a, b)));
+            __m256i t2 = _mm256_add_epi32(big_s0, maj);
+
+            h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+            d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+        }
+
+        s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(words), s[i]);
+        for (size_t l = 0; l < kLanes; l++) {
+            states[l][i] = words[l];
+        }
+    }
+}
+
+#endif // DROPBOXLITE_X86
+
+Sha256Kernel detectBestSha256() {
+#ifdef DROPBOXLITE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+        return Sha256Kernel::SHANI;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return Sha256Kernel::AVX2;
+    }
+#endif
+    return Sha256Kernel::Scalar;
+}
+
+} // namespace
+
+Sha256Kernel Hash::bestSha256Kernel() {
+    static const Sha256Kernel kBest = detectBestSha256();
+    return kBest;
+}
+
+bool Hash::isSupported(Sha256Kernel kernel) {
+    switch (kernel) {
+        case Sha256Kernel::Auto:
+        case Sha256Kernel::Scalar:
+            return true;
+#ifdef DROPBOXLITE_X86
+        case Sha256Kernel::SHANI:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+        case Sha256Kernel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+void Hash::sha256Batch(std::span<const std::span<const uint8_t>> inputs,
+                       std::span<Digest> digests,
+                       Sha256Kernel kernel) {
+    if (kernel == Sha256Kernel::Auto) {
+        kernel = bestSha256Kernel();
+    }
+    if (!isSupported(kernel) || inputs.size() < 2) {
+        kernel = Sha256Kernel::Scalar;
+    }
+
+    if (kernel == Sha256Kernel::Scalar) {
+        for (size_t i = 0; i < inputs.size(); i++) {
+            digests[i] = sha256Digest(inputs[i]);
+        }
+        return;
+    }
+
+    std::vector<Job> jobs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        jobs[i].init(inputs[i], i);
+    }
+
+#ifdef DROPBOXLITE_X86
+    if (kernel == Sha256Kernel::SHANI) {
+        runLanes<2>(jobs, digests, 0, compressShaNi2);
+    } else {
+        runLanes<8>(jobs, digests, 3, compressAvx2x8);
+    }
+#endif
+}
+
+std::vector<Digest> Hash::sha256Batch(std::span<const std::span<const uint8_t>> inputs) {
+    std::vector<Digest> digests(inputs.size());
+    sha256Batch(inputs, digests);
+    return digests;
+}
+
+const char* Hash::sha256KernelName(Sha256Kernel kernel) {
+    switch (kernel) {
+        case Sha256Kernel::Auto: return "auto";
+        case Sha256Kernel::Scalar: return "scalar";
+        case Sha256Kernel::SHANI: return "sha-ni";
+        case Sha256Kernel::AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+} // namespace dropboxlite
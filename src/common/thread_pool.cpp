@@ -1,45 +1,82 @@
 #include "common/thread_pool.h"
+#include "common/work_stealing_deque.h"
+#include "common/object_pool.h"
+#include "common/metrics.h"
+#include <algorithm>
+#include <mutex>
+#include <deque>
+#include <pthread.h>
+#include <sched.h>
 
 namespace dropboxlite {
 
-ThreadPool::ThreadPool(size_t num_threads) : stop_(false), active_tasks_(0) {
+// One lane's queues on one worker
+struct ThreadPool::WorkerLane {
+    WorkStealingDeque<Task> deque;
+
+    // Tasks from threads outside the pool; moved to the deque in batches
+    std::mutex inbox_mutex;
+    std::deque<Task*> inbox;
+    std::atomic<size_t> inbox_size{0};
+};
+
+struct ThreadPool::Worker {
+    std::array<WorkerLane, kLanes> lanes;
+    uint64_t rng;
+
+    // Stride-scheduling position per lane, for WeightedFair
+    std::array<uint64_t, kLanes> pass{};
+};
+
+namespace {
+
+// Pool, worker index and current task's priority of this thread, if it is
+// a worker
+thread_local const ThreadPool* t_pool = nullptr;
+thread_local size_t t_worker = 0;
+thread_local Priority t_priority = Priority::Normal;
+
+// Round-robin inbox cursor for outside producers, staggered per thread
+thread_local size_t t_inbox_cursor = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+// Rounds of stealing before a worker gives up and parks
+constexpr int kStealRounds = 2;
+
+// Stride of a weight-1 lane under WeightedFair
+constexpr uint64_t kStride = 1 << 20;
+
+uint64_t nextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+int64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t num_threads)
+    : policy_(LanePolicy::Strict), stop_(false), unfinished_(0), searching_(0),
+      sleepers_(0), waking_(false), wake_epoch_(0) {
+    num_threads = std::max<size_t>(1, num_threads);
     for (size_t i = 0; i < num_threads; ++i) {
-        workers_.emplace_back([this] {
-            while (true) {
-                std::function<void()> task;
-                
-                {
-                    std::unique_lock<std::mutex> lock(queue_mutex_);
-                    condition_.wait(lock, [this] {
-                        return stop_ || !tasks_.empty();
-                    });
-                    
-                    if (stop_ && tasks_.empty()) {
-                        return;
-                    }
-                    
-                    task = std::move(tasks_.front());
-                    tasks_.pop();
-                }
-                
-                active_tasks_++;
-                task();
-                active_tasks_--;
-                
-                wait_condition_.notify_all();
-            }
-        });
+        queues_.push_back(std::make_unique<Worker>());
+        queues_.back()->rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers_.emplace_back([this, i] { workerLoop(i); });
     }
 }
 
 ThreadPool::~ThreadPool() {
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-        stop_ = true;
-    }
-    
-    condition_.notify_all();
-    
+    stop_ = true;
+    wake_epoch_.fetch_add(1);
+    wake_epoch_.notify_all();
+
     for (std::thread& worker : workers_) {
         if (worker.joinable()) {
             worker.join();
@@ -47,16 +84,349 @@ ThreadPool::~ThreadPool() {
     }
 }
 
+bool ThreadPool::pinWorkers(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (CPU_COUNT(&set) == 0) {
+        return false;
+    }
+    bool ok = true;
+    for (std::thread& worker : workers_) {
+        ok &= pthread_setaffinity_np(worker.native_handle(), sizeof(set), &set) == 0;
+    }
+    return ok;
+}
+
+void ThreadPool::setLaneConfig(Priority priority, const LaneConfig& config) {
+    Lane& lane = lanes_[static_cast<size_t>(priority)];
+    lane.weight = std::max<uint32_t>(1, config.weight);
+    lane.max_running = config.max_running;
+    lane.max_wait_ns_config =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(config.max_wait).count();
+}
+
+LaneStats ThreadPool::laneStats(Priority priority) const {
+    const Lane& lane = lanes_[static_cast<size_t>(priority)];
+    LaneStats stats;
+    stats.queued = lane.queued.load(std::memory_order_relaxed);
+    stats.running = lane.running.load(std::memory_order_relaxed);
+    stats.completed = lane.completed.load(std::memory_order_relaxed);
+    stats.avg_wait_us = stats.completed == 0 ? 0.0 :
+        lane.wait_ns.load(std::memory_order_relaxed) / 1000.0 / stats.completed;
+    stats.max_wait_us = lane.max_wait_ns.load(std::memory_order_relaxed) / 1000;
+    return stats;
+}
+
+void ThreadPool::publishMetrics(const std::string& prefix) const {
+    auto& metrics = Metrics::instance();
+    for (size_t i = 0; i < kLanes; i++) {
+        auto priority = static_cast<Priority>(i);
+        LaneStats stats = laneStats(priority);
+        std::string name = prefix + "." + priorityName(priority);
+        metrics.setGauge(name + ".queue_depth", stats.queued);
+        metrics.setGauge(name + ".running", stats.running);
+        metrics.setGauge(name + ".completed", stats.completed);
+        metrics.setGauge(name + ".wait_avg_us", static_cast<int64_t>(stats.avg_wait_us));
+        metrics.setGauge(name + ".wait_max_us", stats.max_wait_us);
+        lanes_[i].max_wait_ns.store(0, std::memory_order_relaxed);
+    }
+}
+
+const char* ThreadPool::priorityName(Priority priority) {
+    switch (priority) {
+        case Priority::Interactive: return "interactive";
+        case Priority::Normal: return "normal";
+        case Priority::Background: return "background";
+        default: return "unknown";
+    }
+}
+
 size_t ThreadPool::pending() const {
-    std::unique_lock<std::mutex> lock(queue_mutex_);
-    return tasks_.size();
+    size_t queued = 0;
+    for (const Lane& lane : lanes_) {
+        queued += lane.queued.load(std::memory_order_relaxed);
+    }
+    return queued;
 }
 
 void ThreadPool::wait() {
-    std::unique_lock<std::mutex> lock(queue_mutex_);
-    wait_condition_.wait(lock, [this] {
-        return tasks_.empty() && active_tasks_ == 0;
-    });
+    size_t remaining;
+    while ((remaining = unfinished_.load(std::memory_order_acquire)) != 0) {
+        unfinished_.wait(remaining, std::memory_order_acquire);
+    }
+}
+
+Priority ThreadPool::inheritedPriority() const {
+    return t_pool == this ? t_priority : Priority::Normal;
+}
+
+void ThreadPool::schedule(Priority priority, InlineTask&& fn) {
+    if (stop_) {
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+    }
+
+    size_t index = static_cast<size_t>(priority);
+    int64_t now = nowNanos();
+    Task* task = ObjectPool<Task>::create(Task{std::move(fn), now, priority});
+    unfinished_.fetch_add(1, std::memory_order_relaxed);
+
+    // Aging counts from when the lane last had nothing to do
+    Lane& lane = lanes_[index];
+    if (lane.queued.fetch_add(1, std::memory_order_relaxed) == 0) {
+        lane.last_served_ns.store(now, std::memory_order_relaxed);
+    }
+
+    if (t_pool == this) {
+        queues_[t_worker]->lanes[index].deque.push(task);
+    } else {
+        WorkerLane& target = queues_[t_inbox_cursor++ % queues_.size()]->lanes[index];
+        std::lock_guard<std::mutex> lock(target.inbox_mutex);
+        target.inbox.push_back(task);
+        target.inbox_size.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // A searching worker will find the task; otherwise wake a parked one.
+    // Pairs with the announce-then-recheck in park().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (searching_.load(std::memory_order_seq_cst) == 0 &&
+        sleepers_.load(std::memory_order_seq_cst) > 0) {
+        wakeOne();
+    }
+}
+
+void ThreadPool::wakeOne() {
+    // One wake in flight at a time: until the woken worker is up and
+    // searching, further producers would only wake more workers for the
+    // same burst
+    if (waking_.load(std::memory_order_relaxed) ||
+        waking_.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    wake_epoch_.fetch_add(1, std::memory_order_seq_cst);
+    wake_epoch_.notify_one();
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    Worker& self = *queues_[index];
+    t_pool = this;
+    t_worker = index;
+
+    while (true) {
+        Task* task = findTask(self, false);
+        if (!task) {
+            searching_.fetch_add(1, std::memory_order_seq_cst);
+            task = findTask(self, true);
+            if (!task) {
+                task = park(self);
+                if (!task) {
+                    return;
+                }
+            }
+            // The last searcher to find work hands the search on, so a
+            // burst of tasks wakes workers one after another
+            if (searching_.fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+                sleepers_.load(std::memory_order_seq_cst) > 0) {
+                wakeOne();
+            }
+        }
+        run(task);
+    }
+}
+
+ThreadPool::Task* ThreadPool::findTask(Worker& self, bool steal) {
+    // Lanes past their max_wait go first, in priority order; the rest
+    // follow the policy
+    std::array<size_t, kLanes> order;
+    size_t aged = 0;
+    std::array<size_t, kLanes> waiting;
+    size_t waiting_count = 0;
+    int64_t now = 0;
+    for (size_t i = 0; i < kLanes; i++) {
+        const Lane& lane = lanes_[i];
+        if (lane.queued.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        int64_t max_wait = lane.max_wait_ns_config.load(std::memory_order_relaxed);
+        if (max_wait > 0) {
+            now = now ? now : nowNanos();
+            if (now - lane.last_served_ns.load(std::memory_order_relaxed) > max_wait) {
+                order[aged++] = i;
+                continue;
+            }
+        }
+        waiting[waiting_count++] = i;
+    }
+    if (aged + waiting_count == 0) {
+        return nullptr;
+    }
+
+    bool strict = policy_.load(std::memory_order_relaxed) == LanePolicy::Strict;
+    if (!strict) {
+        // Insertion sort over at most kLanes entries; std::sort's unrolled
+        // small-range path trips -Warray-bounds on an array this short
+        auto before = [&self](size_t a, size_t b) {
+            return self.pass[a] != self.pass[b] ? self.pass[a] < self.pass[b] : a < b;
+        };
+        for (size_t i = 1; i < waiting_count; i++) {
+            size_t lane = waiting[i];
+            size_t j = i;
+            for (; j > 0 && before(lane, waiting[j - 1]); j--) {
+                waiting[j] = waiting[j - 1];
+            }
+            waiting[j] = lane;
+        }
+    }
+    size_t count = aged;
+    for (size_t i = 0; i < waiting_count; i++) {
+        order[count++] = waiting[i];
+    }
+
+    uint64_t floor = self.pass[order[0]];
+    for (size_t i = 1; i < count; i++) {
+        floor = std::min(floor, self.pass[order[i]]);
+    }
+
+    // Strict priority is pool-wide: a higher lane's task in another
+    // worker's deque is stolen before this worker's own lower-lane work
+    for (size_t i = 0; i < count; i++) {
+        size_t index = order[i];
+        if (!acquireSlot(index)) {
+            continue;
+        }
+        if (Task* task = takeFromLane(self, index, steal || strict)) {
+            Lane& lane = lanes_[index];
+            lane.queued.fetch_sub(1, std::memory_order_relaxed);
+            lane.last_served_ns.store(now ? now : nowNanos(), std::memory_order_relaxed);
+
+            // A lane that sat idle restarts level with the others rather
+            // than spending credit it built up while empty
+            uint64_t stride = kStride / lane.weight.load(std::memory_order_relaxed);
+            self.pass[index] = std::max(self.pass[index], floor) + stride;
+            return task;
+        }
+        lanes_[index].running.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return nullptr;
+}
+
+bool ThreadPool::acquireSlot(size_t index) {
+    Lane& lane = lanes_[index];
+    size_t limit = lane.max_running.load(std::memory_order_relaxed);
+    if (limit == 0) {
+        lane.running.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    size_t running = lane.running.load(std::memory_order_relaxed);
+    while (running < limit) {
+        if (lane.running.compare_exchange_weak(running, running + 1,
+                                               std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ThreadPool::Task* ThreadPool::takeFromLane(Worker& self, size_t index, bool steal) {
+    WorkerLane& mine = self.lanes[index];
+    if (Task* task = mine.deque.pop()) {
+        return task;
+    }
+
+    // Move the whole inbox to the deque, where other workers can steal it
+    if (mine.inbox_size.load(std::memory_order_relaxed) > 0) {
+        std::deque<Task*> batch;
+        {
+            std::lock_guard<std::mutex> lock(mine.inbox_mutex);
+            batch.swap(mine.inbox);
+            mine.inbox_size.store(0, std::memory_order_relaxed);
+        }
+        for (Task* task : batch) {
+            mine.deque.push(task);
+        }
+        if (Task* task = mine.deque.pop()) {
+            return task;
+        }
+    }
+
+    if (!steal) {
+        return nullptr;
+    }
+
+    size_t count = queues_.size();
+    for (int round = 0; round < kStealRounds; round++) {
+        size_t start = nextRandom(self.rng) % count;
+        for (size_t i = 0; i < count; i++) {
+            Worker& victim = *queues_[(start + i) % count];
+            if (&victim == &self) {
+                continue;
+            }
+            WorkerLane& theirs = victim.lanes[index];
+            if (Task* task = theirs.deque.steal()) {
+                return task;
+            }
+            // A busy worker's inbox is fair game too
+            if (theirs.inbox_size.load(std::memory_order_relaxed) > 0) {
+                std::lock_guard<std::mutex> lock(theirs.inbox_mutex);
+                if (!theirs.inbox.empty()) {
+                    Task* task = theirs.inbox.front();
+                    theirs.inbox.pop_front();
+                    theirs.inbox_size.fetch_sub(1, std::memory_order_relaxed);
+                    return task;
+                }
+            }
+        }
+    }
+    return nullptr;
+}
+
+ThreadPool::Task* ThreadPool::park(Worker& self) {
+    while (true) {
+        // Announce the sleep before the last look, so a producer either
+        // sees a sleeper to wake or its task is seen here
+        uint32_t epoch = wake_epoch_.load(std::memory_order_seq_cst);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        searching_.fetch_sub(1, std::memory_order_seq_cst);
+
+        Task* task = findTask(self, true);
+        if (task || stop_.load(std::memory_order_seq_cst)) {
+            searching_.fetch_add(1, std::memory_order_seq_cst);
+            sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+            waking_.store(false, std::memory_order_release);
+            return task;
+        }
+
+        // Any wake after the epoch was read returns at once
+        wake_epoch_.wait(epoch, std::memory_order_seq_cst);
+        searching_.fetch_add(1, std::memory_order_seq_cst);
+        sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+        waking_.store(false, std::memory_order_release);
+    }
+}
+
+void ThreadPool::run(Task* task) {
+    Lane& lane = lanes_[static_cast<size_t>(task->priority)];
+    int64_t waited = nowNanos() - task->enqueued_ns;
+    lane.wait_ns.fetch_add(waited, std::memory_order_relaxed);
+    int64_t max_wait = lane.max_wait_ns.load(std::memory_order_relaxed);
+    while (waited > max_wait &&
+           !lane.max_wait_ns.compare_exchange_weak(max_wait, waited, std::memory_order_relaxed)) {
+    }
+
+    t_priority = task->priority;
+    task->fn();
+    ObjectPool<Task>::destroy(task);
+
+    lane.completed.fetch_add(1, std::memory_order_relaxed);
+    lane.running.fetch_sub(1, std::memory_order_relaxed);
+
+    if (unfinished_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        unfinished_.notify_all();
+    }
 }
 
 } // namespace dropboxlite
@@ -0,0 +1,131 @@
+#include "common/timer_wheel.h"
+#include "common/object_pool.h"
+#include <algorithm>
+
+namespace dropboxlite {
+
+TimerWheel::TimerWheel(Clock::duration tick, size_t slots)
+    : tick_(std::max<Clock::duration>(tick, Clock::duration(1))),
+      start_(Clock::now()),
+      slots_(std::max<size_t>(1, slots), nullptr) {
+    thread_ = std::thread([this] { run(); });
+}
+
+TimerWheel::~TimerWheel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+
+    for (Entry*& head : slots_) {
+        while (head) {
+            Entry* entry = head;
+            head = entry->next;
+            ObjectPool<Entry>::destroy(entry);
+        }
+    }
+}
+
+TimerWheel& TimerWheel::shared() {
+    // Never destroyed: timers may be scheduled from other static destructors
+    static TimerWheel* wheel = new TimerWheel();
+    return *wheel;
+}
+
+void TimerWheel::schedule(Clock::time_point deadline, InlineTask fn) {
+    Entry* entry = ObjectPool<Entry>::create(Entry{std::move(fn), 0, nullptr});
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // An idle wheel has not been advancing; skip the ticks it slept
+        // through rather than scanning them one by one later
+        if (pending_ == 0) {
+            current_ = std::max(current_, ticksUntil(Clock::now(), false));
+        }
+        entry->tick = std::max(current_, ticksUntil(deadline, true));
+        Entry*& head = slots_[entry->tick % slots_.size()];
+        entry->next = head;
+        head = entry;
+        pending_++;
+        notify = entry->tick < wake_tick_;
+    }
+    if (notify) {
+        wake_.notify_one();
+    }
+}
+
+size_t TimerWheel::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+uint64_t TimerWheel::ticksUntil(Clock::time_point time, bool round_up) const {
+    if (time <= start_) {
+        return 0;
+    }
+    auto elapsed = time - start_;
+    uint64_t ticks = elapsed / tick_;
+    if (round_up && elapsed % tick_ != Clock::duration::zero()) {
+        ticks++;
+    }
+    return ticks;
+}
+
+uint64_t TimerWheel::nextOccupied() const {
+    for (size_t i = 0; i < slots_.size(); i++) {
+        if (slots_[(current_ + i) % slots_.size()]) {
+            return current_ + i;
+        }
+    }
+    return current_ + slots_.size();
+}
+
+void TimerWheel::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        if (pending_ == 0) {
+            wake_tick_ = UINT64_MAX;
+            wake_.wait(lock);
+            continue;
+        }
+        if (current_ > ticksUntil(Clock::now(), false)) {
+            // An occupied slot may hold only later rounds; waking for it
+            // just finds nothing due and sleeps again
+            wake_tick_ = nextOccupied();
+            wake_.wait_until(lock, start_ + wake_tick_ * tick_);
+            continue;
+        }
+
+        // Unlink what is due in this slot, oldest first
+        Entry* due = nullptr;
+        Entry** link = &slots_[current_ % slots_.size()];
+        while (*link) {
+            Entry* entry = *link;
+            if (entry->tick <= current_) {
+                *link = entry->next;
+                entry->next = due;
+                due = entry;
+                pending_--;
+            } else {
+                link = &entry->next;
+            }
+        }
+        current_++;
+        if (!due) {
+            continue;
+        }
+
+        lock.unlock();
+        while (due) {
+            Entry* entry = due;
+            due = entry->next;
+            entry->fn();
+            ObjectPool<Entry>::destroy(entry);
+        }
+        lock.lock();
+    }
+}
+
+} // namespace dropboxlite
@@ -2,24 +2,80 @@
 #include "common/hash.h"
 #include <fstream>
 #include <algorithm>
+#include <memory>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace dropboxlite {
 
+namespace {
+
+// Fill buffer from fd's current position, retrying short reads; returns
+// bytes read (less than size only at end of file) or -1 on error
+ssize_t readBlock(int fd, uint8_t* buffer, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = ::read(fd, buffer + total, size - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return static_cast<ssize_t>(total);
+}
+
+bool sameContents(int fd1, int fd2) {
+    constexpr size_t kBlockSize = 256 * 1024;
+    
+    // Differing sizes settle it without reading anything
+    struct stat st1, st2;
+    if (fstat(fd1, &st1) != 0 || fstat(fd2, &st2) != 0) {
+        return false;
+    }
+    if (S_ISREG(st1.st_mode) && S_ISREG(st2.st_mode) && st1.st_size != st2.st_size) {
+        return false;
+    }
+    posix_fadvise(fd1, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd2, 0, 0, POSIX_FADV_SEQUENTIAL);
+    
+    auto buffer1 = std::make_unique<uint8_t[]>(kBlockSize);
+    auto buffer2 = std::make_unique<uint8_t[]>(kBlockSize);
+    while (true) {
+        ssize_t n1 = readBlock(fd1, buffer1.get(), kBlockSize);
+        ssize_t n2 = readBlock(fd2, buffer2.get(), kBlockSize);
+        if (n1 < 0 || n1 != n2 || std::memcmp(buffer1.get(), buffer2.get(), n1) != 0) {
+            return false;
+        }
+        if (n1 < static_cast<ssize_t>(kBlockSize)) {
+            return true;
+        }
+    }
+}
+
+} // namespace
+
 DeltaEngine::DeltaEngine(MetadataDB& db) : db_(db) {}
 
 DeltaInfo DeltaEngine::computeDelta(const std::string& filepath,
-                                   const std::vector<std::string>& server_chunk_hashes) {
+                                   const std::vector<Digest>& server_chunk_hashes) {
     DeltaInfo delta;
     delta.bytes_to_transfer = 0;
     
-    // Chunk the local file
-    auto local_chunks = chunker_.chunkFile(filepath);
-    
     // Convert server hashes to set for fast lookup
     auto server_set = convertToSet(server_chunk_hashes);
     
-    // Determine which chunks need to be uploaded
-    for (const auto& chunk : local_chunks) {
+    // Stream the local file so memory stays bounded for multi-GB files; the
+    // whole-file digest comes from the same pass
+    auto file_hash = chunker_.fingerprintFile(filepath, [&](const ChunkInfo& chunk, const uint8_t*) {
         if (server_set.find(chunk.hash) == server_set.end()) {
             // Server doesn't have this chunk
             delta.new_chunks.push_back(chunk);
@@ -28,6 +84,10 @@ DeltaInfo DeltaEngine::computeDelta(const std::string& filepath,
             // Server already has this chunk
             delta.existing_chunks.push_back(chunk);
         }
+    });
+    
+    if (file_hash) {
+        delta.file_hash = *file_hash;
     }
     
     return delta;
@@ -56,13 +116,28 @@ bool DeltaEngine::applyDelta(const std::string& filepath,
 }
 
 bool DeltaEngine::areFilesIdentical(const std::string& path1, const std::string& path2) {
-    std::string hash1 = Hash::sha256File(path1);
-    std::string hash2 = Hash::sha256File(path2);
-    return !hash1.empty() && hash1 == hash2;
+    // Both sides are local: comparing the bytes is exact and reads each
+    // file once, where fingerprints would read both twice on a match. They
+    // are read rather than mapped, since a client's files may be truncated
+    // under us (a mapping would SIGBUS; a read just comes up short).
+    int fd1 = ::open(path1.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd1 < 0) {
+        return false;
+    }
+    int fd2 = ::open(path2.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd2 < 0) {
+        ::close(fd1);
+        return false;
+    }
+    
+    bool same = sameContents(fd1, fd2);
+    ::close(fd1);
+    ::close(fd2);
+    return same;
 }
 
-std::set<std::string> DeltaEngine::convertToSet(const std::vector<std::string>& hashes) {
-    return std::set<std::string>(hashes.begin(), hashes.end());
+std::unordered_set<Digest> DeltaEngine::convertToSet(const std::vector<Digest>& hashes) {
+    return std::unordered_set<Digest>(hashes.begin(), hashes.end());
 }
 
 } // namespace dropboxlite
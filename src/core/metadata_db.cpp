@@ -4,6 +4,26 @@
 
 namespace dropboxlite {
 
+namespace {
+
+// Digests are stored as 32-byte BLOBs
+void bindDigest(sqlite3_stmt* stmt, int index, const Digest& digest) {
+    sqlite3_bind_blob(stmt, index, digest.data(), Digest::kSize, SQLITE_TRANSIENT);
+}
+
+Digest columnDigest(sqlite3_stmt* stmt, int column) {
+    const void* blob = sqlite3_column_blob(stmt, column);
+    auto digest = Digest::fromBytes(blob, sqlite3_column_bytes(stmt, column));
+    return digest ? *digest : Digest{};
+}
+
+// Rows written before the algorithm was recorded default to SHA256
+HashAlgorithm columnAlgorithm(sqlite3_stmt* stmt, int column) {
+    return Hash::algorithmFromId(sqlite3_column_int(stmt, column)).value_or(HashAlgorithm::SHA256);
+}
+
+} // namespace
+
 MetadataDB::MetadataDB(const std::string& db_path)
     : db_(nullptr), db_path_(db_path) {}
 
@@ -26,22 +46,33 @@ bool MetadataDB::initialize() {
             path TEXT PRIMARY KEY,
             size INTEGER,
             modified_time INTEGER,
-            hash TEXT,
+            hash BLOB,
             version INTEGER,
             is_directory INTEGER,
             deleted INTEGER,
-            last_sync_time INTEGER
+            last_sync_time INTEGER,
+            hash_algorithm INTEGER NOT NULL DEFAULT 0
         );
         
         CREATE TABLE IF NOT EXISTS chunks (
             file_path TEXT,
             chunk_index INTEGER,
-            hash TEXT,
+            hash BLOB,
             offset INTEGER,
             size INTEGER,
+            hash_algorithm INTEGER NOT NULL DEFAULT 0,
+            codec INTEGER NOT NULL DEFAULT 0,
             PRIMARY KEY (file_path, chunk_index)
         );
         
+        CREATE TABLE IF NOT EXISTS file_digests (
+            path TEXT,
+            hash_algorithm INTEGER,
+            source_hash BLOB,
+            hash BLOB,
+            PRIMARY KEY (path, hash_algorithm)
+        );
+        
         CREATE TABLE IF NOT EXISTS sync_state (
             key TEXT PRIMARY KEY,
             value INTEGER
@@ -51,14 +82,29 @@ bool MetadataDB::initialize() {
         CREATE INDEX IF NOT EXISTS idx_files_modified ON files(modified_time);
     )";
     
-    return executeSQL(schema);
+    if (!executeSQL(schema)) {
+        return false;
+    }
+    
+    // Databases created before the hash algorithm and codec were recorded
+    // lack those columns
+    const char* id_column = "INTEGER NOT NULL DEFAULT 0";
+    if (!addColumnIfMissing("files", "hash_algorithm", id_column) ||
+        !addColumnIfMissing("chunks", "hash_algorithm", id_column) ||
+        !addColumnIfMissing("chunks", "codec", id_column)) {
+        return false;
+    }
+    
+    // Databases created before digests became BLOBs hold hex TEXT
+    return migrateHexDigests("files") && migrateHexDigests("chunks");
 }
 
 bool MetadataDB::insertOrUpdateFile(const FileRecord& record) {
     const char* sql = R"(
         INSERT OR REPLACE INTO files 
-        (path, size, modified_time, hash, version, is_directory, deleted, last_sync_time)
-        VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+        (path, size, modified_time, hash, version, is_directory, deleted, last_sync_time,
+         hash_algorithm)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)
     )";
     
     sqlite3_stmt* stmt;
@@ -71,11 +117,12 @@ bool MetadataDB::insertOrUpdateFile(const FileRecord& record) {
     sqlite3_bind_text(stmt, 1, record.path.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int64(stmt, 2, record.size);
     sqlite3_bind_int64(stmt, 3, record.modified_time);
-    sqlite3_bind_text(stmt, 4, record.hash.c_str(), -1, SQLITE_TRANSIENT);
+    bindDigest(stmt, 4, record.hash);
     sqlite3_bind_int(stmt, 5, record.version);
     sqlite3_bind_int(stmt, 6, record.is_directory ? 1 : 0);
     sqlite3_bind_int(stmt, 7, record.deleted ? 1 : 0);
     sqlite3_bind_int64(stmt, 8, record.last_sync_time);
+    sqlite3_bind_int(stmt, 9, static_cast<int>(record.hash_algorithm));
     
     rc = sqlite3_step(stmt);
     sqlite3_finalize(stmt);
@@ -99,11 +146,12 @@ std::optional<FileRecord> MetadataDB::getFile(const std::string& path) {
         record.path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
         record.size = sqlite3_column_int64(stmt, 1);
         record.modified_time = sqlite3_column_int64(stmt, 2);
-        record.hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        record.hash = columnDigest(stmt, 3);
         record.version = sqlite3_column_int(stmt, 4);
         record.is_directory = sqlite3_column_int(stmt, 5) != 0;
         record.deleted = sqlite3_column_int(stmt, 6) != 0;
         record.last_sync_time = sqlite3_column_int64(stmt, 7);
+        record.hash_algorithm = columnAlgorithm(stmt, 8);
         
         sqlite3_finalize(stmt);
         return record;
@@ -127,11 +175,12 @@ std::vector<FileRecord> MetadataDB::getAllFiles() {
         record.path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
         record.size = sqlite3_column_int64(stmt, 1);
         record.modified_time = sqlite3_column_int64(stmt, 2);
-        record.hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        record.hash = columnDigest(stmt, 3);
         record.version = sqlite3_column_int(stmt, 4);
         record.is_directory = sqlite3_column_int(stmt, 5) != 0;
         record.deleted = sqlite3_column_int(stmt, 6) != 0;
         record.last_sync_time = sqlite3_column_int64(stmt, 7);
+        record.hash_algorithm = columnAlgorithm(stmt, 8);
         files.push_back(record);
     }
     
@@ -140,10 +189,12 @@ std::vector<FileRecord> MetadataDB::getAllFiles() {
 }
 
 bool MetadataDB::insertChunk(const std::string& file_path, int32_t index,
-                            const std::string& hash, int64_t offset, int32_t size) {
+                            const Digest& hash, int64_t offset, int32_t size,
+                            HashAlgorithm algorithm, Codec codec) {
     const char* sql = R"(
-        INSERT OR REPLACE INTO chunks (file_path, chunk_index, hash, offset, size)
-        VALUES (?, ?, ?, ?, ?)
+        INSERT OR REPLACE INTO chunks
+        (file_path, chunk_index, hash, offset, size, hash_algorithm, codec)
+        VALUES (?, ?, ?, ?, ?, ?, ?)
     )";
     
     sqlite3_stmt* stmt;
@@ -153,9 +204,11 @@ bool MetadataDB::insertChunk(const std::string& file_path, int32_t index,
     
     sqlite3_bind_text(stmt, 1, file_path.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int(stmt, 2, index);
-    sqlite3_bind_text(stmt, 3, hash.c_str(), -1, SQLITE_TRANSIENT);
+    bindDigest(stmt, 3, hash);
     sqlite3_bind_int64(stmt, 4, offset);
     sqlite3_bind_int(stmt, 5, size);
+    sqlite3_bind_int(stmt, 6, static_cast<int>(algorithm));
+    sqlite3_bind_int(stmt, 7, static_cast<int>(codec));
     
     int rc = sqlite3_step(stmt);
     sqlite3_finalize(stmt);
@@ -176,6 +229,70 @@ bool MetadataDB::executeSQL(const std::string& sql) {
     return true;
 }
 
+bool MetadataDB::addColumnIfMissing(const char* table, const char* column,
+                                    const char* definition) {
+    std::string pragma = std::string("PRAGMA table_info(") + table + ")";
+    
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, pragma.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    
+    bool found = false;
+    while (!found && sqlite3_step(stmt) == SQLITE_ROW) {
+        found = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1))) == column;
+    }
+    sqlite3_finalize(stmt);
+    
+    if (found) {
+        return true;
+    }
+    return executeSQL(std::string("ALTER TABLE ") + table + " ADD COLUMN " + column + " " + definition);
+}
+
+bool MetadataDB::migrateHexDigests(const char* table) {
+    std::string select = std::string("SELECT rowid, hash FROM ") + table +
+                         " WHERE typeof(hash) = 'text'";
+    std::string update = std::string("UPDATE ") + table + " SET hash = ? WHERE rowid = ?";
+    
+    sqlite3_stmt* read_stmt;
+    if (sqlite3_prepare_v2(db_, select.c_str(), -1, &read_stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    
+    std::vector<std::pair<int64_t, Digest>> rows;
+    while (sqlite3_step(read_stmt) == SQLITE_ROW) {
+        auto digest = Digest::fromHex(
+            reinterpret_cast<const char*>(sqlite3_column_text(read_stmt, 1)));
+        rows.emplace_back(sqlite3_column_int64(read_stmt, 0), digest ? *digest : Digest{});
+    }
+    sqlite3_finalize(read_stmt);
+    
+    if (rows.empty()) {
+        return true;
+    }
+    
+    sqlite3_stmt* write_stmt;
+    if (sqlite3_prepare_v2(db_, update.c_str(), -1, &write_stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    
+    Transaction txn(*this);
+    for (const auto& [rowid, digest] : rows) {
+        bindDigest(write_stmt, 1, digest);
+        sqlite3_bind_int64(write_stmt, 2, rowid);
+        if (sqlite3_step(write_stmt) != SQLITE_DONE) {
+            sqlite3_finalize(write_stmt);
+            return false;
+        }
+        sqlite3_reset(write_stmt);
+    }
+    sqlite3_finalize(write_stmt);
+    
+    LOG_INFO("Migrated " + std::to_string(rows.size()) + " hex digests in " + table);
+    return txn.commit();
+}
+
 std::string MetadataDB::getErrorMessage() {
     return sqlite3_errmsg(db_);
 }
@@ -240,11 +357,12 @@ std::vector<FileRecord> MetadataDB::getModifiedSince(int64_t timestamp) {
         record.path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
         record.size = sqlite3_column_int64(stmt, 1);
         record.modified_time = sqlite3_column_int64(stmt, 2);
-        record.hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        record.hash = columnDigest(stmt, 3);
         record.version = sqlite3_column_int(stmt, 4);
         record.is_directory = sqlite3_column_int(stmt, 5) != 0;
         record.deleted = sqlite3_column_int(stmt, 6) != 0;
         record.last_sync_time = sqlite3_column_int64(stmt, 7);
+        record.hash_algorithm = columnAlgorithm(stmt, 8);
         files.push_back(record);
     }
     
@@ -267,8 +385,53 @@ bool MetadataDB::deleteFile(const std::string& path) {
     return rc == SQLITE_DONE;
 }
 
-std::vector<std::string> MetadataDB::getFileChunks(const std::string& file_path) {
-    std::vector<std::string> hashes;
+std::optional<Digest> MetadataDB::getAlternateDigest(const std::string& path,
+                                                   HashAlgorithm algorithm,
+                                                   const Digest& source) {
+    const char* sql = "SELECT source_hash, hash FROM file_digests WHERE path = ? AND hash_algorithm = ?";
+    
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return std::nullopt;
+    }
+    
+    sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 2, static_cast<int>(algorithm));
+    
+    std::optional<Digest> digest;
+    // A row for older contents of the file is stale
+    if (sqlite3_step(stmt) == SQLITE_ROW && columnDigest(stmt, 0) == source) {
+        digest = columnDigest(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    return digest;
+}
+
+bool MetadataDB::putAlternateDigest(const std::string& path, HashAlgorithm algorithm,
+                                    const Digest& source, const Digest& digest) {
+    const char* sql = R"(
+        INSERT OR REPLACE INTO file_digests (path, hash_algorithm, source_hash, hash)
+        VALUES (?, ?, ?, ?)
+    )";
+    
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    
+    sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 2, static_cast<int>(algorithm));
+    bindDigest(stmt, 3, source);
+    bindDigest(stmt, 4, digest);
+    
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    
+    return rc == SQLITE_DONE;
+}
+
+std::vector<Digest> MetadataDB::getFileChunks(const std::string& file_path) {
+    std::vector<Digest> hashes;
     const char* sql = "SELECT hash FROM chunks WHERE file_path = ? ORDER BY chunk_index";
     
     sqlite3_stmt* stmt;
@@ -279,14 +442,14 @@ std::vector<std::string> MetadataDB::getFileChunks(const std::string& file_path)
     sqlite3_bind_text(stmt, 1, file_path.c_str(), -1, SQLITE_TRANSIENT);
     
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        hashes.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        hashes.push_back(columnDigest(stmt, 0));
     }
     
     sqlite3_finalize(stmt);
     return hashes;
 }
 
-bool MetadataDB::hasChunk(const std::string& hash) {
+bool MetadataDB::hasChunk(const Digest& hash) {
     const char* sql = "SELECT 1 FROM chunks WHERE hash = ? LIMIT 1";
     sqlite3_stmt* stmt;
     
@@ -294,7 +457,7 @@ bool MetadataDB::hasChunk(const std::string& hash) {
         return false;
     }
     
-    sqlite3_bind_text(stmt, 1, hash.c_str(), -1, SQLITE_TRANSIENT);
+    bindDigest(stmt, 1, hash);
     bool exists = (sqlite3_step(stmt) == SQLITE_ROW);
     sqlite3_finalize(stmt);
     
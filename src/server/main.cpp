@@ -1,20 +1,47 @@
 #include "server/sync_service.h"
 #include "common/logger.h"
+#include "common/metrics_server.h"
+#include "common/thread_pool.h"
 #include <grpcpp/grpcpp.h>
 #include <iostream>
+#include <charconv>
 #include <csignal>
 #include <atomic>
 
 std::atomic<bool> running(true);
+std::atomic<bool> reload_limits(false);
 
 void signalHandler(int signal) {
-    running = false;
+    if (signal == SIGHUP) {
+        reload_limits = true;
+    } else {
+        running = false;
+    }
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <storage_root> <port> [--metrics-port <port>]"
+              << " [--limits <file>]\n";
+    std::cerr << "Example: " << program << " ./storage 50051 --metrics-port 9100"
+              << " --limits bandwidth.conf\n";
+    std::cerr << "The limits file is re-read on SIGHUP.\n";
+}
+
+// Whole argument as a port number, 1 to 65535
+bool parsePort(const std::string& text, uint16_t& port) {
+    unsigned value = 0;
+    const char* end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, value);
+    if (result.ec != std::errc() || result.ptr != end || value == 0 || value > 65535) {
+        return false;
+    }
+    port = static_cast<uint16_t>(value);
+    return true;
 }
 
 int main(int argc, char** argv) {
-    if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <storage_root> <port>\n";
-        std::cerr << "Example: " << argv[0] << " ./storage 50051\n";
+    if (argc < 3 || argc % 2 == 0) {
+        printUsage(argv[0]);
         return 1;
     }
     
@@ -22,6 +49,25 @@ int main(int argc, char** argv) {
     std::string port = argv[2];
     std::string server_address = "0.0.0.0:" + port;
     
+    uint16_t metrics_port = 0;  // 0: no metrics endpoint
+    std::string limits_path;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--metrics-port") {
+            if (!parsePort(argv[i + 1], metrics_port)) {
+                std::cerr << "Invalid metrics port: " << argv[i + 1] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (flag == "--limits") {
+            limits_path = argv[i + 1];
+        } else {
+            std::cerr << "Unknown option: " << flag << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
     // Setup logging
     dropboxlite::Logger::instance().setLevel(dropboxlite::LogLevel::INFO);
     dropboxlite::Logger::instance().setLogFile("dropbox_server.log");
@@ -31,7 +77,34 @@ int main(int argc, char** argv) {
     LOG_INFO("Listening on: " + server_address);
     
     // Create service
+    dropboxlite::ThreadPool pool;
     dropboxlite::SyncServiceImpl service(storage_root);
+    service.setThreadPool(&pool);
+    
+    // Bandwidth caps; uncapped without a limits file
+    if (!limits_path.empty() && !service.loadBandwidthLimits(limits_path)) {
+        return 1;
+    }
+    
+    // OpenMetrics endpoint for Prometheus, if asked for
+    dropboxlite::MetricsServer metrics_server;
+    if (metrics_port != 0) {
+        metrics_server.addCollector([&pool, &service] {
+            pool.publishMetrics("server.thread_pool");
+            dropboxlite::Metrics::instance().setGauge("server.thread_pool.pending", pool.pending());
+            service.uploadBandwidth().publishMetrics("server.upload");
+            service.downloadBandwidth().publishMetrics("server.download");
+        });
+        metrics_server.addExporter([&service](std::string& out) {
+            service.uploadBandwidth().writeOpenMetrics(out, "server.upload");
+            service.downloadBandwidth().writeOpenMetrics(out, "server.download");
+        });
+        if (!metrics_server.start(metrics_port)) {
+            LOG_ERROR("Failed to start metrics endpoint");
+            return 1;
+        }
+        LOG_INFO("Metrics on: 0.0.0.0:" + std::to_string(metrics_server.port()) + "/metrics");
+    }
     
     // Build server
     grpc::ServerBuilder builder;
@@ -50,14 +123,20 @@ int main(int argc, char** argv) {
     // Setup signal handlers
     std::signal(SIGINT, signalHandler);
     std::signal(SIGTERM, signalHandler);
+    std::signal(SIGHUP, signalHandler);
     
-    // Wait for shutdown
+    // Wait for shutdown, reloading limits when asked; a bad file keeps
+    // the limits already in force
     while (running) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (reload_limits.exchange(false) && !limits_path.empty()) {
+            service.loadBandwidthLimits(limits_path);
+        }
     }
     
     LOG_INFO("Shutting down server...");
     server->Shutdown();
+    metrics_server.stop();
     
     return 0;
 }
@@ -1,19 +1,78 @@
 #include "server/storage_manager.h"
 #include "common/logger.h"
 #include "common/hash.h"
+#include "common/compression.h"
+#include "common/parallel.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <unordered_set>
 
 namespace dropboxlite {
 
+namespace {
+
+// Write data to a temp file of its own next to path, then rename it over
+// path, so a partly written file is never seen under path and concurrent
+// writers of the same path never share a temp file
+bool writeFileAtomically(const std::string& path, std::span<const uint8_t> data) {
+    std::string temp_path = path + ".tmp.XXXXXX";
+    int fd = ::mkstemp(temp_path.data());
+    if (fd < 0) {
+        return false;
+    }
+    // mkstemp creates the file 0600; keep the mode files written here had
+    ::fchmod(fd, 0644);
+    
+    const uint8_t* next = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t written = ::write(fd, next, left);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            break;
+        }
+        next += written;
+        left -= static_cast<size_t>(written);
+    }
+    bool ok = ::close(fd) == 0 && left == 0;
+    
+    std::error_code error;
+    if (ok) {
+        std::filesystem::rename(temp_path, path, error);
+    }
+    if (!ok || error) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
 StorageManager::StorageManager(const std::string& storage_root)
-    : storage_root_(storage_root) {}
+    : storage_root_(storage_root),
+      dictionaries_(storage_root + "/dictionaries") {}
 
 bool StorageManager::initialize() {
     // Create storage root directory
     std::filesystem::create_directories(storage_root_);
     std::filesystem::create_directories(storage_root_ + "/chunks");
     
+    // Dictionaries live next to the chunks they were trained on
+    if (!dictionaries_.initialize()) {
+        return false;
+    }
+    
+    if (!migrateLegacyChunks()) {
+        return false;
+    }
+    
     LOG_INFO("Storage manager initialized at: " + storage_root_);
     return true;
 }
@@ -22,37 +81,108 @@ bool StorageManager::storeChunk(const std::string& client_id,
                                const std::string& filepath,
                                int32_t chunk_index,
                                const std::vector<uint8_t>& data,
-                               const std::string& hash) {
+                               const Digest& hash,
+                               HashAlgorithm algorithm,
+                               Codec codec) {
+    if (!writeChunk(client_id, filepath, hash, data, {})) {
+        return false;
+    }
+    
+    // Update metadata
+    auto* db = getClientDB(client_id);
+    if (!db) {
+        return false;
+    }
+    
+    return db->insertChunk(filepath, chunk_index, hash, 0, data.size(), algorithm, codec);
+}
+
+bool StorageManager::writeChunk(const std::string& client_id,
+                                const std::string& filepath,
+                                const Digest& hash,
+                                std::span<const uint8_t> data,
+                                std::span<const uint8_t> client_frame) {
     // Store chunk in content-addressable storage
     std::string chunk_path = getChunkPath(hash);
     
     // Check if chunk already exists (deduplication)
     if (std::filesystem::exists(chunk_path)) {
-        LOG_DEBUG("Chunk already exists: " + hash);
-    } else {
-        std::ofstream file(chunk_path, std::ios::binary);
-        if (!file) {
-            LOG_ERROR("Failed to write chunk: " + chunk_path);
-            return false;
+        LOG_DEBUG("Chunk already exists: " + hash.toHex());
+        return true;
+    }
+    
+    std::vector<uint8_t> encoded;
+    if (client_frame.empty() || !keep_client_frames_) {
+        if (compress_at_rest_) {
+            auto dictionary = dictionaryFor(client_id, filepath);
+            encoded = Compression::compressAdaptive(data, dictionary.get());
+        } else {
+            encoded.resize(Compression::kFrameHeaderSize + data.size());
+            Compression::compressInto(data, encoded, CodecChoice{Codec::None, 0});
         }
-        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        client_frame = encoded;
     }
     
-    // Update metadata
+    // Write aside and rename, so a partly written chunk is never taken for
+    // an existing one. Racing uploads of the same chunk each publish a
+    // whole frame of their own; whichever lands last wins.
+    if (!writeFileAtomically(chunk_path, client_frame)) {
+        LOG_ERROR("Failed to write chunk: " + chunk_path);
+        return false;
+    }
+    return true;
+}
+
+bool StorageManager::storeChunks(const std::string& client_id,
+                                 const std::string& filepath,
+                                 const std::vector<ChunkUpload>& chunks) {
     auto* db = getClientDB(client_id);
     if (!db) {
         return false;
     }
     
-    return db->insertChunk(filepath, chunk_index, hash, 0, data.size());
+    // A client uses one algorithm, so this is normally a single batch
+    for (HashAlgorithm algorithm : {HashAlgorithm::SHA256, HashAlgorithm::BLAKE3}) {
+        std::vector<const ChunkUpload*> group;
+        std::vector<std::span<const uint8_t>> inputs;
+        for (const auto& chunk : chunks) {
+            if (chunk.algorithm == algorithm) {
+                group.push_back(&chunk);
+                inputs.emplace_back(chunk.data);
+            }
+        }
+        if (group.empty()) {
+            continue;
+        }
+        
+        std::vector<Digest> digests(group.size());
+        Hash::digestBatch(algorithm, inputs, digests);
+        
+        for (size_t i = 0; i < group.size(); i++) {
+            if (digests[i] != group[i]->hash) {
+                LOG_ERROR("Chunk hash mismatch: " + group[i]->hash.toHex());
+                return false;
+            }
+            const ChunkUpload& chunk = *group[i];
+            if (!writeChunk(client_id, filepath, chunk.hash, chunk.data, chunk.frame)) {
+                return false;
+            }
+            if (!db->insertChunk(filepath, chunk.index, chunk.hash, 0, chunk.data.size(),
+                                 algorithm, chunk.codec)) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
 }
 
-std::vector<uint8_t> StorageManager::getChunk(const std::string& hash) {
+std::vector<uint8_t> StorageManager::getChunk(const Digest& hash) {
     std::string chunk_path = getChunkPath(hash);
     
     std::ifstream file(chunk_path, std::ios::binary);
     if (!file) {
-        LOG_ERROR("Chunk not found: " + hash);
+        LOG_ERROR("Chunk not found: " + hash.toHex());
         return {};
     }
     
@@ -60,19 +190,32 @@ std::vector<uint8_t> StorageManager::getChunk(const std::string& hash) {
     size_t size = file.tellg();
     file.seekg(0, std::ios::beg);
     
-    std::vector<uint8_t> data(size);
-    file.read(reinterpret_cast<char*>(data.data()), size);
+    std::vector<uint8_t> stored(size);
+    file.read(reinterpret_cast<char*>(stored.data()), size);
     
+    // Every stored chunk is a frame (see migrateLegacyChunks)
+    auto original_size = Compression::decompressedSize(stored);
+    if (!original_size) {
+        LOG_ERROR("Chunk is not a valid frame: " + hash.toHex());
+        return {};
+    }
+    
+    std::vector<uint8_t> data(*original_size);
+    if (!Compression::decompressInto(stored, data)) {
+        LOG_ERROR("Failed to decompress chunk: " + hash.toHex());
+        return {};
+    }
     return data;
 }
 
-bool StorageManager::hasChunk(const std::string& hash) {
+bool StorageManager::hasChunk(const Digest& hash) {
     return std::filesystem::exists(getChunkPath(hash));
 }
 
 bool StorageManager::finalizeFile(const std::string& client_id,
                                  const std::string& filepath,
-                                 int32_t total_chunks) {
+                                 int32_t total_chunks,
+                                 HashAlgorithm algorithm) {
     auto* db = getClientDB(client_id);
     if (!db) {
         return false;
@@ -96,31 +239,62 @@ bool StorageManager::finalizeFile(const std::string& client_id,
         return false;
     }
     
+    // Hash while writing so the reconstructed file is never read back
+    Hash::Stream file_hash(algorithm);
+    int64_t file_size = 0;
+    
     for (const auto& hash : chunk_hashes) {
         auto chunk_data = getChunk(hash);
         if (chunk_data.empty()) {
             return false;
         }
         file.write(reinterpret_cast<const char*>(chunk_data.data()), chunk_data.size());
+        file_hash.update(chunk_data);
+        file_size += chunk_data.size();
     }
     
     file.close();
+    if (!file) {
+        return false;
+    }
     
     // Update file metadata
     FileRecord record;
     record.path = filepath;
-    record.size = std::filesystem::file_size(temp_path);
+    record.size = file_size;
     record.modified_time = std::chrono::duration_cast<std::chrono::seconds>(
         std::chrono::system_clock::now().time_since_epoch()
     ).count();
-    record.hash = Hash::sha256File(temp_path);
+    record.hash = file_hash.finish();
     record.version = 1;
     record.is_directory = false;
     record.deleted = false;
+    record.hash_algorithm = algorithm;
     
     return db->insertOrUpdateFile(record);
 }
 
+std::optional<Digest> StorageManager::getFileDigest(const std::string& client_id,
+                                                    const FileRecord& record,
+                                                    HashAlgorithm algorithm) {
+    if (record.hash_algorithm == algorithm) {
+        return record.hash;
+    }
+    
+    // Re-hashing the stored file is paid once per contents and algorithm
+    auto* db = getClientDB(client_id);
+    if (db) {
+        if (auto cached = db->getAlternateDigest(record.path, algorithm, record.hash)) {
+            return cached;
+        }
+    }
+    auto digest = Hash::fileDigest(algorithm, getTempFilePath(client_id, record.path));
+    if (digest && db) {
+        db->putAlternateDigest(record.path, algorithm, record.hash, *digest);
+    }
+    return digest;
+}
+
 std::optional<FileRecord> StorageManager::getFileMetadata(const std::string& client_id,
                                                          const std::string& filepath) {
     auto* db = getClientDB(client_id);
@@ -155,7 +329,8 @@ StorageManager::StorageStats StorageManager::getStats() const {
     // Count chunks
     std::string chunks_dir = storage_root_ + "/chunks";
     for (const auto& entry : std::filesystem::recursive_directory_iterator(chunks_dir)) {
-        if (entry.is_regular_file()) {
+        // Temp files left by an interrupted write are not chunks
+        if (entry.is_regular_file() && Digest::fromHex(entry.path().filename().string())) {
             stats.total_chunks++;
             stats.total_bytes += entry.file_size();
         }
@@ -164,12 +339,198 @@ StorageManager::StorageStats StorageManager::getStats() const {
     return stats;
 }
 
-std::string StorageManager::getChunkPath(const std::string& hash) {
-    // Use first 2 chars as subdirectory for better filesystem performance
-    std::string subdir = hash.substr(0, 2);
-    std::string path = storage_root_ + "/chunks/" + subdir;
+std::optional<uint32_t> StorageManager::trainDictionary(const std::string& client_id,
+                                                        const std::string& extension) {
+    // Enough for the trainer to find common substrings without reading the
+    // whole store
+    constexpr size_t kMaxSamples = 4096;
+    constexpr size_t kMaxSampleBytes = 16 * 1024 * 1024;
+    
+    auto* db = getClientDB(client_id);
+    if (!db) {
+        return std::nullopt;
+    }
+    
+    std::vector<std::vector<uint8_t>> samples;
+    std::unordered_set<Digest> seen;
+    size_t sample_bytes = 0;
+    
+    for (const auto& file : db->getAllFiles()) {
+        if (file.deleted || file.is_directory) {
+            continue;
+        }
+        if (!extension.empty() &&
+            std::filesystem::path(file.path).extension() != "." + extension) {
+            continue;
+        }
+        
+        for (const auto& hash : db->getFileChunks(file.path)) {
+            if (samples.size() == kMaxSamples || sample_bytes >= kMaxSampleBytes) {
+                break;
+            }
+            if (!seen.insert(hash).second) {
+                continue;
+            }
+            // Only chunks that would be compressed with the dictionary
+            auto data = getChunk(hash);
+            if (data.empty() || data.size() > Compression::kDictionaryMaxSize) {
+                continue;
+            }
+            sample_bytes += data.size();
+            samples.push_back(std::move(data));
+        }
+    }
+    
+    std::vector<std::span<const uint8_t>> inputs(samples.begin(), samples.end());
+    return dictionaries_.train(dictionaryScope(client_id, extension), inputs);
+}
+
+std::shared_ptr<const CompressionDictionary> StorageManager::dictionaryFor(
+    const std::string& client_id, const std::string& filepath) const {
+    std::string extension = std::filesystem::path(filepath).extension().string();
+    if (!extension.empty()) {
+        auto dictionary = dictionaries_.latest(dictionaryScope(client_id, extension.substr(1)));
+        if (dictionary) {
+            return dictionary;
+        }
+    }
+    return dictionaries_.latest(dictionaryScope(client_id, ""));
+}
+
+std::string StorageManager::dictionaryScope(const std::string& client_id,
+                                            const std::string& extension) {
+    return extension.empty() ? client_id : client_id + "/" + extension;
+}
+
+std::vector<Digest> StorageManager::scrubChunks() {
+    constexpr size_t kScrubBatchSize = 16;
+    
+    struct Batch {
+        std::vector<Digest> names;
+        std::vector<std::vector<uint8_t>> contents;
+        std::vector<Digest> corrupt;
+    };
+    
+    std::string chunks_dir = storage_root_ + "/chunks";
+    std::filesystem::recursive_directory_iterator entries(chunks_dir), end_of_entries;
+    
+    auto fill = [&](Batch& batch) {
+        batch.names.clear();
+        batch.corrupt.clear();
+        for (; entries != end_of_entries && batch.names.size() < kScrubBatchSize; ++entries) {
+            if (!entries->is_regular_file()) {
+                continue;
+            }
+            if (auto name = Digest::fromHex(entries->path().filename().string())) {
+                batch.names.push_back(*name);
+            }
+        }
+        return !batch.names.empty();
+    };
+    
+    auto verify = [this](Batch& batch) {
+        // Hash the decompressed chunk, not the framed bytes on disk; a frame
+        // that no longer decodes reads back empty and is reported
+        batch.contents.resize(batch.names.size());
+        for (size_t i = 0; i < batch.names.size(); i++) {
+            batch.contents[i] = getChunk(batch.names[i]);
+        }
+        
+        std::vector<std::span<const uint8_t>> inputs(batch.contents.begin(), batch.contents.end());
+        auto digests = Hash::sha256Batch(inputs);
+        for (size_t i = 0; i < batch.names.size(); i++) {
+            // Chunks are addressed by whichever digest their uploader used
+            if (digests[i] != batch.names[i] &&
+                Hash::digest(HashAlgorithm::BLAKE3, inputs[i]) != batch.names[i]) {
+                LOG_ERROR("Corrupt chunk: " + batch.names[i].toHex());
+                batch.corrupt.push_back(batch.names[i]);
+            }
+        }
+    };
+    
+    std::vector<Digest> corrupt;
+    auto collect = [&corrupt](Batch& batch) {
+        corrupt.insert(corrupt.end(), batch.corrupt.begin(), batch.corrupt.end());
+    };
+    
+    if (!pool_) {
+        Batch batch;
+        while (fill(batch)) {
+            verify(batch);
+            collect(batch);
+        }
+        return corrupt;
+    }
+    
+    // Listing stays serial; reads and hashing run on the pool, a few
+    // batches per thread at most so memory stays bounded
+    Pipeline<Batch> pipeline(2 * pool_->size());
+    pipeline.source(fill)
+            .stage(StageMode::Parallel, verify)
+            .stage(StageMode::Serial, collect)
+            .run(*pool_);
+    return corrupt;
+}
+
+bool StorageManager::migrateLegacyChunks() {
+    // Written once every chunk is known to be framed
+    std::string marker = storage_root_ + "/chunk_format";
+    if (std::filesystem::exists(marker)) {
+        return true;
+    }
+    
+    size_t migrated = 0;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(storage_root_ + "/chunks")) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        auto name = Digest::fromHex(entry.path().filename().string());
+        if (!name) {
+            continue;
+        }
+        
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::vector<uint8_t> stored(entry.file_size());
+        file.read(reinterpret_cast<char*>(stored.data()), stored.size());
+        if (!file) {
+            LOG_ERROR("Failed to read chunk: " + entry.path().string());
+            return false;
+        }
+        
+        // A raw chunk hashes to its own name; a frame does not. This also
+        // skips chunks an interrupted earlier run already framed.
+        if (Hash::digest(HashAlgorithm::SHA256, stored) != *name &&
+            Hash::digest(HashAlgorithm::BLAKE3, stored) != *name) {
+            continue;
+        }
+        
+        std::vector<uint8_t> frame(Compression::kFrameHeaderSize + stored.size());
+        Compression::compressInto(stored, frame, CodecChoice{Codec::None, 0});
+        if (!writeFileAtomically(entry.path().string(), frame)) {
+            LOG_ERROR("Failed to write chunk: " + entry.path().string());
+            return false;
+        }
+        migrated++;
+    }
+    
+    std::ofstream out(marker);
+    out << "framed\n";
+    if (!out) {
+        LOG_ERROR("Failed to write chunk format marker: " + marker);
+        return false;
+    }
+    if (migrated > 0) {
+        LOG_INFO("Framed " + std::to_string(migrated) + " legacy chunks");
+    }
+    return true;
+}
+
+std::string StorageManager::getChunkPath(const Digest& hash) {
+    // Use first 2 hex chars as subdirectory for better filesystem performance
+    std::string hex = hash.toHex();
+    std::string path = storage_root_ + "/chunks/" + hex.substr(0, 2);
     std::filesystem::create_directories(path);
-    return path + "/" + hash;
+    return path + "/" + hex;
 }
 
 std::string StorageManager::getClientStoragePath(const std::string& client_id) {
@@ -1,6 +1,12 @@
 #include "server/sync_service.h"
 #include "common/logger.h"
+#include "common/hash.h"
+#include "common/compression.h"
+#include "common/chunker.h"
+#include <charconv>
 #include <chrono>
+#include <fstream>
+#include <sstream>
 
 namespace dropboxlite {
 
@@ -47,28 +53,109 @@ grpc::Status SyncServiceImpl::UploadFile(grpc::ServerContext* context,
     std::string filepath;
     int32_t total_chunks = 0;
     int32_t chunks_received = 0;
+    HashAlgorithm algorithm = HashAlgorithm::SHA256;
     
+    // Chunks are verified and stored in small groups so their hashes can be
+    // checked with one batched digest call
+    constexpr size_t kVerifyBatchSize = 16;
+    std::vector<StorageManager::ChunkUpload> pending;
+    
+    auto flush = [&] {
+        bool ok = storage_->storeChunks(client_id, filepath, pending);
+        chunks_received += ok ? pending.size() : 0;
+        pending.clear();
+        return ok;
+    };
+    
+    BandwidthScheduler::Transfer transfer;
     while (reader->Read(&request)) {
         if (client_id.empty()) {
             client_id = request.client_id();
             filepath = request.file_path();
             total_chunks = request.total_chunks();
+            transfer = upload_bandwidth_.open(client_id);
         }
         
+        // Holding off the next Read lets gRPC flow control push back on
+        // the client
+        transfer.acquire(request.chunk().data().size());
+        
         const auto& chunk = request.chunk();
-        std::vector<uint8_t> data(chunk.data().begin(), chunk.data().end());
         
-        if (!storage_->storeChunk(client_id, filepath, chunk.index(), data, chunk.hash())) {
+        auto hash = Digest::parse(chunk.hash());
+        if (!hash) {
             response->set_success(false);
-            response->set_message("Failed to store chunk");
+            response->set_message("Invalid chunk hash");
+            return grpc::Status::OK;
+        }
+        
+        auto chunk_algorithm = Hash::algorithmFromId(chunk.hash_algorithm());
+        if (!chunk_algorithm) {
+            response->set_success(false);
+            response->set_message("Unsupported hash algorithm");
             return grpc::Status::OK;
         }
+        algorithm = *chunk_algorithm;
         
-        chunks_received++;
+        auto codec = Compression::codecFromId(chunk.codec());
+        if (!codec) {
+            response->set_success(false);
+            response->set_message("Unsupported chunk codec");
+            return grpc::Status::OK;
+        }
+        
+        std::span<const uint8_t> payload(reinterpret_cast<const uint8_t*>(chunk.data().data()),
+                                         chunk.data().size());
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> frame;
+        if (*codec == Codec::None) {
+            data.assign(payload.begin(), payload.end());
+        } else {
+            // Compressed chunks arrive as frames; the recorded size lets them
+            // be decoded straight into a buffer of the right length. That
+            // size is the client's claim, so it is held to what the chunker
+            // can produce before anything is allocated for it.
+            auto size = Compression::decompressedSize(payload);
+            bool valid = size && *size <= Chunker::kMaxChunkSize &&
+                         Compression::frameCodec(payload) == *codec;
+            if (valid) {
+                data.resize(*size);
+                valid = Compression::decompressInto(payload, data);
+            }
+            if (!valid) {
+                response->set_success(false);
+                response->set_message("Invalid compressed chunk");
+                return grpc::Status::OK;
+            }
+            // Kept so storage can store the frame without recompressing it
+            frame.assign(payload.begin(), payload.end());
+        }
+        
+        // Peers that predate the size field send 0
+        if (data.size() > Chunker::kMaxChunkSize ||
+            (chunk.size() != 0 && data.size() != static_cast<size_t>(chunk.size()))) {
+            response->set_success(false);
+            response->set_message("Chunk size mismatch");
+            return grpc::Status::OK;
+        }
+        
+        pending.push_back({chunk.index(), std::move(data), *hash, algorithm, *codec, std::move(frame)});
+        
+        if (pending.size() == kVerifyBatchSize && !flush()) {
+            response->set_success(false);
+            response->set_message("Failed to store chunk");
+            return grpc::Status::OK;
+        }
+    }
+    
+    if (!pending.empty() && !flush()) {
+        response->set_success(false);
+        response->set_message("Failed to store chunk");
+        return grpc::Status::OK;
     }
     
     // Finalize file
-    if (storage_->finalizeFile(client_id, filepath, total_chunks)) {
+    if (storage_->finalizeFile(client_id, filepath, total_chunks, algorithm)) {
         response->set_success(true);
         response->set_chunks_received(chunks_received);
         LOG_INFO("File uploaded successfully: " + filepath);
@@ -95,6 +182,8 @@ grpc::Status SyncServiceImpl::DownloadFile(grpc::ServerContext* context,
     DownloadResponse response;
     response.set_is_last(true);
     
+    auto transfer = download_bandwidth_.open(request->client_id());
+    transfer.acquire(response.ByteSizeLong());
     writer->Write(response);
     
     return grpc::Status::OK;
@@ -150,7 +239,7 @@ std::vector<FileChange> SyncServiceImpl::computeChanges(
                 found = true;
                 
                 // Check for conflicts
-                if (local_file.hash() != server_file.hash) {
+                if (contentDiffers(client_id, local_file, server_file)) {
                     FileChange change;
                     change.set_path(server_file.path);
                     change.set_type(FileChange::MODIFIED);
@@ -171,10 +260,124 @@ std::vector<FileChange> SyncServiceImpl::computeChanges(
     return changes;
 }
 
-bool SyncServiceImpl::detectConflict(const FileMetadata& local, const FileRecord& server) {
-    return local.hash() != server.hash && 
+bool SyncServiceImpl::detectConflict(const std::string& client_id,
+                                     const FileMetadata& local,
+                                     const FileRecord& server) {
+    return contentDiffers(client_id, local, server) && 
            local.version() > 0 && 
            server.version > 0;
 }
 
+bool SyncServiceImpl::contentDiffers(const std::string& client_id,
+                                     const FileMetadata& local,
+                                     const FileRecord& server) {
+    auto algorithm = Hash::algorithmFromId(local.hash_algorithm());
+    if (!algorithm) {
+        return true;
+    }
+    // Either digest missing (unparseable, or the stored file is gone)
+    // cannot prove the contents equal
+    auto local_hash = Digest::parse(local.hash());
+    auto server_hash = storage_->getFileDigest(client_id, server, *algorithm);
+    return !local_hash || !server_hash || *local_hash != *server_hash;
+}
+
+namespace {
+
+// Whole field as an unsigned number
+template<typename T>
+bool parseNumber(const std::string& field, T& value) {
+    const char* end = field.data() + field.size();
+    auto result = std::from_chars(field.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+} // namespace
+
+bool SyncServiceImpl::loadBandwidthLimits(const std::string& path) {
+    struct Limit {
+        size_t rate = 0;
+        uint32_t weight = 1;
+    };
+    struct Direction {
+        size_t global = 0;
+        Limit client_default;
+        std::vector<std::pair<std::string, Limit>> clients;
+    };
+    
+    std::ifstream file(path);
+    if (!file) {
+        LOG_ERROR("Cannot read bandwidth limits: " + path);
+        return false;
+    }
+    
+    // Parse everything before applying anything
+    Direction upload, download;
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key)) {
+            continue;
+        }
+        
+        // "client <id> upload|download" names one client's limit; other
+        // keys name the setting themselves
+        std::string id, setting = key;
+        if (key == "client" &&
+            (!(fields >> id >> setting) || (setting != "upload" && setting != "download"))) {
+            setting.clear();
+        }
+        bool client_default = setting == "client_upload" || setting == "client_download";
+        Direction* target = setting == "upload" || setting == "client_upload" ? &upload :
+                            setting == "download" || setting == "client_download" ? &download :
+                            nullptr;
+        
+        // <rate> [weight], weight only where a client limit is set
+        bool takes_weight = key == "client" || client_default;
+        Limit limit;
+        std::string rate_field, weight_field, extra;
+        bool ok = target && (fields >> rate_field) && parseNumber(rate_field, limit.rate);
+        if (ok && (fields >> weight_field)) {
+            ok = takes_weight && parseNumber(weight_field, limit.weight) && limit.weight > 0;
+        }
+        ok = ok && !(fields >> extra);
+        if (!ok) {
+            LOG_ERROR("Bad bandwidth limit at " + path + ":" + std::to_string(number));
+            return false;
+        }
+        
+        if (key == "client") {
+            target->clients.emplace_back(id, limit);
+        } else if (client_default) {
+            target->client_default = limit;
+        } else {
+            target->global = limit.rate;
+        }
+    }
+    
+    auto apply = [](BandwidthScheduler& scheduler, const Direction& settings,
+                    std::vector<std::string>& limited) {
+        scheduler.setGlobalRate(settings.global);
+        scheduler.setDefaultClientLimit(settings.client_default.rate, settings.client_default.weight);
+        // Clients dropped from the file fall back to the default
+        for (const auto& id : limited) {
+            scheduler.clearClientLimit(id);
+        }
+        limited.clear();
+        for (const auto& [id, limit] : settings.clients) {
+            scheduler.setClientLimit(id, limit.rate, limit.weight);
+            limited.push_back(id);
+        }
+    };
+    apply(upload_bandwidth_, upload, limited_uploaders_);
+    apply(download_bandwidth_, download, limited_downloaders_);
+    
+    LOG_INFO("Bandwidth limits loaded from " + path + ": upload " + std::to_string(upload.global) +
+             " B/s, download " + std::to_string(download.global) + " B/s, " +
+             std::to_string(upload.clients.size() + download.clients.size()) + " client overrides");
+    return true;
+}
+
 } // namespace dropboxlite
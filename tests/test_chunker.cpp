@@ -1,6 +1,12 @@
 #include "common/chunker.h"
+#include "common/hash.h"
+#include "common/thread_pool.h"
 #include <gtest/gtest.h>
 #include <fstream>
+#include <unordered_set>
+#include <algorithm>
+#include <sstream>
+#include <cstring>
 
 using namespace dropboxlite;
 
@@ -28,3 +34,232 @@ TEST(ChunkerTest, EmptyData) {
     
     EXPECT_EQ(chunks.size(), 0);
 }
+
+namespace {
+
+std::vector<uint8_t> randomData(size_t size, uint32_t seed) {
+    std::vector<uint8_t> data(size);
+    uint32_t state = seed;
+    for (auto& byte : data) {
+        state = state * 1664525u + 1013904223u;
+        byte = static_cast<uint8_t>(state >> 24);
+    }
+    return data;
+}
+
+// Byte-at-a-time FastCDC reference for the unrolled gear scan
+size_t referenceGearBoundary(const uint8_t* data, size_t size) {
+    if (size <= Chunker::kMinChunkSize) {
+        return size;
+    }
+    size_t limit = std::min(size, Chunker::kMaxChunkSize);
+    Hash::GearHash gear;
+    for (size_t i = Chunker::kMinChunkSize; i < limit; i++) {
+        gear.append(data[i]);
+        uint64_t mask = i < Chunker::kAvgChunkSize ? Chunker::kGearMaskS
+                                                   : Chunker::kGearMaskL;
+        if ((gear.hash() & mask) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+} // namespace
+
+TEST(ChunkerTest, GearMatchesReference) {
+    auto data = randomData(8 * 1024 * 1024, 1);
+    
+    Chunker chunker(ChunkingAlgorithm::Gear);
+    auto chunks = chunker.chunkData(data);
+    
+    size_t offset = 0;
+    for (const auto& chunk : chunks) {
+        EXPECT_EQ(chunk.offset, offset);
+        EXPECT_EQ(chunk.size, referenceGearBoundary(data.data() + offset,
+                                                    data.size() - offset));
+        offset += chunk.size;
+    }
+    EXPECT_EQ(offset, data.size());
+}
+
+TEST(ChunkerTest, GearChunkSizeBounds) {
+    auto data = randomData(8 * 1024 * 1024, 2);
+    
+    Chunker chunker;
+    auto chunks = chunker.chunkData(data);
+    
+    ASSERT_GT(chunks.size(), 1u);
+    for (size_t i = 0; i + 1 < chunks.size(); i++) {
+        EXPECT_GT(chunks[i].size, Chunker::kMinChunkSize);
+        EXPECT_LE(chunks[i].size, Chunker::kMaxChunkSize);
+    }
+}
+
+TEST(ChunkerTest, GearResynchronizesAfterInsert) {
+    auto data = randomData(4 * 1024 * 1024, 3);
+    auto shifted = data;
+    shifted.insert(shifted.begin(), 17, 0x5a);
+    
+    Chunker chunker;
+    auto original = chunker.chunkData(data);
+    auto modified = chunker.chunkData(shifted);
+    
+    std::unordered_set<Digest> hashes;
+    for (const auto& chunk : original) {
+        hashes.insert(chunk.hash);
+    }
+    size_t shared = 0;
+    for (const auto& chunk : modified) {
+        shared += hashes.count(chunk.hash);
+    }
+    
+    // Only the first chunk should differ
+    EXPECT_GE(shared + 1, original.size());
+}
+
+TEST(ChunkerTest, AlgorithmsAreSelectable) {
+    auto data = randomData(2 * 1024 * 1024, 4);
+    
+    Chunker rabin(ChunkingAlgorithm::Rabin);
+    Chunker gear(ChunkingAlgorithm::Gear);
+    auto rabin_chunks = rabin.chunkData(data);
+    auto gear_chunks = gear.chunkData(data);
+    
+    EXPECT_EQ(rabin.algorithm(), ChunkingAlgorithm::Rabin);
+    EXPECT_TRUE(Chunker::sameBoundaries(rabin_chunks, rabin.chunkData(data)));
+    EXPECT_FALSE(Chunker::sameBoundaries(rabin_chunks, gear_chunks));
+}
+
+TEST(ChunkerTest, StreamMatchesChunkData) {
+    // Larger than the stream window so the window slides several times
+    auto data = randomData(3 * Chunker::kStreamWindowSize + 12345, 5);
+    std::istringstream input(std::string(data.begin(), data.end()));
+    
+    Chunker chunker;
+    auto expected = chunker.chunkData(data);
+    
+    std::vector<ChunkInfo> streamed;
+    ASSERT_TRUE(chunker.chunkStream(input, [&](const ChunkInfo& chunk, const uint8_t* bytes) {
+        EXPECT_EQ(std::memcmp(bytes, data.data() + chunk.offset, chunk.size), 0);
+        streamed.push_back(chunk);
+    }));
+    
+    ASSERT_TRUE(Chunker::sameBoundaries(expected, streamed));
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(expected[i].hash, streamed[i].hash);
+    }
+    EXPECT_EQ(chunker.getLastStats().total_chunks, expected.size());
+}
+
+TEST(ChunkerTest, ChunkFileMissing) {
+    Chunker chunker;
+    EXPECT_TRUE(chunker.chunkFile("/nonexistent/chunker_test.dat").empty());
+    EXPECT_FALSE(chunker.chunkFile("/nonexistent/chunker_test.dat",
+                                   [](const ChunkInfo&, const uint8_t*) {}));
+}
+
+TEST(ChunkerTest, MappedMatchesStream) {
+    auto data = randomData(Chunker::kStreamWindowSize + 54321, 6);
+    std::string path = ::testing::TempDir() + "chunker_mapped_test.dat";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+    
+    Chunker stream;
+    stream.setFileInput(FileInput::Stream);
+    Chunker mapped;
+    mapped.setFileInput(FileInput::Mapped);
+    
+    auto streamed = stream.chunkFile(path);
+    auto mapped_chunks = mapped.chunkFile(path);
+    std::remove(path.c_str());
+    
+    ASSERT_TRUE(Chunker::sameBoundaries(streamed, mapped_chunks));
+    for (size_t i = 0; i < streamed.size(); i++) {
+        EXPECT_EQ(streamed[i].hash, mapped_chunks[i].hash);
+    }
+}
+
+TEST(ChunkerTest, ParallelMatchesSequential) {
+    // Mix random and periodic regions so segment seams land in both
+    auto data = randomData(20 * 1024 * 1024 + 777, 7);
+    for (size_t i = 6 * 1024 * 1024; i < 11 * 1024 * 1024; i++) {
+        data[i] = static_cast<uint8_t>(i % 45);
+    }
+    
+    Chunker sequential;
+    auto expected = sequential.chunkData(data);
+    
+    ThreadPool pool(4);
+    Chunker parallel;
+    parallel.setThreadPool(&pool);
+    auto chunks = parallel.chunkData(data);
+    
+    ASSERT_TRUE(Chunker::sameBoundaries(expected, chunks));
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(expected[i].hash, chunks[i].hash);
+    }
+    EXPECT_EQ(parallel.getLastStats().total_chunks, expected.size());
+}
+
+TEST(ChunkerTest, ScanKernelsMatchScalar) {
+    auto data = randomData(16 * 1024 * 1024 + 99, 8);
+    
+    Chunker scalar;
+    ASSERT_TRUE(scalar.setScanKernel(ScanKernel::Scalar));
+    auto expected = scalar.chunkData(data);
+    
+    for (auto kernel : {ScanKernel::SSE42, ScanKernel::AVX2, ScanKernel::AVX512}) {
+        if (!GearScan::isSupported(kernel)) {
+            continue;
+        }
+        Chunker chunker;
+        ASSERT_TRUE(chunker.setScanKernel(kernel));
+        EXPECT_TRUE(Chunker::sameBoundaries(expected, chunker.chunkData(data)))
+            << GearScan::name(kernel);
+    }
+}
+
+TEST(ChunkerTest, ScanKernelsFindEveryCandidate) {
+    // Loose masks hit often, exercising hits in every lane and block
+    auto data = randomData(256 * 1024, 9);
+    auto scalar = GearScan::get(ScanKernel::Scalar);
+    
+    for (auto kernel : {ScanKernel::SSE42, ScanKernel::AVX2, ScanKernel::AVX512}) {
+        auto scan = GearScan::get(kernel);
+        if (!scan) {
+            continue;
+        }
+        for (uint64_t mask : {0x7ULL << 56, 0x3ffULL << 53}) {
+            for (size_t begin = 0; begin < data.size(); ) {
+                size_t expected = scalar(data.data(), 0, begin, data.size(), mask);
+                ASSERT_EQ(scan(data.data(), 0, begin, data.size(), mask), expected)
+                    << GearScan::name(kernel) << " at " << begin;
+                begin = expected + 1;
+            }
+        }
+    }
+}
+
+TEST(ChunkerTest, FingerprintSinglePass) {
+    auto data = randomData(Chunker::kStreamWindowSize + 4321, 10);
+    std::string path = ::testing::TempDir() + "chunker_fingerprint_test.dat";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+    
+    Chunker chunker;
+    auto fingerprint = chunker.fingerprintFile(path);
+    auto expected_chunks = chunker.chunkFile(path);
+    auto expected_hash = Hash::sha256FileDigest(path);
+    std::remove(path.c_str());
+    
+    ASSERT_TRUE(fingerprint);
+    EXPECT_EQ(fingerprint->size, data.size());
+    EXPECT_EQ(fingerprint->file_hash, *expected_hash);
+    EXPECT_TRUE(Chunker::sameBoundaries(fingerprint->chunks, expected_chunks));
+    EXPECT_FALSE(chunker.fingerprintFile("/nonexistent/chunker_test.dat"));
+}
@@ -0,0 +1,216 @@
+#include "common/compression.h"
+#include "common/dictionary_store.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <random>
+
+using namespace dropboxlite;
+
+namespace {
+
+std::vector<uint8_t> mixedData(size_t size) {
+    // Random runs separated by zeros, so output is neither trivial nor incompressible
+    std::vector<uint8_t> data(size);
+    std::mt19937 rng(42);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (i / 4096) % 2 ? 0 : static_cast<uint8_t>(rng() % 16);
+    }
+    return data;
+}
+
+} // namespace
+
+TEST(CompressionTest, RoundTrip) {
+    for (size_t size : {size_t{1}, size_t{1000}, size_t{300000}}) {
+        auto data = mixedData(size);
+        auto compressed = Compression::compress(data);
+        EXPECT_EQ(Compression::decompressedSize(compressed), size);
+        EXPECT_EQ(Compression::decompress(compressed), data) << "size " << size;
+    }
+    
+    EXPECT_TRUE(Compression::compress({}).empty());
+    EXPECT_TRUE(Compression::decompress({}).empty());
+}
+
+TEST(CompressionTest, ZerosDecompressInOnePass) {
+    std::vector<uint8_t> zeros(8 << 20, 0);
+    auto compressed = Compression::compress(zeros);
+    ASSERT_LT(compressed.size(), zeros.size() / 500);
+    
+    // The recorded size is exact, so the caller's buffer is all that is needed
+    std::vector<uint8_t> out(*Compression::decompressedSize(compressed));
+    EXPECT_TRUE(Compression::decompressInto(compressed, out));
+    EXPECT_EQ(out, zeros);
+    
+    // A buffer of the wrong size is rejected rather than overrun
+    std::vector<uint8_t> small(out.size() - 1);
+    EXPECT_FALSE(Compression::decompressInto(compressed, small));
+}
+
+TEST(CompressionTest, RejectsCorruptFrames) {
+    auto data = mixedData(50000);
+    auto compressed = Compression::compress(data);
+    
+    auto truncated = compressed;
+    truncated.resize(truncated.size() / 2);
+    EXPECT_THROW(Compression::decompress(truncated), std::runtime_error);
+    
+    auto bad_magic = compressed;
+    bad_magic[0] ^= 0xff;
+    EXPECT_FALSE(Compression::decompressedSize(bad_magic));
+    
+    // A length no payload of this size could inflate to
+    auto inflated_claim = compressed;
+    inflated_claim[11] = 0x7f;
+    EXPECT_FALSE(Compression::decompressedSize(inflated_claim));
+    
+    std::vector<uint8_t> small(16);
+    EXPECT_FALSE(Compression::compressInto(data, small));
+}
+
+TEST(CompressionTest, StreamsMatchOneShot) {
+    auto data = mixedData(500000);
+    std::span<const uint8_t> bytes(data);
+    
+    Compression::CompressStream compressor(data.size(), 1);
+    std::vector<uint8_t> frame;
+    for (size_t offset = 0; offset < data.size(); offset += 70000) {
+        ASSERT_TRUE(compressor.update(bytes.subspan(offset, std::min<size_t>(70000, data.size() - offset)), frame));
+    }
+    ASSERT_TRUE(compressor.finish(frame));
+    EXPECT_EQ(Compression::decompress(frame), data);
+    
+    // Fed in small pieces, including a split header
+    Compression::DecompressStream decompressor;
+    std::vector<uint8_t> out;
+    std::span<const uint8_t> input(frame);
+    for (size_t offset = 0; offset < input.size(); offset += 5) {
+        ASSERT_TRUE(decompressor.update(input.subspan(offset, std::min<size_t>(5, input.size() - offset)),
+                                        [&](std::span<const uint8_t> piece) {
+                                            out.insert(out.end(), piece.begin(), piece.end());
+                                        }));
+    }
+    EXPECT_TRUE(decompressor.finished());
+    EXPECT_EQ(decompressor.expectedSize(), data.size());
+    EXPECT_EQ(out, data);
+    
+    // Declared total must match what was fed
+    Compression::CompressStream short_stream(10);
+    std::vector<uint8_t> ignored;
+    EXPECT_TRUE(short_stream.update(bytes.subspan(0, 5), ignored));
+    EXPECT_FALSE(short_stream.finish(ignored));
+}
+
+TEST(CompressionTest, EveryCodecRoundTrips) {
+    auto data = mixedData(200000);
+    for (Codec id : {Codec::None, Codec::Zlib, Codec::Zstd, Codec::LZ4}) {
+        const CompressionCodec* codec = Compression::codec(id);
+        if (!codec) {
+            continue;
+        }
+        SCOPED_TRACE(Compression::codecName(id));
+        
+        std::vector<uint8_t> frame(Compression::maxCompressedSize(data.size()));
+        auto size = Compression::compressInto(data, frame, CodecChoice{id, codec->defaultLevel()});
+        ASSERT_TRUE(size);
+        frame.resize(*size);
+        
+        EXPECT_EQ(Compression::frameCodec(frame), id);
+        EXPECT_EQ(Compression::decompress(frame), data);
+    }
+    
+    EXPECT_TRUE(Compression::codec(Codec::Zlib));
+    EXPECT_FALSE(Compression::codecFromId(9));
+}
+
+TEST(CompressionTest, ChoosesCodecFromSample) {
+    std::vector<uint8_t> random(64 * 1024);
+    std::mt19937 rng(7);
+    for (auto& byte : random) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    EXPECT_EQ(Compression::chooseCodec(random).codec, Codec::None);
+    
+    // Incompressible data is stored as-is rather than expanded
+    auto stored = Compression::compressAdaptive(random);
+    EXPECT_EQ(Compression::frameCodec(stored), Codec::None);
+    EXPECT_EQ(stored.size(), Compression::kFrameHeaderSize + random.size());
+    
+    // Recognised by its signature even if the sample looks compressible
+    std::vector<uint8_t> jpeg(8192, 0);
+    jpeg[0] = 0xff;
+    jpeg[1] = 0xd8;
+    jpeg[2] = 0xff;
+    EXPECT_TRUE(Compression::estimate(jpeg).precompressed);
+    EXPECT_EQ(Compression::chooseCodec(jpeg).codec, Codec::None);
+    
+    std::string line = "int main(int argc, char** argv) { return run(argc, argv); }\n";
+    std::vector<uint8_t> text;
+    while (text.size() < 32 * 1024) {
+        text.insert(text.end(), line.begin(), line.end());
+    }
+    EXPECT_NE(Compression::chooseCodec(text).codec, Codec::None);
+    auto compressed = Compression::compressAdaptive(text);
+    EXPECT_LT(compressed.size(), text.size() / 10);
+    EXPECT_EQ(Compression::decompress(compressed), text);
+    
+    // Too small to bother
+    EXPECT_EQ(Compression::chooseCodec(std::span(text).subspan(0, 100)).codec, Codec::None);
+}
+
+TEST(CompressionTest, DictionaryCompressesSmallChunks) {
+    if (!Compression::codec(Codec::Zstd)) {
+        GTEST_SKIP() << "built without zstd";
+    }
+    
+    // Many small config files sharing structure but not content
+    auto config = [](size_t i) {
+        std::string text = "{\n  \"service\": \"worker-" + std::to_string(i) + "\",\n"
+                           "  \"replicas\": " + std::to_string(i % 7 + 1) + ",\n"
+                           "  \"image\": \"registry.internal/team/worker:" + std::to_string(i * 13) + "\",\n"
+                           "  \"env\": {\"LOG_LEVEL\": \"info\", \"REGION\": \"zone-" +
+                           std::to_string(i % 5) + "\"},\n"
+                           "  \"healthcheck\": {\"path\": \"/healthz\", \"interval_seconds\": 30}\n}\n";
+        return std::vector<uint8_t>(text.begin(), text.end());
+    };
+    
+    std::vector<std::vector<uint8_t>> samples;
+    for (size_t i = 0; i < 500; i++) {
+        samples.push_back(config(i));
+    }
+    std::vector<std::span<const uint8_t>> inputs(samples.begin(), samples.end());
+    
+    std::string root = ::testing::TempDir() + "dictionary_store_test";
+    std::filesystem::remove_all(root);
+    
+    std::shared_ptr<const CompressionDictionary> dictionary;
+    {
+        DictionaryStore store(root);
+        ASSERT_TRUE(store.initialize());
+        auto id = store.train("client/json", inputs);
+        ASSERT_TRUE(id);
+        EXPECT_GE(*id, CompressionDictionary::kMinId);
+        dictionary = store.latest("client/json");
+        ASSERT_TRUE(dictionary);
+        EXPECT_FALSE(store.latest("client"));
+    }
+    
+    auto chunk = config(100000);
+    auto plain = Compression::compressAdaptive(chunk);
+    auto with_dictionary = Compression::compressAdaptive(chunk, dictionary.get());
+    EXPECT_LT(with_dictionary.size(), plain.size() / 2);
+    EXPECT_EQ(Compression::decompress(with_dictionary), chunk);
+    
+    // A reopened store finds the version on disk, and new ones get higher ids
+    DictionaryStore reopened(root);
+    ASSERT_TRUE(reopened.initialize());
+    ASSERT_TRUE(reopened.latest("client/json"));
+    EXPECT_EQ(reopened.latest("client/json")->id(), dictionary->id());
+    auto next = reopened.train("client/json", inputs);
+    ASSERT_TRUE(next);
+    EXPECT_GT(*next, dictionary->id());
+    
+    // The old version still decodes frames that name it
+    EXPECT_EQ(Compression::decompress(with_dictionary), chunk);
+    std::filesystem::remove_all(root);
+}
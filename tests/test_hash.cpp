@@ -1,5 +1,11 @@
 #include "common/hash.h"
+#include "common/thread_pool.h"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <sys/stat.h>
 
 using namespace dropboxlite;
 
@@ -19,6 +25,205 @@ TEST(HashTest, SHA256Consistency) {
     EXPECT_EQ(hash1, hash2);
 }
 
+TEST(HashTest, SHA256Span) {
+    std::vector<uint8_t> data = {'a', 'b', 'c', 'd', 'e'};
+    std::span<const uint8_t> span(data);
+    
+    EXPECT_EQ(Hash::sha256(span), Hash::sha256(data));
+    EXPECT_EQ(Hash::sha256(span.subspan(1, 3)), Hash::sha256(std::string("bcd")));
+    EXPECT_EQ(Hash::sha256(std::string("abc")),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST(HashTest, DigestHexRoundTrip) {
+    Digest digest = Hash::sha256Digest(std::span<const uint8_t>());
+    std::string hex = digest.toHex();
+    
+    EXPECT_EQ(hex, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(Digest::fromHex(hex), digest);
+    EXPECT_EQ(Digest::parse(hex), digest);
+    EXPECT_EQ(Digest::parse(digest.toBytes()), digest);
+    EXPECT_FALSE(Digest::fromHex("e3b0"));
+    EXPECT_FALSE(Digest::fromHex(std::string(64, 'g')));
+}
+
+TEST(HashTest, DigestMatchesHexAPI) {
+    std::string data = "test data";
+    std::span<const uint8_t> bytes(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    
+    EXPECT_EQ(Hash::sha256Digest(bytes).toHex(), Hash::sha256(data));
+    EXPECT_NE(std::hash<Digest>()(Hash::sha256Digest(bytes)),
+              std::hash<Digest>()(Hash::sha256Digest(bytes.subspan(1))));
+}
+
+TEST(HashTest, Sha256StreamMatchesOneShot) {
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i * 31);
+    }
+    std::span<const uint8_t> bytes(data);
+    
+    Hash::Sha256Stream stream;
+    stream.update(bytes.subspan(0, 7));
+    stream.update(bytes.subspan(7, 40000));
+    stream.update(bytes.subspan(40007));
+    
+    EXPECT_EQ(stream.finish(), Hash::sha256Digest(bytes));
+    
+    // Stream restarts after finish
+    stream.update(bytes.subspan(0, 10));
+    EXPECT_EQ(stream.finish(), Hash::sha256Digest(bytes.subspan(0, 10)));
+}
+
+TEST(HashTest, Sha256BatchMatchesOneShot) {
+    std::vector<uint8_t> data(300000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+    }
+    std::span<const uint8_t> bytes(data);
+
+    // Padding edge cases, then a mix of lengths so lanes finish at different times
+    std::vector<size_t> lengths = {0, 1, 55, 56, 63, 64, 65, 119, 120, 1000, 100000};
+    for (size_t i = 0; i < 40; i++) {
+        lengths.push_back((i * 7919) % 20000);
+    }
+
+    std::vector<std::span<const uint8_t>> inputs;
+    size_t offset = 0;
+    for (size_t length : lengths) {
+        inputs.push_back(bytes.subspan(offset % 1000, length));
+        offset += 17;
+    }
+
+    for (auto kernel : {Sha256Kernel::Scalar, Sha256Kernel::SHANI, Sha256Kernel::AVX2}) {
+        if (!Hash::isSupported(kernel)) {
+            continue;
+        }
+        SCOPED_TRACE(Hash::sha256KernelName(kernel));
+
+        std::vector<Digest> digests(inputs.size());
+        Hash::sha256Batch(inputs, digests, kernel);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            EXPECT_EQ(digests[i], Hash::sha256Digest(inputs[i])) << "length " << inputs[i].size();
+        }
+
+        // Batches smaller than the lane count
+        Hash::sha256Batch(std::span(inputs).subspan(0, 3), digests, kernel);
+        for (size_t i = 0; i < 3; i++) {
+            EXPECT_EQ(digests[i], Hash::sha256Digest(inputs[i]));
+        }
+    }
+
+    EXPECT_EQ(Hash::sha256Batch(inputs).size(), inputs.size());
+}
+
+TEST(HashTest, Blake3KnownVectors) {
+    // Official test vectors: input byte i is i % 251
+    std::vector<uint8_t> data(102400);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i % 251);
+    }
+    std::span<const uint8_t> bytes(data);
+    
+    std::vector<std::pair<size_t, std::string>> vectors = {
+        {0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+        {1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+        {1023, "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11"},
+        {1024, "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+        {1025, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+        {2048, "e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a"},
+        {102400, "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085"},
+    };
+    for (const auto& [length, hex] : vectors) {
+        EXPECT_EQ(Hash::blake3(bytes.subspan(0, length)).toHex(), hex) << "length " << length;
+    }
+}
+
+TEST(HashTest, Blake3StreamMatchesOneShot) {
+    std::vector<uint8_t> data(70000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i * 31);
+    }
+    std::span<const uint8_t> bytes(data);
+    
+    Hash::Blake3Stream stream;
+    for (size_t length : {0, 64, 1024, 3000, 8192, 9217, 70000}) {
+        // Uneven pieces so updates straddle block and chunk boundaries
+        size_t offset = 0;
+        for (size_t piece = 1; offset < length; piece = piece * 3 + 1) {
+            size_t n = std::min(piece, length - offset);
+            stream.update(bytes.subspan(offset, n));
+            offset += n;
+        }
+        EXPECT_EQ(stream.finish(), Hash::blake3(bytes.subspan(0, length))) << "length " << length;
+    }
+}
+
+TEST(HashTest, AlgorithmDispatch) {
+    std::string text = "abc";
+    std::span<const uint8_t> bytes(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+    
+    EXPECT_EQ(Hash::digest(HashAlgorithm::BLAKE3, bytes).toHex(),
+              "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85");
+    EXPECT_EQ(Hash::digest(HashAlgorithm::SHA256, bytes), Hash::sha256Digest(bytes));
+    
+    Hash::Stream stream(HashAlgorithm::BLAKE3);
+    stream.update(bytes);
+    EXPECT_EQ(stream.finish(), Hash::blake3(bytes));
+    
+    EXPECT_EQ(Hash::algorithmFromId(1), HashAlgorithm::BLAKE3);
+    EXPECT_FALSE(Hash::algorithmFromId(7));
+}
+
+TEST(HashTest, FileDigestMatchesOneShot) {
+    std::vector<uint8_t> data(5 * 1024 * 1024 + 12345);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>((i * 2654435761u) >> 11);
+    }
+    std::string path = ::testing::TempDir() + "hash_file_digest_test.dat";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+    
+    ThreadPool pool(4);
+    FileHashOptions single_read;
+    single_read.block_size = 8 << 20;
+    FileHashOptions double_buffered;
+    double_buffered.block_size = 100000;  // Rounded up to a page, not a divisor of the size
+    FileHashOptions parallel;
+    parallel.parallel_threshold = 0;
+    parallel.pool = &pool;
+    
+    for (auto algorithm : {HashAlgorithm::SHA256, HashAlgorithm::BLAKE3}) {
+        SCOPED_TRACE(Hash::algorithmName(algorithm));
+        Digest expected = Hash::digest(algorithm, data);
+        for (const auto& options : {single_read, double_buffered, parallel}) {
+            EXPECT_EQ(Hash::fileDigest(algorithm, path, options), expected);
+        }
+    }
+    std::remove(path.c_str());
+    
+    EXPECT_FALSE(Hash::fileDigest(HashAlgorithm::SHA256, path));
+    
+    // Pipes cannot be pread; they are read sequentially instead
+    ASSERT_EQ(::mkfifo(path.c_str(), 0600), 0);
+    std::thread writer([&] {
+        std::ofstream fifo(path, std::ios::binary);
+        fifo.write(reinterpret_cast<const char*>(data.data()), data.size());
+    });
+    EXPECT_EQ(Hash::fileDigest(HashAlgorithm::SHA256, path, double_buffered),
+              Hash::digest(HashAlgorithm::SHA256, data));
+    writer.join();
+    std::remove(path.c_str());
+    
+    // Subtree split points that do and do not fall on chunk boundaries
+    for (size_t length : {size_t{2} << 20, (size_t{3} << 20) + 1, data.size()}) {
+        std::span<const uint8_t> bytes(data.data(), length);
+        EXPECT_EQ(Hash::blake3(bytes, &pool), Hash::blake3(bytes)) << "length " << length;
+    }
+}
+
 TEST(HashTest, RollingHash) {
     Hash::RollingHash rh(10);
     
@@ -0,0 +1,257 @@
+#include "common/metrics.h"
+#include "common/metrics_server.h"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+using namespace dropboxlite;
+
+TEST(MetricsTest, HandlesAreStableAndShared) {
+    auto& metrics = Metrics::instance();
+    Counter& counter = metrics.counter("test.handles");
+    
+    EXPECT_EQ(&counter, &metrics.counter("test.handles"));
+    counter.add(5);
+    metrics.incrementCounter("test.handles", 2);
+    EXPECT_EQ(metrics.getCounter("test.handles"), 7);
+    
+    metrics.gauge("test.gauge").set(42);
+    EXPECT_EQ(metrics.getGauge("test.gauge"), 42);
+    EXPECT_EQ(metrics.getCounter("test.missing"), 0);
+    
+    // Reset zeroes values but keeps the handle registered
+    metrics.reset();
+    EXPECT_EQ(counter.value(), 0);
+    counter.add();
+    EXPECT_EQ(metrics.getCounter("test.handles"), 1);
+}
+
+TEST(MetricsTest, ShardedUpdatesSumOnRead) {
+    Counter& counter = Metrics::instance().counter("test.sharded");
+    Histogram& histogram = Metrics::instance().histogram("test.sharded_latency");
+    counter.reset();
+    histogram.reset();
+    
+    constexpr int kThreads = 8;
+    constexpr int kPerThread = 10000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kPerThread; i++) {
+                counter.add();
+                histogram.record(t * kPerThread + i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    EXPECT_EQ(counter.value(), kThreads * kPerThread);
+    Histogram::Snapshot stats = histogram.snapshot();
+    EXPECT_EQ(stats.count, kThreads * kPerThread);
+    EXPECT_EQ(stats.min, 0);
+    EXPECT_EQ(stats.max, kThreads * kPerThread - 1);
+}
+
+TEST(MetricsTest, ToStringWithThroughput) {
+    auto& metrics = Metrics::instance();
+    metrics.recordBytes("test.bytes", 1 << 20);
+    metrics.histogram("test.scope", HistogramOptions{5, {std::chrono::seconds(60)}});
+    {
+        MEASURE_LATENCY("test.scope");
+    }
+    
+    std::string text = metrics.toString();
+    EXPECT_NE(text.find("test.bytes"), std::string::npos);
+    EXPECT_NE(text.find("test.scope"), std::string::npos);
+    EXPECT_EQ(metrics.histogram("test.scope").snapshot().count, 1);
+    EXPECT_NE(text.find("p999="), std::string::npos);
+    EXPECT_NE(text.find("last 60s"), std::string::npos);
+}
+
+TEST(MetricsTest, PercentilesWithinPrecision) {
+    Histogram histogram(HistogramOptions{7, {}});
+    for (int64_t value = 1; value <= 100000; value++) {
+        histogram.record(value);
+    }
+    
+    Histogram::Snapshot stats = histogram.snapshot();
+    EXPECT_EQ(stats.count, 100000);
+    EXPECT_EQ(stats.min, 1);
+    EXPECT_EQ(stats.max, 100000);
+    for (double q : {0.5, 0.9, 0.99, 0.999}) {
+        double exact = q * 100000;
+        EXPECT_NEAR(stats.percentile(q), exact, exact / 128 + 1) << "q=" << q;
+    }
+    EXPECT_EQ(stats.percentile(1.0), 100000);
+    
+    // Small values are exact
+    Histogram small;
+    small.record(3);
+    EXPECT_EQ(small.snapshot().percentile(0.5), 3);
+}
+
+TEST(MetricsTest, SnapshotsMergeAcrossPrecisions) {
+    Histogram fine(HistogramOptions{8, {}});
+    Histogram coarse(HistogramOptions{3, {}});
+    for (int i = 0; i < 1000; i++) {
+        fine.record(1000);
+        coarse.record(1000000);
+    }
+    
+    Histogram::Snapshot merged = fine.snapshot();
+    merged.merge(coarse.snapshot());
+    EXPECT_EQ(merged.count, 2000);
+    EXPECT_EQ(merged.max, 1000000);
+    EXPECT_NEAR(merged.percentile(0.25), 1000, 1000 / 256 + 1);
+    EXPECT_NEAR(merged.percentile(0.75), 1000000, 1000000 / 8);
+}
+
+TEST(MetricsTest, WindowForgetsOldSamples) {
+    WindowedHistogram window(std::chrono::seconds(1), 5, 4);
+    window.record(500);
+    EXPECT_EQ(window.snapshot().count, 1);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    window.record(7);
+    HistogramSnapshot recent = window.snapshot();
+    EXPECT_EQ(recent.count, 1);
+    EXPECT_EQ(recent.max, 7);
+}
+
+TEST(MetricsTest, OpenMetricsText) {
+    auto& metrics = Metrics::instance();
+    metrics.counter("test.om-requests").add(3);
+    metrics.gauge("test.om.depth").set(-2);
+    metrics.histogram("test.om.latency", HistogramOptions{5, {std::chrono::seconds(60)}}).record(40);
+    metrics.throughput("test.om.upload").add(1000);
+    
+    std::string text;
+    metrics.writeOpenMetrics(text);
+    EXPECT_NE(text.find("# TYPE test_om_requests counter\ntest_om_requests_total 3\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE test_om_depth gauge\ntest_om_depth -2\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE test_om_latency summary\n"), std::string::npos);
+    EXPECT_NE(text.find("test_om_latency{quantile=\"0.99\"} 40\n"), std::string::npos);
+    EXPECT_NE(text.find("test_om_latency_count 1\n"), std::string::npos);
+    EXPECT_NE(text.find("test_om_latency{window=\"60s\",quantile=\"0.5\"} 40\n"), std::string::npos);
+    EXPECT_NE(text.find("test_om_latency_sum{window=\"60s\"} 40\n"), std::string::npos);
+    EXPECT_NE(text.find("test_om_upload_bytes_total 1000\n"), std::string::npos);
+    EXPECT_EQ(text.substr(text.size() - 6), "# EOF\n");
+    
+    // Appends; a cleared buffer renders the same again
+    size_t size = text.size();
+    text.clear();
+    metrics.writeOpenMetrics(text);
+    EXPECT_EQ(text.size(), size);
+}
+
+TEST(MetricsTest, OpenMetricsFamilyNamesStayUnique) {
+    auto& metrics = Metrics::instance();
+    // Both render as test_clash_a_b; so does the counter's family
+    metrics.gauge("test.clash.a_b").set(1);
+    metrics.gauge("test.clash_a.b").set(2);
+    metrics.counter("test.clash.a.b").add(3);
+    // Different kinds under one name clash too, throughput's _bytes aside
+    metrics.throughput("test.clash.a_b").add(4);
+    
+    std::string text;
+    metrics.writeOpenMetrics(text);
+    size_t first = text.find("# TYPE test_clash_a_b ");
+    ASSERT_NE(first, std::string::npos);
+    EXPECT_EQ(text.find("# TYPE test_clash_a_b ", first + 1), std::string::npos);
+    EXPECT_NE(text.find("# TYPE test_clash_a_b gauge\ntest_clash_a_b 1\n"), std::string::npos);
+    EXPECT_NE(text.find("test_clash_a_b_bytes_total 4\n"), std::string::npos);
+    
+    // Left out of the export only; the handles still work
+    EXPECT_EQ(metrics.getGauge("test.clash_a.b"), 2);
+    EXPECT_EQ(metrics.counter("test.clash.a.b").value(), 3);
+    
+    // Families appended from an offset on must not repeat any before it
+    std::string families = "# TYPE a gauge\na 1\n# TYPE b gauge\nb 2\n";
+    size_t from = families.size();
+    families += "# TYPE a counter\na_total 3\n# TYPE c gauge\nc 4\n# TYPE c gauge\nc 5\n";
+    auto dropped = openmetrics::dropDuplicateFamilies(families, from);
+    EXPECT_EQ(families, "# TYPE a gauge\na 1\n# TYPE b gauge\nb 2\n# TYPE c gauge\nc 4\n");
+    EXPECT_EQ(dropped, (std::vector<std::string>{"a", "c"}));
+}
+
+namespace {
+
+std::string httpRequest(uint16_t port, const std::string& method, const std::string& path) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return "";
+    }
+    std::string request = method + " " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ::send(fd, request.data(), request.size(), 0);
+    std::string response;
+    char buffer[4096];
+    ssize_t received;
+    while ((received = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, static_cast<size_t>(received));
+    }
+    ::close(fd);
+    return response;
+}
+
+} // namespace
+
+TEST(MetricsTest, ServerServesScrapes) {
+    auto stats = ProcessStats::read();
+    ASSERT_TRUE(stats.has_value());
+    EXPECT_GT(stats->resident_bytes, 0);
+    EXPECT_GT(stats->open_fds, 0);
+    EXPECT_GE(stats->threads, 1);
+    
+    MetricsServer server;
+    int collected = 0;
+    server.addCollector([&collected] {
+        Metrics::instance().setGauge("test.server.collected", ++collected);
+    });
+    server.addExporter([](std::string& out) {
+        // Already registered; dropped rather than repeated
+        openmetrics::appendFamily(out, "test.server.collected", "", "gauge");
+        openmetrics::appendSample(out, "test.server.collected", "", "", 99);
+        std::string labels;
+        openmetrics::appendLabel(labels, "client", "a\"b");
+        openmetrics::appendFamily(out, "test.server.per_client", "", "gauge");
+        openmetrics::appendSample(out, "test.server.per_client", "", labels, 7);
+    });
+    ASSERT_TRUE(server.start(0, "127.0.0.1"));
+    ASSERT_NE(server.port(), 0);
+    EXPECT_FALSE(server.start(0, "127.0.0.1"));
+    
+    std::string response = httpRequest(server.port(), "GET", "/metrics");
+    EXPECT_EQ(response.rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+    EXPECT_NE(response.find("application/openmetrics-text"), std::string::npos);
+    EXPECT_NE(response.find("process_resident_bytes "), std::string::npos);
+    EXPECT_NE(response.find("process_open_fds "), std::string::npos);
+    EXPECT_NE(response.find("# TYPE process_cpu_seconds counter\nprocess_cpu_seconds_total "),
+              std::string::npos);
+    EXPECT_EQ(response.find("process_cpu_ms"), std::string::npos);
+    EXPECT_NE(response.find("test_server_collected 1\n"), std::string::npos);
+    EXPECT_EQ(response.find("test_server_collected 99\n"), std::string::npos);
+    EXPECT_NE(response.find("test_server_per_client{client=\"a\\\"b\"} 7\n"), std::string::npos);
+    EXPECT_EQ(response.substr(response.size() - 6), "# EOF\n");
+    
+    EXPECT_EQ(httpRequest(server.port(), "GET", "/other").rfind("HTTP/1.1 404", 0), 0u);
+    std::string rejected = httpRequest(server.port(), "POST", "/metrics");
+    EXPECT_EQ(rejected.rfind("HTTP/1.1 405", 0), 0u);
+    EXPECT_NE(rejected.find("\r\nAllow: GET, HEAD\r\n"), std::string::npos);
+    EXPECT_EQ(collected, 1);
+    
+    server.stop();
+    EXPECT_EQ(server.port(), 0);
+}
@@ -1,6 +1,14 @@
 #include "common/rate_limiter.h"
+#include "common/bandwidth_scheduler.h"
+#include "common/metrics.h"
+#include "common/timer_wheel.h"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace dropboxlite;
 
@@ -38,3 +46,197 @@ TEST(RateLimiterTest, RateChange) {
     limiter.setRate(2048);
     EXPECT_EQ(limiter.getRate(), 2048);
 }
+
+TEST(RateLimiterTest, ConcurrentTryAcquireNeverOverspends) {
+    RateLimiter limiter(1000, 100000); // Refills too slowly to matter
+    
+    std::atomic<size_t> granted{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 10000; i++) {
+                if (limiter.tryAcquire(7)) {
+                    granted += 7;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    EXPECT_LE(granted.load(), 100000u + 100);
+    EXPECT_GE(granted.load(), 100000u - 7);
+}
+
+TEST(RateLimiterTest, RequestsLargerThanBurstWait) {
+    RateLimiter limiter(100000, 1000);
+    
+    auto start = std::chrono::steady_clock::now();
+    limiter.acquire(1000);
+    limiter.acquire(5000); // 50 ms of credit
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    
+    EXPECT_GE(elapsed, std::chrono::milliseconds(45));
+    EXPECT_FALSE(limiter.tryAcquire(1000));
+}
+
+TEST(RateLimiterTest, AcquireAsyncCompletesInOrder) {
+    TimerWheel wheel;
+    RateLimiter limiter(100000, 1000);
+    limiter.setTimerWheel(&wheel);
+    
+    std::mutex mutex;
+    std::vector<int> order;
+    std::atomic<int> done{0};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 5; i++) {
+        limiter.acquireAsync(1000, [&, i] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(i);
+            done++;
+        });
+    }
+    while (done < 5) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    // First from the burst, the rest 10 ms apart
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(38));
+    EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3, 4}));
+}
+
+TEST(RateLimiterTest, AcquireAsyncAwaitable) {
+    ThreadPool pool(2);
+    Executor executor(pool);
+    RateLimiter limiter(100000, 1000);
+    
+    auto send = [](Executor& executor, RateLimiter& limiter) -> Task<void> {
+        for (int i = 0; i < 3; i++) {
+            co_await limiter.acquireAsync(executor, 1000);
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    syncWait(send(executor, limiter));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(18));
+}
+
+TEST(TimerWheelTest, FiresNoEarlierThanDeadline) {
+    TimerWheel wheel(std::chrono::milliseconds(1), 8); // Small ring: later rounds share slots
+    
+    std::atomic<int> fired{0};
+    std::atomic<bool> early{false};
+    auto start = TimerWheel::Clock::now();
+    for (int ms : {30, 1, 9, 17, 0, 25}) {
+        auto deadline = start + std::chrono::milliseconds(ms);
+        wheel.schedule(deadline, [&, deadline] {
+            if (TimerWheel::Clock::now() < deadline) {
+                early = true;
+            }
+            fired++;
+        });
+    }
+    while (fired < 6) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    EXPECT_FALSE(early.load());
+    EXPECT_EQ(wheel.pending(), 0u);
+}
+
+TEST(BandwidthSchedulerTest, WeightsSplitContendedBandwidth) {
+    TimerWheel wheel;
+    BandwidthScheduler scheduler(1000000); // 1 ms per 1000-byte request
+    scheduler.setTimerWheel(&wheel);
+    scheduler.setClientLimit("bulk", 0, 1);
+    scheduler.setClientLimit("interactive", 0, 2);
+    
+    // Drain the global burst so the requests below have to queue
+    auto warmup = scheduler.open("warmup");
+    warmup.acquire(1000000);
+    
+    std::mutex mutex;
+    std::vector<std::string> order;
+    std::atomic<int> done{0};
+    auto bulk = scheduler.open("bulk");
+    auto interactive = scheduler.open("interactive");
+    for (auto* transfer : {&bulk, &interactive}) {
+        std::string name = transfer == &bulk ? "bulk" : "interactive";
+        for (int i = 0; i < 30; i++) {
+            transfer->acquireAsync(1000, [&, name] {
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(name);
+                done++;
+            });
+        }
+    }
+    while (done < 60) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    // The first bulk request went before the rest were queued; after
+    // that, interactive gets two grants for each bulk one
+    auto interactive_share = std::count(order.begin() + 1, order.begin() + 31, "interactive");
+    EXPECT_GE(interactive_share, 18);
+    EXPECT_LE(interactive_share, 22);
+    EXPECT_EQ(bulk.bytes(), 30000u);
+}
+
+TEST(BandwidthSchedulerTest, CappedClientDoesNotHoldBackOthers) {
+    TimerWheel wheel;
+    BandwidthScheduler scheduler;
+    scheduler.setTimerWheel(&wheel);
+    scheduler.setClientLimit("capped", 10000);
+    
+    auto capped = scheduler.open("capped");
+    std::atomic<int> capped_done{0};
+    for (int i = 0; i < 3; i++) {
+        capped.acquireAsync(10000, [&] { capped_done++; });
+    }
+    
+    // Its burst and one request on credit go at once; the third waits a
+    // second for its cap while the other client runs freely
+    auto start = std::chrono::steady_clock::now();
+    auto other = scheduler.open("other");
+    for (int i = 0; i < 10; i++) {
+        other.acquire(100000);
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+    EXPECT_EQ(capped_done.load(), 2);
+    ASSERT_TRUE(scheduler.clientStats("capped"));
+    EXPECT_EQ(scheduler.clientStats("capped")->queued, 1u);
+    
+    // Lifting the cap at runtime releases it
+    scheduler.setClientLimit("capped", 0);
+    EXPECT_EQ(capped_done.load(), 3);
+    
+    scheduler.publishMetrics("test.bandwidth");
+    EXPECT_EQ(Metrics::instance().getGauge("test.bandwidth.clients"), 2);
+    
+    // Per-client values are labels on fixed families, never metric names
+    std::string text;
+    scheduler.writeOpenMetrics(text, "test.bandwidth");
+    EXPECT_NE(text.find("# TYPE test_bandwidth_client_bytes counter\n"), std::string::npos);
+    EXPECT_NE(text.find("test_bandwidth_client_bytes_total{client=\"other\"} 1000000\n"), std::string::npos);
+    EXPECT_NE(text.find("test_bandwidth_client_rate_limit{client=\"capped\"} 0\n"), std::string::npos);
+    EXPECT_EQ(Metrics::instance().getGauge("test.bandwidth.client.other.bytes"), 0);
+}
+
+TEST(BandwidthSchedulerTest, TransferAcquireIsAwaitable) {
+    ThreadPool pool(2);
+    Executor executor(pool);
+    BandwidthScheduler scheduler(1000000);
+    auto transfer = scheduler.open("client");
+    
+    auto send = [](Executor& executor, BandwidthScheduler::Transfer& transfer) -> Task<void> {
+        for (int i = 0; i < 24; i++) {
+            co_await transfer.acquireAsync(executor, 50000);
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    syncWait(send(executor, transfer));
+    
+    // 1.2 MB against a 1 MB burst: the last 150 ms or so are paced
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+    EXPECT_EQ(transfer.bytes(), 1200000u);
+}
@@ -0,0 +1,201 @@
+#include "server/storage_manager.h"
+#include "common/compression.h"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <cstring>
+
+using namespace dropboxlite;
+
+namespace {
+
+// Text-like data that every codec compresses
+std::vector<uint8_t> textData(size_t size, uint32_t seed) {
+    static const char* kWords[] = {"chunk ", "sync ", "delta ", "client ", "server ", "file\n"};
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data;
+    while (data.size() < size) {
+        const char* word = kWords[rng() % 6];
+        data.insert(data.end(), word, word + std::strlen(word));
+    }
+    data.resize(size);
+    return data;
+}
+
+// Small config files sharing structure but not content
+std::vector<uint8_t> config(size_t i) {
+    std::string text = "{\n  \"service\": \"worker-" + std::to_string(i) + "\",\n"
+                       "  \"replicas\": " + std::to_string(i % 7 + 1) + ",\n"
+                       "  \"image\": \"registry.internal/team/worker:" + std::to_string(i * 13) + "\",\n"
+                       "  \"env\": {\"LOG_LEVEL\": \"info\", \"REGION\": \"zone-" +
+                       std::to_string(i % 5) + "\"},\n"
+                       "  \"healthcheck\": {\"path\": \"/healthz\", \"interval_seconds\": 30}\n}\n";
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+class StorageManagerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        root_ = ::testing::TempDir() + "storage_manager_test";
+        std::filesystem::remove_all(root_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(root_);
+    }
+
+    // Where the store keeps a chunk
+    std::string chunkPath(const Digest& hash) const {
+        std::string hex = hash.toHex();
+        return root_ + "/chunks/" + hex.substr(0, 2) + "/" + hex;
+    }
+
+    std::vector<uint8_t> readFile(const std::string& path) const {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)),
+                                    std::istreambuf_iterator<char>());
+    }
+
+    void writeFile(const std::string& path, const std::vector<uint8_t>& data) const {
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    std::string root_;
+};
+
+} // namespace
+
+TEST_F(StorageManagerTest, CompressedChunksRoundTrip) {
+    StorageManager storage(root_);
+    ASSERT_TRUE(storage.initialize());
+
+    auto data = textData(200000, 1);
+    auto hash = Hash::digest(HashAlgorithm::SHA256, data);
+    ASSERT_TRUE(storage.storeChunk("alice", "notes.txt", 0, data, hash));
+    EXPECT_TRUE(storage.hasChunk(hash));
+    EXPECT_EQ(storage.getChunk(hash), data);
+
+    // Kept compressed on disk
+    auto stored = readFile(chunkPath(hash));
+    EXPECT_LT(stored.size(), data.size() / 2);
+    EXPECT_EQ(Compression::decompressedSize(stored), data.size());
+
+    // With compression off chunks are still framed, just not compressed
+    storage.setCompressionAtRest(false);
+    auto raw = textData(50000, 2);
+    auto raw_hash = Hash::digest(HashAlgorithm::SHA256, raw);
+    ASSERT_TRUE(storage.storeChunk("alice", "raw.txt", 0, raw, raw_hash));
+    auto raw_stored = readFile(chunkPath(raw_hash));
+    EXPECT_EQ(raw_stored.size(), Compression::kFrameHeaderSize + raw.size());
+    EXPECT_EQ(Compression::frameCodec(raw_stored), Codec::None);
+    EXPECT_EQ(storage.getChunk(raw_hash), raw);
+
+    auto stats = storage.getStats();
+    EXPECT_EQ(stats.total_chunks, 2u);
+}
+
+TEST_F(StorageManagerTest, ClientFrameStoredAsReceived) {
+    StorageManager storage(root_);
+    ASSERT_TRUE(storage.initialize());
+
+    auto data = textData(100000, 3);
+    auto frame = Compression::compress(data);
+    auto codec = Compression::frameCodec(frame);
+    ASSERT_TRUE(codec);
+
+    StorageManager::ChunkUpload upload;
+    upload.index = 0;
+    upload.data = data;
+    upload.hash = Hash::digest(HashAlgorithm::BLAKE3, data);
+    upload.algorithm = HashAlgorithm::BLAKE3;
+    upload.codec = *codec;
+    upload.frame = frame;
+    ASSERT_TRUE(storage.storeChunks("alice", "notes.txt", {upload}));
+
+    EXPECT_EQ(readFile(chunkPath(upload.hash)), frame);
+    EXPECT_EQ(storage.getChunk(upload.hash), data);
+
+    // A chunk whose data does not match its hash is refused
+    upload.hash = Hash::digest(HashAlgorithm::BLAKE3, textData(100, 4));
+    EXPECT_FALSE(storage.storeChunks("alice", "notes.txt", {upload}));
+    EXPECT_FALSE(storage.hasChunk(upload.hash));
+}
+
+TEST_F(StorageManagerTest, LegacyChunksFramedOnce) {
+    // A store from before compression at rest: chunks raw, no marker
+    auto legacy = textData(30000, 5);
+    auto legacy_hash = Hash::digest(HashAlgorithm::SHA256, legacy);
+    writeFile(chunkPath(legacy_hash), legacy);
+    // Stray files that are not chunks are left alone
+    writeFile(root_ + "/chunks/00/notes", legacy);
+
+    {
+        StorageManager storage(root_);
+        ASSERT_TRUE(storage.initialize());
+        EXPECT_TRUE(std::filesystem::exists(root_ + "/chunk_format"));
+
+        auto stored = readFile(chunkPath(legacy_hash));
+        EXPECT_EQ(stored.size(), Compression::kFrameHeaderSize + legacy.size());
+        EXPECT_EQ(Compression::frameCodec(stored), Codec::None);
+        EXPECT_EQ(storage.getChunk(legacy_hash), legacy);
+        EXPECT_EQ(readFile(root_ + "/chunks/00/notes"), legacy);
+    }
+
+    // With the marker present the store is not scanned again, so a raw
+    // file appearing later is not mistaken for a legacy chunk and framed
+    auto late = textData(20000, 6);
+    auto late_hash = Hash::digest(HashAlgorithm::SHA256, late);
+    writeFile(chunkPath(late_hash), late);
+    auto framed = readFile(chunkPath(legacy_hash));
+
+    StorageManager reopened(root_);
+    ASSERT_TRUE(reopened.initialize());
+    EXPECT_EQ(readFile(chunkPath(late_hash)), late);
+    EXPECT_EQ(readFile(chunkPath(legacy_hash)), framed);
+    EXPECT_EQ(reopened.getChunk(legacy_hash), legacy);
+}
+
+TEST_F(StorageManagerTest, DictionaryChunksDecodeAfterReload) {
+    if (!Compression::codec(Codec::Zstd)) {
+        GTEST_SKIP() << "built without zstd";
+    }
+
+    auto chunk = config(100000);
+    auto hash = Hash::digest(HashAlgorithm::SHA256, chunk);
+    std::optional<uint32_t> id;
+    {
+        StorageManager storage(root_);
+        ASSERT_TRUE(storage.initialize());
+        for (size_t i = 0; i < 300; i++) {
+            auto data = config(i);
+            std::string path = "services/" + std::to_string(i) + ".json";
+            ASSERT_TRUE(storage.storeChunk("alice", path, 0, data,
+                                           Hash::digest(HashAlgorithm::SHA256, data)));
+            ASSERT_TRUE(storage.finalizeFile("alice", path, 1));
+        }
+
+        id = storage.trainDictionary("alice", "json");
+        ASSERT_TRUE(id);
+        auto dictionary = storage.dictionaryFor("alice", "new.json");
+        ASSERT_TRUE(dictionary);
+        EXPECT_EQ(dictionary->id(), *id);
+        EXPECT_FALSE(storage.dictionaryFor("alice", "new.txt"));
+        EXPECT_FALSE(storage.dictionaryFor("bob", "new.json"));
+
+        // Too small to gain much alone; the dictionary makes it worth it
+        ASSERT_TRUE(storage.storeChunk("alice", "services/new.json", 0, chunk, hash));
+        EXPECT_LT(readFile(chunkPath(hash)).size(), Compression::compressAdaptive(chunk).size() / 2);
+    }
+
+    // The reopened store loads its dictionaries before anything is read
+    StorageManager reopened(root_);
+    ASSERT_TRUE(reopened.initialize());
+    auto dictionary = reopened.dictionaryFor("alice", "other.json");
+    ASSERT_TRUE(dictionary);
+    EXPECT_EQ(dictionary->id(), *id);
+    EXPECT_EQ(reopened.getChunk(hash), chunk);
+}
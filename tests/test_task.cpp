@@ -0,0 +1,131 @@
+#include "common/executor.h"
+#include "common/task.h"
+#include "common/thread_pool.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace dropboxlite;
+using namespace std::chrono_literals;
+
+namespace {
+
+Task<int> square(Executor& executor, int x) {
+    co_return co_await executor.offload([x] { return x * x; });
+}
+
+Task<int> sumOfSquares(Executor& executor, int n) {
+    int total = 0;
+    for (int i = 1; i <= n; i++) {
+        total += co_await square(executor, i);
+    }
+    co_return total;
+}
+
+Task<void> failAfterSleep(Executor& executor) {
+    co_await executor.sleepFor(1ms);
+    throw std::runtime_error("boom");
+}
+
+} // namespace
+
+TEST(TaskTest, ChainedAwaitsReturnValues) {
+    ThreadPool pool(2);
+    Executor executor(pool);
+    
+    EXPECT_EQ(syncWait(sumOfSquares(executor, 10)), 385);
+}
+
+TEST(TaskTest, ExceptionsReachTheAwaiter) {
+    ThreadPool pool(2);
+    Executor executor(pool);
+    
+    auto outer = [](Executor& executor) -> Task<bool> {
+        try {
+            co_await failAfterSleep(executor);
+        } catch (const std::runtime_error&) {
+            co_return true;
+        }
+        co_return false;
+    };
+    EXPECT_TRUE(syncWait(outer(executor)));
+    EXPECT_THROW(syncWait(failAfterSleep(executor)), std::runtime_error);
+}
+
+TEST(TaskTest, SleepWaitsForDeadline) {
+    ThreadPool pool(2);
+    Executor executor(pool);
+    
+    auto start = Executor::Clock::now();
+    auto sleeper = [](Executor& executor) -> Task<void> {
+        co_await executor.sleepFor(30ms);
+        co_await executor.sleepFor(0ms);
+    };
+    syncWait(sleeper(executor));
+    EXPECT_GE(Executor::Clock::now() - start, 30ms);
+}
+
+// Sessions suspended on timers and I/O hold no thread: far more of them
+// than workers overlap their waits
+TEST(TaskTest, ManySessionsShareFewThreads) {
+    ThreadPool pool(2);
+    Executor executor(pool);
+    
+    constexpr int kSessions = 2000;
+    std::atomic<int> finished{0};
+    auto session = [](Executor& executor, std::atomic<int>& finished) -> Task<void> {
+        co_await executor.sleepFor(50ms);
+        int value = co_await executor.blocking([] { return 1; });
+        co_await executor.sleepFor(50ms);
+        finished += value;
+    };
+    
+    auto start = Executor::Clock::now();
+    for (int i = 0; i < kSessions; i++) {
+        executor.spawn(session(executor, finished));
+    }
+    while (executor.inFlight() > 0) {
+        std::this_thread::sleep_for(5ms);
+    }
+    
+    EXPECT_EQ(finished.load(), kSessions);
+    EXPECT_LT(Executor::Clock::now() - start, 5s);
+}
+
+TEST(TaskTest, FileIoRoundTrip) {
+    ThreadPool pool(2);
+    Executor executor(pool);
+    std::string path = (std::filesystem::temp_directory_path() / "test_task_io.bin").string();
+    
+    auto roundTrip = [](Executor& executor, std::string path) -> Task<bool> {
+        std::vector<uint8_t> data(100000);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<uint8_t>(i * 7);
+        }
+        if (!co_await executor.writeFile(path, data)) {
+            co_return false;
+        }
+        auto whole = co_await executor.readFile(path);
+        if (!whole || *whole != data) {
+            co_return false;
+        }
+        
+        int fd = ::open(path.c_str(), O_RDONLY);
+        std::vector<uint8_t> tail(1000);
+        auto n = co_await executor.readAt(fd, data.size() - 400, tail);
+        ::close(fd);
+        co_return n == 400u && std::equal(tail.begin(), tail.begin() + 400, data.end() - 400);
+    };
+    
+    EXPECT_TRUE(syncWait(roundTrip(executor, path)));
+    EXPECT_FALSE(syncWait([](Executor& executor) -> Task<bool> {
+        co_return (co_await executor.readFile("/nonexistent/file")).has_value();
+    }(executor)));
+    std::filesystem::remove(path);
+}
@@ -1,6 +1,16 @@
 #include "common/thread_pool.h"
+#include "common/work_stealing_deque.h"
+#include "common/metrics.h"
+#include "common/parallel.h"
+#include "common/numa_pools.h"
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <atomic>
+#include <array>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
 
 using namespace dropboxlite;
 
@@ -48,3 +58,404 @@ TEST(ThreadPoolTest, Wait) {
     pool.wait();
     EXPECT_EQ(counter.load(), 10);
 }
+
+TEST(ThreadPoolTest, TasksSpawnTasks) {
+    ThreadPool pool(4);
+    
+    // Recursive fan-out: every task but the leaves enqueues two more from
+    // inside the pool
+    std::atomic<int> leaves{0};
+    std::function<void(int)> split = [&](int depth) {
+        if (depth == 0) {
+            leaves++;
+            return;
+        }
+        pool.enqueue(split, depth - 1);
+        pool.enqueue(split, depth - 1);
+    };
+    
+    pool.enqueue(split, 10);
+    pool.wait();
+    EXPECT_EQ(leaves.load(), 1024);
+    EXPECT_EQ(pool.pending(), 0u);
+}
+
+TEST(ThreadPoolTest, SubmitAndPost) {
+    ThreadPool pool(4);
+    
+    auto value = pool.submit([](int a, int b) { return a * b; }, 6, 7);
+    auto failed = pool.submit([] { throw std::runtime_error("boom"); });
+    EXPECT_EQ(value.get(), 42);
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    EXPECT_FALSE(value.valid());
+    
+    std::atomic<int> counter{0};
+    for (int i = 0; i < 1000; i++) {
+        pool.post([&counter] { counter++; });
+    }
+    pool.wait();
+    EXPECT_EQ(counter.load(), 1000);
+}
+
+TEST(ThreadPoolTest, InlineTaskTakesMoveOnlyAndLargeCallables) {
+    auto owned = std::make_unique<int>(5);
+    int seen = 0;
+    InlineTask small([owned = std::move(owned), &seen] { seen = *owned; });
+    InlineTask moved(std::move(small));
+    EXPECT_FALSE(small);
+    moved();
+    EXPECT_EQ(seen, 5);
+    
+    // Too big for the inline buffer, so stored on the heap
+    std::array<int, 64> big{};
+    big[63] = 9;
+    InlineTask large([big, &seen] { seen = big[63]; });
+    InlineTask assigned;
+    assigned = std::move(large);
+    assigned();
+    EXPECT_EQ(seen, 9);
+}
+
+TEST(ThreadPoolTest, BrokenPromise) {
+    Future<int> future;
+    {
+        Promise<int> promise;
+        future = promise.getFuture();
+    }
+    EXPECT_THROW(future.get(), std::future_error);
+}
+
+// Occupies a one-thread pool until released, so a queue can be built up
+class Gate {
+public:
+    void block(ThreadPool& pool) {
+        pool.post(Priority::Interactive, [this] {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this] { return open_; });
+        });
+        while (pool.pending() > 0) {
+            std::this_thread::yield();
+        }
+    }
+    void open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_ = true;
+        condition_.notify_all();
+    }
+private:
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool open_ = false;
+};
+
+TEST(ThreadPoolTest, StrictPriorityRunsInteractiveFirst) {
+    ThreadPool pool(1);
+    Gate gate;
+    gate.block(pool);
+    
+    std::vector<Priority> order;
+    for (int i = 0; i < 5; i++) {
+        pool.post(Priority::Background, [&order] { order.push_back(Priority::Background); });
+        pool.post([&order] { order.push_back(Priority::Normal); });
+    }
+    pool.post(Priority::Interactive, [&order] { order.push_back(Priority::Interactive); });
+    gate.open();
+    pool.wait();
+    
+    ASSERT_EQ(order.size(), 11u);
+    EXPECT_EQ(order[0], Priority::Interactive);
+    for (int i = 1; i <= 5; i++) {
+        EXPECT_EQ(order[i], Priority::Normal);
+    }
+    EXPECT_EQ(pool.laneStats(Priority::Background).completed, 5u);
+}
+
+TEST(ThreadPoolTest, StrictPriorityStealsBeforeLocalLowerLanes) {
+    ThreadPool pool(2);
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool interactive_queued = false;
+    std::vector<Priority> order;
+    
+    // One worker queues Interactive work on its own deque and stays busy
+    // until the other worker, which has Normal work of its own, has run both
+    pool.post([&] {
+        pool.post(Priority::Interactive, [&] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(Priority::Interactive);
+            changed.notify_all();
+        });
+        std::unique_lock<std::mutex> lock(mutex);
+        interactive_queued = true;
+        changed.notify_all();
+        changed.wait_for(lock, std::chrono::seconds(5), [&] { return order.size() == 2; });
+    });
+    pool.post([&] {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return interactive_queued; });
+        }
+        pool.post([&] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(Priority::Normal);
+            changed.notify_all();
+        });
+    });
+    pool.wait();
+    
+    ASSERT_EQ(order.size(), 2u);
+    EXPECT_EQ(order[0], Priority::Interactive);
+}
+
+TEST(ThreadPoolTest, WeightedFairSharesByWeight) {
+    ThreadPool pool(1);
+    pool.setLanePolicy(LanePolicy::WeightedFair);
+    pool.setLaneConfig(Priority::Normal, {3});
+    pool.setLaneConfig(Priority::Background, {1});
+    Gate gate;
+    gate.block(pool);
+    
+    std::vector<Priority> order;
+    for (int i = 0; i < 40; i++) {
+        pool.post(Priority::Normal, [&order] { order.push_back(Priority::Normal); });
+        pool.post(Priority::Background, [&order] { order.push_back(Priority::Background); });
+    }
+    gate.open();
+    pool.wait();
+    
+    // In the first 40 dispatches, about 3 normal tasks per background one
+    auto background = std::count(order.begin(), order.begin() + 40, Priority::Background);
+    EXPECT_GE(background, 8);
+    EXPECT_LE(background, 12);
+}
+
+TEST(ThreadPoolTest, LaneCapAndAging) {
+    ThreadPool pool(4);
+    pool.setLaneConfig(Priority::Background, {1, 1, std::chrono::milliseconds(1)});
+    
+    std::atomic<int> running{0};
+    std::atomic<int> peak{0};
+    for (int i = 0; i < 20; i++) {
+        pool.post(Priority::Background, [&] {
+            int now = ++running;
+            int seen = peak.load();
+            while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            running--;
+        });
+    }
+    
+    // A steady stream of normal work does not starve the capped lane
+    std::atomic<bool> background_done{false};
+    pool.post(Priority::Background, [&background_done] { background_done = true; });
+    for (int i = 0; i < 2000 && !background_done; i++) {
+        pool.post([] { std::this_thread::sleep_for(std::chrono::microseconds(50)); });
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+    pool.wait();
+    
+    EXPECT_TRUE(background_done);
+    EXPECT_EQ(peak.load(), 1);
+    
+    pool.publishMetrics("test_pool");
+    EXPECT_EQ(Metrics::instance().getGauge("test_pool.background.completed"), 21);
+    EXPECT_EQ(Metrics::instance().getGauge("test_pool.background.queue_depth"), 0);
+}
+
+TEST(ParallelTest, ParallelForCoversRangeOnce) {
+    ThreadPool pool(4);
+    std::vector<std::atomic<int>> hits(10000);
+    
+    parallelFor(pool, 0, hits.size(), [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            hits[i]++;
+        }
+    });
+    for (auto& hit : hits) {
+        ASSERT_EQ(hit.load(), 1);
+    }
+    
+    // Nested loops on every worker must not deadlock on queued helpers
+    std::atomic<int> total{0};
+    parallelFor(pool, 0, 8, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            parallelFor(pool, 0, 100, [&](size_t a, size_t b) { total += b - a; });
+        }
+    });
+    EXPECT_EQ(total.load(), 800);
+    
+    EXPECT_THROW(parallelFor(pool, 0, 100, [](size_t lo, size_t) {
+        if (lo == 0) {
+            throw std::runtime_error("boom");
+        }
+    }), std::runtime_error);
+}
+
+TEST(ParallelTest, ParallelReduceSums) {
+    ThreadPool pool(4);
+    uint64_t sum = parallelReduce(pool, 0, 100000, uint64_t{0},
+        [](size_t lo, size_t hi) {
+            uint64_t partial = 0;
+            for (size_t i = lo; i < hi; i++) {
+                partial += i;
+            }
+            return partial;
+        },
+        [](uint64_t a, uint64_t b) { return a + b; }, 64);
+    EXPECT_EQ(sum, 99999ULL * 100000 / 2);
+}
+
+TEST(ParallelTest, PipelineKeepsOrderUnderBound) {
+    ThreadPool pool(4);
+    constexpr int kItems = 500;
+    constexpr size_t kInFlight = 3;
+    
+    struct Item {
+        int value;
+        int squared;
+    };
+    
+    int next = 0;
+    std::atomic<int> live{0};
+    std::atomic<int> peak{0};
+    std::vector<int> output;
+    
+    Pipeline<Item> pipeline(kInFlight);
+    pipeline.source([&](Item& item) {
+                if (next == kItems) {
+                    return false;
+                }
+                item.value = next++;
+                int now = ++live;
+                int seen = peak.load();
+                while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+                }
+                return true;
+            })
+            .stage(StageMode::Parallel, [](Item& item) { item.squared = item.value * item.value; })
+            .stage(StageMode::Serial, [&](Item& item) {
+                output.push_back(item.squared);
+                live--;
+            })
+            .run(pool);
+    
+    ASSERT_EQ(output.size(), static_cast<size_t>(kItems));
+    for (int i = 0; i < kItems; i++) {
+        ASSERT_EQ(output[i], i * i);
+    }
+    EXPECT_LE(peak.load(), static_cast<int>(kInFlight));
+}
+
+TEST(WorkStealingDequeTest, OwnerPopsNewestThievesStealOldest) {
+    WorkStealingDeque<int> deque(2);
+    int items[5] = {0, 1, 2, 3, 4};
+    for (int& item : items) {
+        deque.push(&item);
+    }
+    
+    EXPECT_EQ(deque.size(), 5u);
+    EXPECT_EQ(deque.pop(), &items[4]);
+    EXPECT_EQ(deque.steal(), &items[0]);
+    EXPECT_EQ(deque.steal(), &items[1]);
+    EXPECT_EQ(deque.pop(), &items[3]);
+    EXPECT_EQ(deque.pop(), &items[2]);
+    EXPECT_EQ(deque.pop(), nullptr);
+    EXPECT_EQ(deque.steal(), nullptr);
+}
+
+TEST(WorkStealingDequeTest, EveryItemTakenOnce) {
+    constexpr int kItems = 100000;
+    WorkStealingDeque<int> deque;
+    std::vector<int> items(kItems);
+    std::vector<std::atomic<int>> taken(kItems);
+    std::atomic<bool> done{false};
+    
+    auto take = [&](int* item) {
+        taken[item - items.data()]++;
+    };
+    
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < 3; i++) {
+        thieves.emplace_back([&] {
+            while (!done || !deque.empty()) {
+                if (int* item = deque.steal()) {
+                    take(item);
+                }
+            }
+        });
+    }
+    
+    for (int i = 0; i < kItems; i++) {
+        deque.push(&items[i]);
+        if (i % 3 == 0) {
+            if (int* item = deque.pop()) {
+                take(item);
+            }
+        }
+    }
+    while (int* item = deque.pop()) {
+        take(item);
+    }
+    done = true;
+    for (auto& thief : thieves) {
+        thief.join();
+    }
+    
+    for (int i = 0; i < kItems; i++) {
+        ASSERT_EQ(taken[i].load(), 1) << "item " << i;
+    }
+}
+
+TEST(NumaTest, ParseCpuList) {
+    EXPECT_EQ(NumaTopology::parseCpuList("0-3,8,10-11\n"),
+              (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_TRUE(NumaTopology::parseCpuList("").empty());
+    EXPECT_TRUE(NumaTopology::parseCpuList("x-1").empty());
+}
+
+TEST(NumaTest, DetectReadsSysfsLayout) {
+    auto root = std::filesystem::temp_directory_path() / "test_numa_nodes";
+    std::filesystem::remove_all(root);
+    for (auto [name, cpus] : {std::pair{"node0", "0-1"}, {"node2", "2,3"}, {"node3", ""}}) {
+        std::filesystem::create_directories(root / name);
+        std::ofstream(root / name / "cpulist") << cpus << "\n";
+    }
+    std::filesystem::create_directories(root / "power");
+    
+    NumaTopology topology = NumaTopology::detect(root.string());
+    ASSERT_EQ(topology.nodeCount(), 2u);
+    EXPECT_EQ(topology.nodes()[1].id, 2);
+    EXPECT_EQ(topology.nodeOfCpu(3), 2);
+    EXPECT_EQ(topology.nodeOfCpu(7), -1);
+    
+    NumaTopology restricted = topology.restrictTo({1, 2});
+    ASSERT_EQ(restricted.nodeCount(), 2u);
+    EXPECT_EQ(restricted.nodes()[0].cpus, std::vector<int>{1});
+    EXPECT_EQ(topology.restrictTo({0}).nodeCount(), 1u);
+    
+    EXPECT_EQ(NumaTopology::detect((root / "missing").string()).nodeCount(), 1u);
+    std::filesystem::remove_all(root);
+}
+
+TEST(NumaTest, PoolsRunWorkNearItsData) {
+    NumaPools pools(NumaTopology::system(), 2);
+    ASSERT_GE(pools.nodeCount(), 1u);
+    
+    NodeBuffer buffer = pools.allocate(1 << 16);
+    ASSERT_EQ(buffer.size(), 1u << 16);
+    // Asking where an untouched page lives must not fault it in
+    EXPECT_EQ(NumaTopology::nodeOfAddress(buffer.data()), -1);
+    std::fill(buffer.data(), buffer.data() + buffer.size(), 1);
+    
+    auto sum = pools.submitNear(buffer.data(), [&buffer] {
+        return std::accumulate(buffer.data(), buffer.data() + buffer.size(), size_t{0});
+    });
+    EXPECT_EQ(sum.get(), 1u << 16);
+    
+    // Unknown nodes fall back to a real pool
+    std::atomic<int> ran{0};
+    pools.pool(12345).post([&ran] { ran++; });
+    pools.wait();
+    EXPECT_EQ(ran.load(), 1);
+}